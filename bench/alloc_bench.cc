@@ -0,0 +1,707 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+// Suite of allocation-path benchmarks. Every benchmark reports operations per
+// second, nanoseconds and cycles (TSC) per operation, and the peak and final
+// RSS while it ran. Where perf_event_open() is permitted, CPU cycles, cache
+// misses, and dTLB load misses per operation of all benchmark threads are
+// reported as well.
+//
+// Benchmarks:
+//   sizes       Single-thread malloc/free latency per size class.
+//   remote      Producers allocate objects that consumers free (remote frees).
+//   larson      Threads replace random objects of a shared-nothing slot array;
+//               every round hands the slots over to a fresh thread.
+//   threadtest  Threads allocate and free batches of fixed-size objects.
+//   shbench     Threads allocate mostly small objects of random sizes, freeing
+//               some of them early and the rest in a burst.
+//   aligned     Single-thread posix_memalign()/free latency per alignment,
+//               next to malloc() of the same size.
+//   batch       Single-thread allocation and free of batches of same-size
+//               objects, through malloc()/free() and through scalloc's batch
+//               API if the allocator under test exports it.
+//   realloc     Grows buffers with realloc() in small increments.
+//   large       Allocates and touches large objects.
+//   churn       Starts short-lived threads in waves.
+//
+// Usage: alloc_bench [-t threads (online CPUs)] [-n operations (4000000)]
+//                    [-r rss trace interval in ms (0: off)] [benchmark...]
+//
+// Operations are per thread for multithreaded benchmarks. Run with the
+// allocator under test preloaded, e.g.,
+// tools/run_with_scalloc.sh bench/alloc_bench sizes remote
+
+#include <dlfcn.h>
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+
+namespace {
+
+int num_threads = 1;
+int operations = 4000000;
+int rss_trace_ms = 0;
+
+
+double Now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+uint64_t Ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __builtin_ia32_rdtsc();
+#else
+  return 0;
+#endif
+}
+
+
+size_t Rss() {
+  long pages = 0;  // NOLINT
+  FILE* f = fopen("/proc/self/statm", "r");
+  if (f != NULL) {
+    if (fscanf(f, "%*s %ld", &pages) != 1) {
+      pages = 0;
+    }
+    fclose(f);
+  }
+  return static_cast<size_t>(pages) * sysconf(_SC_PAGESIZE);
+}
+
+
+// Samples the RSS of the process in the background. The peak is reset at the
+// start of every benchmark.
+class RssSampler {
+ public:
+  void Start() {
+    pthread_t tid;
+    pthread_create(&tid, NULL, Main, this);
+    pthread_detach(tid);
+  }
+
+  void Reset() { peak_.store(Rss()); }
+  size_t peak() { return peak_.load(); }
+
+ private:
+  static void* Main(void* arg) {
+    RssSampler* sampler = reinterpret_cast<RssSampler*>(arg);
+    const double start = Now();
+    const int interval_ms = (rss_trace_ms > 0) ? rss_trace_ms : 10;
+    while (true) {
+      usleep(interval_ms * 1000);
+      const size_t rss = Rss();
+      size_t peak = sampler->peak_.load();
+      while ((rss > peak) && !sampler->peak_.compare_exchange_weak(peak, rss)) {
+      }
+      if (rss_trace_ms > 0) {
+        fprintf(stderr, "rss: %.2f s %zu KiB\n", Now() - start, rss >> 10);
+      }
+    }
+    return NULL;
+  }
+
+  std::atomic<size_t> peak_;
+};
+
+RssSampler rss_sampler;
+
+
+// Hardware counters of the calling thread and all threads it creates while
+// the counters are enabled.
+class Counters {
+ public:
+  enum Event { kCycles, kCacheMisses, kTlbMisses, kNumEvents };
+
+  Counters() {
+    const uint64_t configs[kNumEvents][2] = {
+      { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+      { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+      { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB |
+                            (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                            (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+    };
+    for (int i = 0; i < kNumEvents; i++) {
+      struct perf_event_attr attr;
+      memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = configs[i][0];
+      attr.config = configs[i][1];
+      attr.disabled = 1;
+      attr.inherit = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      fds_[i] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+  }
+
+  ~Counters() {
+    for (int i = 0; i < kNumEvents; i++) {
+      if (fds_[i] >= 0) close(fds_[i]);
+    }
+  }
+
+  void Start() {
+    for (int i = 0; i < kNumEvents; i++) {
+      if (fds_[i] >= 0) {
+        ioctl(fds_[i], PERF_EVENT_IOC_RESET, 0);
+        ioctl(fds_[i], PERF_EVENT_IOC_ENABLE, 0);
+      }
+    }
+  }
+
+  void Stop() {
+    for (int i = 0; i < kNumEvents; i++) {
+      if (fds_[i] >= 0) ioctl(fds_[i], PERF_EVENT_IOC_DISABLE, 0);
+    }
+  }
+
+  // Returns false if the event is not available.
+  bool Read(Event event, uint64_t* value) {
+    return (fds_[event] >= 0) &&
+           (read(fds_[event], value, sizeof(*value)) == sizeof(*value));
+  }
+
+ private:
+  int fds_[kNumEvents];
+};
+
+
+// Measures a single benchmark (or a part of it) and prints its results.
+class Measurement {
+ public:
+  explicit Measurement(const char* name) : name_(name) {
+    rss_sampler.Reset();
+    counters_.Start();
+    start_ticks_ = Ticks();
+    start_ = Now();
+  }
+
+  void Finish(uint64_t ops) {
+    const double elapsed = Now() - start_;
+    const uint64_t ticks = Ticks() - start_ticks_;
+    counters_.Stop();
+    const double n = (ops > 0) ? static_cast<double>(ops) : 1;
+    printf("%-16s %12.0f ops/s %9.2f ns/op %9.2f tsc/op", name_,
+           ops / elapsed, elapsed * 1e9 / n, ticks / n);
+    uint64_t value;
+    if (counters_.Read(Counters::kCycles, &value)) {
+      printf(" %9.2f cycles/op", value / n);
+    }
+    if (counters_.Read(Counters::kCacheMisses, &value)) {
+      printf(" %7.3f cache-misses/op", value / n);
+    }
+    if (counters_.Read(Counters::kTlbMisses, &value)) {
+      printf(" %7.3f dtlb-misses/op", value / n);
+    }
+    const size_t rss = Rss();
+    const size_t peak = (rss_sampler.peak() > rss) ? rss_sampler.peak() : rss;
+    printf(" rss %zu/%zu KiB\n", peak >> 10, rss >> 10);
+    fflush(stdout);
+  }
+
+ private:
+  const char* name_;
+  Counters counters_;
+  double start_;
+  uint64_t start_ticks_;
+};
+
+
+// Runs body on num_threads threads, passing the i-th thread the i-th element
+// of args, and waits for them.
+void RunThreads(void* (*body)(void*), void* args, size_t arg_size) {
+  pthread_t* tids = new pthread_t[num_threads];
+  for (int i = 0; i < num_threads; i++) {
+    if (pthread_create(&tids[i], NULL, body,
+                       reinterpret_cast<char*>(args) + i * arg_size) != 0) {
+      fprintf(stderr, "pthread_create failed\n");
+      exit(1);
+    }
+  }
+  for (int i = 0; i < num_threads; i++) {
+    pthread_join(tids[i], NULL);
+  }
+  delete[] tids;
+}
+
+
+// sizes ----------------------------------------------------------------------
+
+void BenchSizes() {
+  const int kBatch = 64;
+  void* objects[kBatch];
+  // Fine classes, then four sizes per power of two up to 1MiB.
+  size_t sizes[128];
+  int num_sizes = 0;
+  for (size_t size = 16; size <= 256; size += 16) {
+    sizes[num_sizes++] = size;
+  }
+  for (size_t p = 256; p < (1 << 20); p *= 2) {
+    for (int i = 1; i <= 4; i++) {
+      sizes[num_sizes++] = p + i * (p / 4);
+    }
+  }
+  for (int s = 0; s < num_sizes; s++) {
+    // Fewer operations for larger sizes, so that every size takes about the
+    // same time.
+    const int ops = (sizes[s] <= 4096) ? operations :
+        operations / static_cast<int>(sizes[s] / 4096);
+    char name[32];
+    snprintf(name, sizeof(name), "sizes/%zu", sizes[s]);
+    Measurement m(name);
+    for (int done = 0; done < ops; done += kBatch) {
+      for (int i = 0; i < kBatch; i++) {
+        objects[i] = malloc(sizes[s]);
+        *reinterpret_cast<char*>(objects[i]) = 1;
+      }
+      for (int i = 0; i < kBatch; i++) {
+        free(objects[i]);
+      }
+    }
+    m.Finish(ops);
+  }
+}
+
+
+// remote ---------------------------------------------------------------------
+
+// Single-producer single-consumer ring.
+struct Channel {
+  static const int kSize = 1024;
+  std::atomic<uint64_t> head;
+  char pad1[64];
+  std::atomic<uint64_t> tail;
+  char pad2[64];
+  void* slots[kSize];
+};
+
+struct RemoteArgs {
+  Channel* channel;
+  bool producer;
+  char pad[64];
+};
+
+
+void* RemoteMain(void* arg) {
+  RemoteArgs* args = reinterpret_cast<RemoteArgs*>(arg);
+  Channel* c = args->channel;
+  unsigned seed = static_cast<unsigned>(reinterpret_cast<uintptr_t>(c));
+  for (int i = 0; i < operations; i++) {
+    if (args->producer) {
+      void* p = malloc(16 + (rand_r(&seed) % 512));
+      *reinterpret_cast<char*>(p) = 1;
+      const uint64_t tail = c->tail.load(std::memory_order_relaxed);
+      while ((tail - c->head.load(std::memory_order_acquire)) ==
+             Channel::kSize) {
+        sched_yield();
+      }
+      c->slots[tail % Channel::kSize] = p;
+      c->tail.store(tail + 1, std::memory_order_release);
+    } else {
+      const uint64_t head = c->head.load(std::memory_order_relaxed);
+      while (c->tail.load(std::memory_order_acquire) == head) {
+        sched_yield();
+      }
+      free(c->slots[head % Channel::kSize]);
+      c->head.store(head + 1, std::memory_order_release);
+    }
+  }
+  return NULL;
+}
+
+
+void BenchRemote() {
+  const int saved_threads = num_threads;
+  // At least one producer/consumer pair.
+  const int pairs = (num_threads > 1) ? num_threads / 2 : 1;
+  num_threads = 2 * pairs;
+  Channel* channels = new Channel[pairs];
+  RemoteArgs* args = new RemoteArgs[num_threads];
+  for (int i = 0; i < num_threads; i++) {
+    args[i].channel = &channels[i / 2];
+    args[i].channel->head.store(0);
+    args[i].channel->tail.store(0);
+    args[i].producer = (i % 2) == 0;
+  }
+  Measurement m("remote");
+  RunThreads(RemoteMain, args, sizeof(*args));
+  m.Finish(static_cast<uint64_t>(pairs) * operations);
+  delete[] args;
+  delete[] channels;
+  num_threads = saved_threads;
+}
+
+
+// larson ---------------------------------------------------------------------
+
+const int kLarsonSlots = 1000;
+const int kLarsonRounds = 10;
+
+struct LarsonArgs {
+  void* slots[kLarsonSlots];
+  unsigned seed;
+};
+
+
+void* LarsonMain(void* arg) {
+  LarsonArgs* args = reinterpret_cast<LarsonArgs*>(arg);
+  for (int i = 0; i < operations / kLarsonRounds; i++) {
+    const int slot = rand_r(&args->seed) % kLarsonSlots;
+    free(args->slots[slot]);
+    args->slots[slot] = malloc(8 + (rand_r(&args->seed) % 1024));
+    *reinterpret_cast<char*>(args->slots[slot]) = 1;
+  }
+  return NULL;
+}
+
+
+void BenchLarson() {
+  LarsonArgs* args = new LarsonArgs[num_threads];
+  for (int i = 0; i < num_threads; i++) {
+    args[i].seed = i + 1;
+    for (int j = 0; j < kLarsonSlots; j++) {
+      args[i].slots[j] = malloc(8 + (rand_r(&args[i].seed) % 1024));
+    }
+  }
+  Measurement m("larson");
+  // Every round starts fresh threads that free objects of the previous ones.
+  for (int round = 0; round < kLarsonRounds; round++) {
+    RunThreads(LarsonMain, args, sizeof(*args));
+  }
+  m.Finish(static_cast<uint64_t>(num_threads) *
+           (operations / kLarsonRounds) * kLarsonRounds);
+  for (int i = 0; i < num_threads; i++) {
+    for (int j = 0; j < kLarsonSlots; j++) {
+      free(args[i].slots[j]);
+    }
+  }
+  delete[] args;
+}
+
+
+// threadtest -----------------------------------------------------------------
+
+void* ThreadtestMain(void*) {
+  const int kObjects = 10000;
+  void** objects = reinterpret_cast<void**>(malloc(kObjects * sizeof(void*)));
+  for (int done = 0; done < operations; done += kObjects) {
+    for (int i = 0; i < kObjects; i++) {
+      objects[i] = malloc(64);
+      *reinterpret_cast<char*>(objects[i]) = 1;
+    }
+    for (int i = 0; i < kObjects; i++) {
+      free(objects[i]);
+    }
+  }
+  free(objects);
+  return NULL;
+}
+
+
+void BenchThreadtest() {
+  Measurement m("threadtest");
+  RunThreads(ThreadtestMain, NULL, 0);
+  m.Finish(static_cast<uint64_t>(num_threads) * operations);
+}
+
+
+// shbench --------------------------------------------------------------------
+
+struct ShbenchArgs {
+  unsigned seed;
+  char pad[60];
+};
+
+
+void* ShbenchMain(void* arg) {
+  ShbenchArgs* args = reinterpret_cast<ShbenchArgs*>(arg);
+  const int kBatch = 1000;
+  void* objects[kBatch];
+  for (int done = 0; done < operations; done += kBatch) {
+    for (int i = 0; i < kBatch; i++) {
+      // Small sizes are much more likely than larger ones.
+      const unsigned r = rand_r(&args->seed);
+      const size_t size = 1 + (r % ((r & 7) == 0 ? 1000 : 100));
+      objects[i] = malloc(size);
+      *reinterpret_cast<char*>(objects[i]) = 1;
+      // Free every other object right away.
+      if ((i % 2) == 1) {
+        free(objects[i - 1]);
+        objects[i - 1] = NULL;
+      }
+    }
+    for (int i = 0; i < kBatch; i++) {
+      free(objects[i]);
+    }
+  }
+  return NULL;
+}
+
+
+void BenchShbench() {
+  ShbenchArgs* args = new ShbenchArgs[num_threads];
+  for (int i = 0; i < num_threads; i++) {
+    args[i].seed = i + 1;
+  }
+  Measurement m("shbench");
+  RunThreads(ShbenchMain, args, sizeof(*args));
+  m.Finish(static_cast<uint64_t>(num_threads) * operations);
+  delete[] args;
+}
+
+
+// aligned --------------------------------------------------------------------
+
+void BenchAligned() {
+  const int kBatch = 64;
+  void* objects[kBatch];
+  const size_t kAlignments[] = { 64, 4096, 65536, 2 << 20 };
+  const size_t kSize = 4000;
+  for (size_t a = 0; a < sizeof(kAlignments) / sizeof(kAlignments[0]); a++) {
+    // Large alignments are served by large objects.
+    const int ops = (kAlignments[a] <= 65536) ? operations : operations / 4096;
+    for (int aligned = 0; aligned <= 1; aligned++) {
+      char name[32];
+      snprintf(name, sizeof(name), "%s/%zu",
+               aligned ? "aligned" : "malloc", kAlignments[a]);
+      Measurement m(name);
+      for (int done = 0; done < ops; done += kBatch) {
+        for (int i = 0; i < kBatch; i++) {
+          if (!aligned) {
+            objects[i] = malloc(kSize);
+          } else if (posix_memalign(&objects[i], kAlignments[a], kSize) != 0) {
+            objects[i] = NULL;
+          }
+          *reinterpret_cast<char*>(objects[i]) = 1;
+        }
+        for (int i = 0; i < kBatch; i++) {
+          free(objects[i]);
+        }
+      }
+      m.Finish(ops);
+    }
+  }
+}
+
+
+// batch ----------------------------------------------------------------------
+
+void BenchBatch() {
+  typedef size_t (*MallocBatch)(size_t size, void** ptrs, size_t n);
+  typedef void (*FreeBatch)(void** ptrs, size_t n);
+  MallocBatch malloc_batch = reinterpret_cast<MallocBatch>(
+      dlsym(RTLD_DEFAULT, "scalloc_malloc_batch"));
+  FreeBatch free_batch = reinterpret_cast<FreeBatch>(
+      dlsym(RTLD_DEFAULT, "scalloc_free_batch"));
+  const int kBatch = 256;
+  void* objects[kBatch];
+  const size_t kSizes[] = { 16, 64, 256, 1024 };
+  for (size_t s = 0; s < sizeof(kSizes) / sizeof(kSizes[0]); s++) {
+    for (int batched = 0; batched <= 1; batched++) {
+      if (batched && ((malloc_batch == NULL) || (free_batch == NULL))) {
+        printf("batch/%zu: no batch API\n", kSizes[s]);
+        continue;
+      }
+      char name[32];
+      snprintf(name, sizeof(name), "%s/%zu",
+               batched ? "batch" : "single", kSizes[s]);
+      Measurement m(name);
+      for (int done = 0; done < operations; done += kBatch) {
+        if (batched) {
+          if (malloc_batch(kSizes[s], objects, kBatch) != kBatch) {
+            fprintf(stderr, "batch allocation failed\n");
+            exit(1);
+          }
+        } else {
+          for (int i = 0; i < kBatch; i++) {
+            objects[i] = malloc(kSizes[s]);
+          }
+        }
+        for (int i = 0; i < kBatch; i++) {
+          *reinterpret_cast<char*>(objects[i]) = 1;
+        }
+        if (batched) {
+          free_batch(objects, kBatch);
+        } else {
+          for (int i = 0; i < kBatch; i++) {
+            free(objects[i]);
+          }
+        }
+      }
+      m.Finish(operations);
+    }
+  }
+}
+
+
+// realloc --------------------------------------------------------------------
+
+void BenchRealloc() {
+  Measurement m("realloc");
+  unsigned seed = 1;
+  int ops = 0;
+  while (ops < operations) {
+    char* p = NULL;
+    size_t size = 0;
+    // Grow in small steps up to 1MiB, like a string builder would.
+    while (size < (1 << 20)) {
+      size += 1 + (rand_r(&seed) % 64);
+      p = reinterpret_cast<char*>(realloc(p, size));
+      p[size - 1] = 1;
+      ops++;
+    }
+    free(p);
+  }
+  m.Finish(ops);
+}
+
+
+// large ----------------------------------------------------------------------
+
+void BenchLarge() {
+  const int kObjects = 16;
+  void* objects[kObjects];
+  unsigned seed = 1;
+  const int ops = operations / 4096;
+  Measurement m("large");
+  for (int done = 0; done < ops; done += kObjects) {
+    for (int i = 0; i < kObjects; i++) {
+      const size_t size = (1 << 20) + (rand_r(&seed) % (15 << 20));
+      objects[i] = malloc(size);
+      reinterpret_cast<char*>(objects[i])[0] = 1;
+      reinterpret_cast<char*>(objects[i])[size - 1] = 1;
+    }
+    for (int i = 0; i < kObjects; i++) {
+      free(objects[i]);
+    }
+  }
+  m.Finish(ops);
+}
+
+
+// churn ----------------------------------------------------------------------
+
+void* ChurnMain(void* arg) {
+  void** handed_over = reinterpret_cast<void**>(arg);
+  // Free what the previous wave left behind.
+  for (int i = 0; i < 8; i++) {
+    free(handed_over[i]);
+  }
+  void* objects[256];
+  for (int i = 0; i < 256; i++) {
+    objects[i] = malloc(16 + (i * 37) % 2048);
+  }
+  for (int i = 0; i < 256; i++) {
+    if (i < 8) {
+      handed_over[i] = objects[i];
+    } else {
+      free(objects[i]);
+    }
+  }
+  return NULL;
+}
+
+
+void BenchChurn() {
+  const int threads = operations / 256;
+  void** handed_over =
+      reinterpret_cast<void**>(calloc(num_threads * 8, sizeof(void*)));
+  Measurement m("churn");
+  for (int done = 0; done < threads; done += num_threads) {
+    RunThreads(ChurnMain, handed_over, 8 * sizeof(void*));
+  }
+  // Operations are threads here.
+  m.Finish(threads);
+  for (int i = 0; i < num_threads * 8; i++) {
+    free(handed_over[i]);
+  }
+  free(handed_over);
+}
+
+
+struct Benchmark {
+  const char* name;
+  void (*run)();
+};
+
+const Benchmark kBenchmarks[] = {
+  { "sizes", BenchSizes },
+  { "remote", BenchRemote },
+  { "larson", BenchLarson },
+  { "threadtest", BenchThreadtest },
+  { "shbench", BenchShbench },
+  { "aligned", BenchAligned },
+  { "batch", BenchBatch },
+  { "realloc", BenchRealloc },
+  { "large", BenchLarge },
+  { "churn", BenchChurn },
+};
+const int kNumBenchmarks = sizeof(kBenchmarks) / sizeof(kBenchmarks[0]);
+
+
+void Usage(const char* argv0) {
+  fprintf(stderr, "usage: %s [-t threads] [-n operations] [-r rss trace ms] "
+                  "[benchmark...]\nbenchmarks:", argv0);
+  for (int i = 0; i < kNumBenchmarks; i++) {
+    fprintf(stderr, " %s", kBenchmarks[i].name);
+  }
+  fprintf(stderr, "\n");
+  exit(1);
+}
+
+}  // namespace
+
+
+int main(int argc, char** argv) {
+  num_threads = static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN));
+  int opt;
+  while ((opt = getopt(argc, argv, "t:n:r:")) != -1) {
+    switch (opt) {
+      case 't': num_threads = atoi(optarg); break;
+      case 'n': operations = atoi(optarg); break;
+      case 'r': rss_trace_ms = atoi(optarg); break;
+      default: Usage(argv[0]);
+    }
+  }
+  if ((num_threads <= 0) || (operations <= 0) || (rss_trace_ms < 0)) {
+    Usage(argv[0]);
+  }
+  bool selected[kNumBenchmarks];
+  for (int i = 0; i < kNumBenchmarks; i++) {
+    selected[i] = (optind == argc);
+  }
+  for (int arg = optind; arg < argc; arg++) {
+    int i = 0;
+    while ((i < kNumBenchmarks) &&
+           (strcmp(argv[arg], kBenchmarks[i].name) != 0)) {
+      i++;
+    }
+    if (i == kNumBenchmarks) {
+      Usage(argv[0]);
+    }
+    selected[i] = true;
+  }
+
+  printf("threads: %d, operations: %d\n", num_threads, operations);
+  rss_sampler.Reset();
+  rss_sampler.Start();
+  for (int i = 0; i < kNumBenchmarks; i++) {
+    if (selected[i]) {
+      kBenchmarks[i].run();
+    }
+  }
+  return 0;
+}
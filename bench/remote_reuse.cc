@@ -0,0 +1,89 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+// Stresses the reusable span lists of cores with remote frees. Threads share a
+// table of slots; each operation allocates an object, swaps it into a random
+// slot, and frees the object it got out, which has most likely been allocated
+// by another thread. The default object size belongs to a size class with 64
+// objects per span, so spans frequently cross the reuse threshold and become
+// empty through remote frees.
+//
+// Usage: remote_reuse [threads (8)] [operations per thread (2000000)]
+//                     [object size (512)]
+//
+// Run with the allocator under test preloaded, e.g.,
+// tools/run_with_scalloc.sh bench/remote_reuse
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <atomic>
+
+namespace {
+
+const int kSlots = 1 << 14;
+
+std::atomic<void*> slots[kSlots];
+int operations = 2000000;
+size_t object_size = 512;
+
+
+void* ThreadMain(void* arg) {
+  unsigned seed = static_cast<unsigned>(reinterpret_cast<uintptr_t>(arg));
+  for (int i = 0; i < operations; i++) {
+    void* p = malloc(object_size);
+    *reinterpret_cast<char*>(p) = 1;
+    void* old = slots[rand_r(&seed) % kSlots].exchange(p);
+    free(old);
+  }
+  return NULL;
+}
+
+
+double Now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+}  // namespace
+
+
+int main(int argc, char** argv) {
+  const int threads = (argc > 1) ? atoi(argv[1]) : 8;
+  operations = (argc > 2) ? atoi(argv[2]) : 2000000;
+  object_size = (argc > 3) ? atoi(argv[3]) : 512;
+  if ((threads <= 0) || (operations <= 0) || (object_size == 0)) {
+    fprintf(stderr, "usage: %s [threads] [operations] [object size]\n",
+            argv[0]);
+    return 1;
+  }
+
+  pthread_t* tids = new pthread_t[threads];
+  const double start = Now();
+  for (int i = 0; i < threads; i++) {
+    if (pthread_create(&tids[i], NULL, ThreadMain,
+                       reinterpret_cast<void*>(i + 1)) != 0) {
+      fprintf(stderr, "pthread_create failed\n");
+      return 1;
+    }
+  }
+  for (int i = 0; i < threads; i++) {
+    pthread_join(tids[i], NULL);
+  }
+  const double elapsed = Now() - start;
+  for (int i = 0; i < kSlots; i++) {
+    free(slots[i].load());
+  }
+
+  printf("threads: %d, operations per thread: %d, object size: %zu\n",
+         threads, operations, object_size);
+  printf("time: %.3f s, %.1f ns per operation\n",
+         elapsed, elapsed * 1e9 / (static_cast<double>(threads) * operations));
+  return 0;
+}
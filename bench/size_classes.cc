@@ -0,0 +1,85 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+// Measures the allocation fast path for sizes of different ranges, which
+// mostly exercises the size-to-class mapping and the size-class metadata.
+// A single thread repeatedly allocates a batch of objects of random sizes in
+// the range and frees them again, so that all objects come from the thread's
+// own hot spans.
+//
+// Usage: size_classes [operations per range (20000000)]
+//
+// Run with the allocator under test preloaded, e.g.,
+// tools/run_with_scalloc.sh bench/size_classes
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+namespace {
+
+const int kBatch = 64;
+// Random sizes are precomputed, so that generating them is not measured.
+const int kSizes = 1 << 12;
+
+struct Range {
+  const char* name;
+  size_t min;
+  size_t max;
+};
+
+const Range kRanges[] = {
+  { "fixed 32", 32, 32 },
+  { "small", 1, 256 },
+  { "medium <4K", 257, 4096 },
+  { "medium <64K", 4097, 65536 },
+  { "mixed", 1, 65536 },
+};
+
+
+double Now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+double Run(const Range& range, int operations) {
+  static size_t sizes[kSizes];
+  static void* objects[kBatch];
+  unsigned seed = 1;
+  for (int i = 0; i < kSizes; i++) {
+    sizes[i] = range.min + rand_r(&seed) % (range.max - range.min + 1);
+  }
+  int next = 0;
+  const double start = Now();
+  for (int done = 0; done < operations; done += kBatch) {
+    for (int i = 0; i < kBatch; i++) {
+      objects[i] = malloc(sizes[next]);
+      next = (next + 1) & (kSizes - 1);
+    }
+    for (int i = 0; i < kBatch; i++) {
+      free(objects[i]);
+    }
+  }
+  return (Now() - start) * 1e9 / operations;
+}
+
+}  // namespace
+
+
+int main(int argc, char** argv) {
+  const int operations = (argc > 1) ? atoi(argv[1]) : 20000000;
+  if (operations <= 0) {
+    fprintf(stderr, "usage: %s [operations]\n", argv[0]);
+    return 1;
+  }
+  // Warm up spans and caches of all classes.
+  Run(kRanges[sizeof(kRanges) / sizeof(kRanges[0]) - 1], operations / 10);
+  for (size_t i = 0; i < sizeof(kRanges) / sizeof(kRanges[0]); i++) {
+    printf("%-12s %6.2f ns per malloc/free\n",
+           kRanges[i].name, Run(kRanges[i], operations));
+  }
+  return 0;
+}
@@ -0,0 +1,175 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+// Churns through many short-lived threads. Threads are started in waves; each
+// thread allocates a mix of small and medium objects, frees most of them, and
+// hands the rest over to the next wave, which frees them remotely after the
+// allocating thread has terminated.
+//
+// Usage: thread_churn [threads (100000)] [threads per wave (64)]
+//                     [objects per thread (256)]
+//
+// Run with the allocator under test preloaded, e.g.,
+// tools/run_with_scalloc.sh bench/thread_churn
+
+#include <dlfcn.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace {
+
+int objects_per_thread = 256;
+
+struct Work {
+  void** inherited;
+  int inherited_len;
+  void** handed_over;
+  int handed_over_len;
+  unsigned seed;
+};
+
+
+size_t NextSize(unsigned* seed) {
+  const unsigned r = rand_r(seed);
+  // Mostly small objects, some medium ones.
+  if ((r % 16) == 0) {
+    return 4096 + (r % (64 * 1024));
+  }
+  return 8 + (r % 512);
+}
+
+
+void* ThreadMain(void* arg) {
+  Work* work = reinterpret_cast<Work*>(arg);
+  for (int i = 0; i < work->inherited_len; i++) {
+    free(work->inherited[i]);
+  }
+  void** objects = reinterpret_cast<void**>(
+      malloc(objects_per_thread * sizeof(void*)));
+  for (int i = 0; i < objects_per_thread; i++) {
+    objects[i] = malloc(NextSize(&work->seed));
+    memset(objects[i], 0xab, 8);
+  }
+  // Keep every 8th object alive for the next wave.
+  work->handed_over_len = 0;
+  for (int i = 0; i < objects_per_thread; i++) {
+    if ((i % 8) == 0) {
+      work->handed_over[work->handed_over_len++] = objects[i];
+    } else {
+      free(objects[i]);
+    }
+  }
+  free(objects);
+  return NULL;
+}
+
+
+double Now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+long ResidentKiB() {
+  long size = 0;
+  long pages = 0;
+  FILE* f = fopen("/proc/self/statm", "r");
+  if (f != NULL) {
+    if (fscanf(f, "%ld %ld", &size, &pages) != 2) {
+      pages = 0;
+    }
+    fclose(f);
+  }
+  return pages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+
+// Prints scalloc statistics if the allocator under test provides mallctl().
+void PrintAllocatorStats() {
+  typedef int (*MallctlFunc)(const char*, void*, size_t*, void*, size_t);
+  MallctlFunc mallctl =
+      reinterpret_cast<MallctlFunc>(dlsym(RTLD_DEFAULT, "mallctl"));
+  if (mallctl == NULL) {
+    return;
+  }
+  uint64_t epoch = 1;
+  uint64_t value;
+  size_t len = sizeof(value);
+  mallctl("epoch", NULL, NULL, &epoch, sizeof(epoch));
+  const char* keys[] = {
+    "stats.allocated", "stats.mapped", "stats.cores.count"
+  };
+  for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+    len = sizeof(value);
+    if (mallctl(keys[i], &value, &len, NULL, 0) == 0) {
+      printf("%s: %lu\n", keys[i], static_cast<unsigned long>(value));
+    }
+  }
+}
+
+}  // namespace
+
+
+int main(int argc, char** argv) {
+  const int threads = (argc > 1) ? atoi(argv[1]) : 100000;
+  const int wave = (argc > 2) ? atoi(argv[2]) : 64;
+  objects_per_thread = (argc > 3) ? atoi(argv[3]) : 256;
+  if ((threads <= 0) || (wave <= 0) || (objects_per_thread <= 0)) {
+    fprintf(stderr, "usage: %s [threads] [threads per wave] [objects]\n",
+            argv[0]);
+    return 1;
+  }
+
+  const int handed_over = (objects_per_thread + 7) / 8;
+  // Two generations of work items: a wave frees what the previous one handed
+  // over.
+  Work* works = new Work[2 * wave];
+  for (int i = 0; i < 2 * wave; i++) {
+    works[i].handed_over = new void*[handed_over];
+    works[i].handed_over_len = 0;
+    works[i].seed = i;
+  }
+  pthread_t* tids = new pthread_t[wave];
+
+  const double start = Now();
+  int started = 0;
+  for (int w = 0; started < threads; w++) {
+    Work* current = &works[(w % 2) * wave];
+    Work* previous = &works[((w + 1) % 2) * wave];
+    const int n = (threads - started < wave) ? (threads - started) : wave;
+    for (int i = 0; i < n; i++) {
+      current[i].inherited = previous[i].handed_over;
+      current[i].inherited_len = previous[i].handed_over_len;
+      previous[i].handed_over_len = 0;
+      if (pthread_create(&tids[i], NULL, ThreadMain, &current[i]) != 0) {
+        fprintf(stderr, "pthread_create failed\n");
+        return 1;
+      }
+    }
+    for (int i = 0; i < n; i++) {
+      pthread_join(tids[i], NULL);
+    }
+    started += n;
+  }
+  const double elapsed = Now() - start;
+  for (int i = 0; i < 2 * wave; i++) {
+    for (int j = 0; j < works[i].handed_over_len; j++) {
+      free(works[i].handed_over[j]);
+    }
+  }
+
+  printf("threads: %d, wave: %d, objects per thread: %d\n",
+         threads, wave, objects_per_thread);
+  printf("time: %.3f s, %.1f us per thread\n",
+         elapsed, elapsed * 1e6 / threads);
+  printf("rss: %ld KiB\n", ResidentKiB());
+  PrintAllocatorStats();
+  return 0;
+}
@@ -0,0 +1,62 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+// Extensions of scalloc beyond the standard allocation functions. See the
+// README for details. Standard functions (malloc(), free(), ...) and the
+// unprefixed names of the functions below are declared by the C library's
+// headers, if at all.
+
+#ifndef SCALLOC_SCALLOC_H_
+#define SCALLOC_SCALLOC_H_
+
+#include <stddef.h>
+#include <stdlib.h>
+
+#if defined(__THROW)
+#define SCALLOC_THROW __THROW
+#else
+#define SCALLOC_THROW
+#endif  // __THROW
+
+// scalloc-specific mallopt() parameters. The values do not collide with
+// glibc's (negative, small) parameters.
+#define M_SCALLOC_REUSE_THRESHOLD         (-2001)
+#define M_SCALLOC_MADVISE_DECAY_MS        (-2002)
+#define M_SCALLOC_SPAN_POOL_BACKEND_LIMIT (-2003)
+#define M_SCALLOC_LARGE_OBJECT_CACHE_MB   (-2004)
+#define M_SCALLOC_PURGE                   (-2005)
+
+#ifdef __cplusplus
+extern "C" {
+#endif  // __cplusplus
+
+int scalloc_mallopt(int cmd, int value) SCALLOC_THROW;
+int scalloc_mallctl(const char* name, void* oldp, size_t* oldlenp,
+                    void* newp, size_t newlen) SCALLOC_THROW;
+
+// Sized deallocation (C23).
+void scalloc_free_sized(void* p, size_t size) SCALLOC_THROW;
+void scalloc_free_aligned_sized(void* p, size_t alignment, size_t size)
+    SCALLOC_THROW;
+
+// Block sizes.
+size_t scalloc_malloc_usable_size(void* p) SCALLOC_THROW;
+size_t scalloc_nallocx(size_t size, int flags) SCALLOC_THROW;
+
+// Batch allocation. Returns the number of blocks stored in ptrs.
+size_t scalloc_malloc_batch(size_t size, void** ptrs, size_t n) SCALLOC_THROW;
+void scalloc_free_batch(void** ptrs, size_t n) SCALLOC_THROW;
+
+// Explicit heaps. Objects of a heap must only be freed through
+// scalloc_heap_free() or by destroying the heap.
+void* scalloc_heap_create(void) SCALLOC_THROW;
+void* scalloc_heap_malloc(void* heap, size_t size) SCALLOC_THROW;
+void scalloc_heap_free(void* heap, void* p) SCALLOC_THROW;
+void scalloc_heap_destroy(void* heap) SCALLOC_THROW;
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif  // __cplusplus
+
+#endif  // SCALLOC_SCALLOC_H_
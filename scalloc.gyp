@@ -8,13 +8,88 @@
     'lab_model%': "SCALLOC_LAB_MODEL_TLAB",
     'madvise%': 'yes',
     'madvise_eager%': 'yes',
+    'madvise_decay%': 'yes',
+    'madvise_decay_ms%': "1000",
+    'background_purge%': 'yes',
     'span_pool_backend_limit%': 'cpu',
     'cleanup_in_free%': 'yes',
+    'thread_cache%': 'yes',
+    'remote_free_buffer%': 'yes',
+    'large_object_cache%': 'yes',
+    'numa%': 'yes',
+    'span_stealing%': 'yes',
     'safe_global_construction%': 'no',
     'strict_memory%': 'no',
     'disable_transparent_hugepages%': 'no' ,
+    'hugepages%': 'no',
+    'bump_carving%': 'no',
+    # Fetched by tools/make_deps.sh.
+    'gtest_dir%': 'build/googletest/googletest',
   },
   'conditions': [
+    # Tests of the allocation API (test/api), see README.
+    ['OS=="linux"', {
+      'targets': [
+        {
+          'target_name': 'gtest',
+          'type': 'static_library',
+          'cflags!': [ '-std=c++11', '-fno-exceptions', '-fno-rtti' ],
+          'cflags': [ '-std=c++17' ],
+          'include_dirs': [
+            '<(gtest_dir)/include',
+            '<(gtest_dir)',
+          ],
+          'direct_dependent_settings': {
+            'include_dirs': [
+              '<(gtest_dir)/include',
+            ],
+          },
+          'sources': [
+            '<(gtest_dir)/src/gtest-all.cc',
+            '<(gtest_dir)/src/gtest_main.cc',
+          ],
+        },
+        {
+          # Reports the configuration read from SCALLOC_CONF, see
+          # config_test.cc.
+          'target_name': 'conf_probe',
+          'type': 'executable',
+          'dependencies': [
+            'scalloc',
+          ],
+          'sources': [
+            'test/api/conf_probe.cc',
+          ],
+        },
+        {
+          'target_name': 'api_test',
+          'type': 'executable',
+          'dependencies': [
+            'scalloc',
+            'gtest',
+            'conf_probe',
+          ],
+          'cflags!': [ '-std=c++11', '-fno-exceptions', '-fno-rtti' ],
+          'cflags': [ '-std=c++17' ],
+          'ldflags': [ '-pthread' ],
+          'libraries': ['-ldl'],
+          'sources': [
+            'test/api/aligned_test.cc',
+            'test/api/batch_test.cc',
+            'test/api/config_test.cc',
+            'test/api/heap_test.cc',
+            'test/api/remote_free_test.cc',
+            'test/api/reusable_spans_test.cc',
+            'test/api/runtime_config_test.cc',
+            'test/api/sized_delete_test.cc',
+            'test/api/span_stealing_test.cc',
+            'test/api/test_util.h',
+            'test/api/thread_reclaim_test.cc',
+            'test/api/usable_size_test.cc',
+          ],
+        },
+      ],
+    }],
   ],
   'targets': [
     {
@@ -25,7 +100,14 @@
         'SCALLOC_LOG_LEVEL=<(log_level)',
         'SCALLOC_REUSE_THRESHOLD=<(reuse_threshold)',
         'SCALLOC_LAB_MODEL=<(lab_model)',
+        'SCALLOC_MADVISE_DECAY_MS=<(madvise_decay_ms)',
       ],
+      # Compiles the C++17 aligned new and delete overloads (see glue.cc), which
+      # would otherwise be served by the C++ library on top of malloc().
+      'cflags': [ '-faligned-new' ],
+      'xcode_settings': {
+        'OTHER_CPLUSPLUSFLAGS': [ '$(inherited)', '-faligned-new' ],
+      },
       'conditions': [
         ['OS=="linux"', {
           'ldflags': [ '-pthread' ],
@@ -45,6 +127,16 @@
             'SCALLOC_NO_MADVISE_EAGER'
           ]
         }],
+        ['"no"=="<(madvise_decay)"', {
+          'defines': [
+            'SCALLOC_NO_MADVISE_DECAY'
+          ]
+        }],
+        ['"no"=="<(background_purge)"', {
+          'defines': [
+            'SCALLOC_NO_BACKGROUND_PURGE'
+          ]
+        }],
         ['"cpu"!="<(span_pool_backend_limit)"', {
           'defines': [
             'SCALLOC_SPAN_POOL_BACKEND_LIMIT=<(span_pool_backend_limit)'
@@ -55,6 +147,31 @@
             'SCALLOC_NO_CLEANUP_IN_FREE'
           ]
         }],
+        ['"no"=="<(thread_cache)"', {
+          'defines': [
+            'SCALLOC_NO_THREAD_CACHE'
+          ]
+        }],
+        ['"no"=="<(remote_free_buffer)"', {
+          'defines': [
+            'SCALLOC_NO_REMOTE_FREE_BUFFER'
+          ]
+        }],
+        ['"no"=="<(numa)"', {
+          'defines': [
+            'SCALLOC_NO_NUMA'
+          ]
+        }],
+        ['"no"=="<(span_stealing)"', {
+          'defines': [
+            'SCALLOC_NO_SPAN_STEALING'
+          ]
+        }],
+        ['"no"=="<(large_object_cache)"', {
+          'defines': [
+            'SCALLOC_NO_LARGE_OBJECT_CACHE'
+          ]
+        }],
         ['"no"=="<(safe_global_construction)"', {
           'defines': [
             'SCALLOC_NO_SAFE_GLOBAL_CONSTRUCTION'
@@ -71,30 +188,76 @@
             'SCALLOC_DISABLE_TRANSPARENT_HUGEPAGES',
           ]
         }],
+        ['"yes"=="<(hugepages)"', {
+          'defines': [
+            'SCALLOC_HUGEPAGES',
+          ]
+        }],
+        ['"yes"=="<(bump_carving)"', {
+          'defines': [
+            'SCALLOC_BUMP_CARVING',
+          ]
+        }],
       ],
       'sources': [
         'src/arena.h',
+        'src/config.h',
         'src/globals.h',
         'src/core.h',
+        'src/cpu_cache.h',
+        'src/ctl.h',
         'src/lab.h',
+        'src/large_object_cache.h',
         'src/log.h',
+        'src/numa.h',
         'src/glue.h',
+        'src/heap.h',
         'src/glue.cc',
         'src/platform/assert.h',
         'src/platform/globals.h',
+        'src/platform/membarrier.h',
         'src/platform/override.h',
         'src/platform/override_gcc_weak.h',
         'src/platform/override_osx.h',
         'src/platform/pthread_intercept.h',
         'src/platform/pthread_intercept.cc',
+        'src/platform/rseq.h',
+        'src/profiler.h',
+        'src/purger.h',
+        'src/remote_free_buffer.h',
+        'src/reusable_spans.h',
         'src/size_classes.h',
         'src/span.h',
         'src/span_pool.h',
-        'src/utils.h'
+        'src/stats.h',
+        'src/thread_cache.h',
+        'src/utils.h',
+        'include/scalloc.h'
       ],
       'include_dirs': [
         'src',
-      ]
+        'include',
+      ],
+      'direct_dependent_settings': {
+        'include_dirs': [
+          'include',
+        ],
+      },
+    },
+    {
+      # Does not link against scalloc, so that other allocators can be
+      # compared by preloading them.
+      'target_name': 'alloc_bench',
+      'type': 'executable',
+      'conditions': [
+        ['OS=="linux"', {
+          'ldflags': [ '-pthread' ],
+          'libraries': ['-ldl'],
+        }],
+      ],
+      'sources': [
+        'bench/alloc_bench.cc',
+      ],
     },
   ],
 }
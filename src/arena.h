@@ -23,9 +23,31 @@ class Arena {
   always_inline void Init(size_t size, size_t alignment, const char* name);
   always_inline bool Contains(const void* p);
   always_inline void* Allocate(size_t size);
-  always_inline void* AllocateVirtualSpan();
+  always_inline void* AllocateVirtualSpan(int32_t partition);
+
+  // Splits the arena into equally sized partitions (at most kMaxNumaNodes)
+  // that are bump allocated independently. Must be called before the first
+  // allocation.
+  always_inline void Partition(int32_t partitions);
+  always_inline int32_t PartitionOf(const void* p);
+
+  always_inline int32_t partitions() { return partitions_; }
+  always_inline uintptr_t partition_len() { return partition_len_; }
+  always_inline uintptr_t start(int32_t partition) {
+    return start_ + partition * partition_len_;
+  }
+  always_inline uintptr_t current(int32_t partition) {
+    return cursors_[partition].current.load();
+  }
 
  private:
+  struct Cursor {
+    std::atomic<uintptr_t> current;
+    UNUSED uint8_t pad[64 - (sizeof(std::atomic<uintptr_t>) % 64)];
+  };
+
+  always_inline uintptr_t Bump(int32_t partition, size_t size);
+
   const char* name_;
 
   // All of the following members hold pointers to their respective locations.
@@ -33,16 +55,18 @@ class Arena {
   uintptr_t start_;
   uintptr_t end_;
   uintptr_t len_;
+  uintptr_t partition_len_;
+  int32_t partitions_;
 
   UNUSED uint8_t pad1_[64 -
       ((sizeof(name_) +
         sizeof(start_) +
         sizeof(end_) +
-        sizeof(len_)) % 64)];
+        sizeof(len_) +
+        sizeof(partition_len_) +
+        sizeof(partitions_)) % 64)];
 
-  std::atomic<uintptr_t> current_;
-  UNUSED uint8_t pad2_[64  -
-      ((sizeof(current_)) % 64)];
+  Cursor cursors_[kMaxNumaNodes];
 };
 
 
@@ -65,7 +89,9 @@ void Arena::Init(size_t size, size_t alignment, const char* name) {
   }
   ScallocAssert((start_ % alignment) == 0);
   end_ = start_ + size;
-  current_.store(start_);
+  partitions_ = 1;
+  partition_len_ = len_;
+  cursors_[0].current.store(start_);
 #if defined(SCALLOC_STRICT_DUMP) && defined(MADV_DONTDUMP)
   madvise(reinterpret_cast<void*>(start_), len_, MADV_DONTDUMP);
 #endif  // DEBUG && MADV_DONTDUMP
@@ -80,14 +106,39 @@ bool Arena::Contains(const void* p) {
 }
 
 
-void* Arena::Allocate(size_t size) {
-  LOG(kTrace, "allocate: %lu", size);
-  uintptr_t obj = current_.fetch_add(size);
-  if (UNLIKELY((obj + size) >= end_)) {
-    Fatal("%s arena OOM; start: %p, end: %p, curr: %p",
-        name_, start_, end_, current_.load());
+void Arena::Partition(int32_t partitions) {
+  ScallocAssert((partitions > 0) && (partitions <= kMaxNumaNodes));
+  partitions_ = partitions;
+  partition_len_ = (len_ / partitions) & kVirtualSpanMask;
+  for (int32_t i = 0; i < partitions; i++) {
+    cursors_[i].current.store(start(i));
+  }
+}
+
+
+int32_t Arena::PartitionOf(const void* p) {
+  if (partitions_ == 1) {
+    return 0;
+  }
+  return static_cast<int32_t>(
+      (reinterpret_cast<uintptr_t>(p) - start_) / partition_len_);
+}
+
+
+uintptr_t Arena::Bump(int32_t partition, size_t size) {
+  uintptr_t obj = cursors_[partition].current.fetch_add(size);
+  if (UNLIKELY((obj + size) >= (start(partition) + partition_len_))) {
+    Fatal("%s arena OOM; start: %p, end: %p, curr: %p, partition: %d",
+        name_, start_, end_, cursors_[partition].current.load(), partition);
   }
   LOG(kTrace, "%s: obj: %p", name_, obj);
+  return obj;
+}
+
+
+void* Arena::Allocate(size_t size) {
+  LOG(kTrace, "allocate: %lu", size);
+  uintptr_t obj = Bump(0, size);
 #if defined(SCALLOC_STRICT_DUMP) && defined(MADV_DODUMP)
   madvise(reinterpret_cast<void*>(obj & kPageNrMask),
           ((size / kPageSize) + 1) * kPageSize,
@@ -97,14 +148,9 @@ void* Arena::Allocate(size_t size) {
 }
 
 
-void* Arena::AllocateVirtualSpan() {
+void* Arena::AllocateVirtualSpan(int32_t partition) {
   LOG(kTrace, "allocate: %lu", kVirtualSpanSize);
-  uintptr_t obj = current_.fetch_add(kVirtualSpanSize);
-  if (UNLIKELY((obj + kVirtualSpanSize) >= end_)) {
-    Fatal("%s arena OOM; start: %p, end: %p, curr: %p",
-        name_, start_, end_, current_.load());
-  }
-  LOG(kTrace, "%s: obj: %p", name_, obj);
+  uintptr_t obj = Bump(partition, kVirtualSpanSize);
 #if defined(SCALLOC_STRICT_DUMP) && defined(MADV_DODUMP)
   madvise(reinterpret_cast<void*>(obj), kVirtualSpanSize, MADV_DODUMP);
 #endif  // DEBUG && MADV_DODUMP
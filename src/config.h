@@ -0,0 +1,311 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+#ifndef SCALLOC_CONFIG_H_
+#define SCALLOC_CONFIG_H_
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+
+#include "globals.h"
+#include "log.h"
+#include "platform/globals.h"
+
+namespace scalloc {
+
+// Runtime configuration. Options are read once from the SCALLOC_CONF
+// environment variable during initialization, before the first allocation, and
+// are read-mostly afterwards. The format is a comma-separated list of
+// key:value pairs, e.g.,
+//
+//   SCALLOC_CONF="lab_model:percpu,reuse_threshold:60,madvise_decay_ms:0"
+//
+// Options that are not given keep the defaults from the build configuration.
+// Unknown options and malformed values are reported and ignored. Options that
+// have a setter can also be changed on a live process (see mallctl() and
+// mallopt()).
+//
+// Options:
+//   lab_model                tlab, rr, or percpu.
+//   reuse_threshold          Percent of free objects at which a span is
+//                            revived, 0 to 100.
+//   cleanup_in_free          Return empty spans on free (yes/no).
+//   span_pool_backend_limit  Maximum number of span pool backends, or cpu.
+//                            Backends that are in use are never given up.
+//   large_object_cache_bytes Maximum number of bytes kept in the large object
+//                            cache. 0 disables caching.
+//   madvise_decay_ms         Decay period of dirty spans. 0 purges spans as
+//                            soon as they are returned, -1 never purges.
+//                            Requires a build with madvise_decay.
+//   background_purge         End decay periods of dirty spans and cached large
+//                            objects from a background thread (yes/no).
+//   log_level                trace, info, warning, error, or fatal. Levels
+//                            above the build's log_level have been compiled
+//                            out.
+class Config {
+ public:
+  // Globally constructed, hence we use staged construction.
+  always_inline Config() {}
+  always_inline ~Config() {}
+
+  inline void Init();
+
+  always_inline int32_t lab_model() { return lab_model_; }
+  always_inline bool cleanup_in_free() { return cleanup_in_free_; }
+  always_inline bool background_purge() { return background_purge_; }
+  always_inline int32_t log_level() { return log_level_; }
+
+  // The reuse threshold (in percent) that has last been set for all size
+  // classes, and the one of a specific size class.
+  always_inline int32_t reuse_threshold() {
+    return reuse_threshold_.load(std::memory_order_relaxed);
+  }
+  always_inline int32_t reuse_threshold(int32_t size_class) {
+    return class_reuse_thresholds_[size_class].load(std::memory_order_relaxed);
+  }
+  always_inline int32_t span_pool_backend_limit() {
+    return span_pool_backend_limit_.load(std::memory_order_relaxed);
+  }
+  always_inline int64_t madvise_decay_ms() {
+    return madvise_decay_ms_.load(std::memory_order_relaxed);
+  }
+  always_inline uint64_t large_object_cache_bytes() {
+    return large_object_cache_bytes_.load(std::memory_order_relaxed);
+  }
+
+  // Setters return false for values out of range. Components that cache a
+  // derived value need to be told separately, e.g., the reuse thresholds of
+  // size classes (see UpdateReuseThreshold()).
+  inline bool set_reuse_threshold(int64_t percent);
+  inline bool set_reuse_threshold(int32_t size_class, int64_t percent);
+  inline bool set_span_pool_backend_limit(int64_t limit);
+  inline bool set_madvise_decay_ms(int64_t ms);
+  always_inline void set_large_object_cache_bytes(uint64_t bytes) {
+    large_object_cache_bytes_.store(bytes, std::memory_order_relaxed);
+  }
+
+ private:
+  static inline bool ParseInt(const char* value, size_t len, int64_t min,
+                              int64_t max, int64_t* result);
+  static inline bool ParseBool(const char* value, size_t len, bool* result);
+  static inline bool Equals(const char* value, size_t len, const char* s);
+
+  inline bool Set(const char* key, size_t key_len,
+                  const char* value, size_t value_len);
+
+  int32_t lab_model_;
+  int32_t log_level_;
+  bool cleanup_in_free_;
+  bool background_purge_;
+  std::atomic<int32_t> reuse_threshold_;
+  std::atomic<int32_t> span_pool_backend_limit_;
+  std::atomic<int64_t> madvise_decay_ms_;
+  std::atomic<uint64_t> large_object_cache_bytes_;
+  std::atomic<int32_t> class_reuse_thresholds_[kNumClasses];
+};
+
+
+void Config::Init() {
+  lab_model_ = SCALLOC_LAB_MODEL;
+  set_reuse_threshold(kReuseThreshold);
+  span_pool_backend_limit_ = kSpanPoolBackendLimit;
+  log_level_ = kVerbosity;
+  madvise_decay_ms_ = kMadviseDecayMs;
+  large_object_cache_bytes_ = kLargeObjectCacheBytes;
+#if defined(SCALLOC_NO_CLEANUP_IN_FREE)
+  cleanup_in_free_ = false;
+#else
+  cleanup_in_free_ = true;
+#endif  // SCALLOC_NO_CLEANUP_IN_FREE
+#if defined(SCALLOC_NO_BACKGROUND_PURGE)
+  background_purge_ = false;
+#else
+  background_purge_ = true;
+#endif  // SCALLOC_NO_BACKGROUND_PURGE
+
+  const char* conf = getenv("SCALLOC_CONF");
+  if (conf == NULL) {
+    return;
+  }
+  const char* c = conf;
+  while (*c != '\0') {
+    const char* key = c;
+    const size_t key_len = strcspn(key, ":,");
+    const char* value = key + key_len;
+    size_t value_len = 0;
+    if (*value == ':') {
+      value++;
+      value_len = strcspn(value, ",");
+    }
+    if ((key_len == 0) || (value_len == 0) ||
+        !Set(key, key_len, value, value_len)) {
+      LOG(kWarning, "SCALLOC_CONF: ignoring option '%.*s'",
+          static_cast<int>((value + value_len) - key), key);
+    }
+    c = value + value_len;
+    if (*c == ',') {
+      c++;
+    }
+  }
+  log_verbosity = log_level_;
+}
+
+
+bool Config::Set(const char* key, size_t key_len,
+                 const char* value, size_t value_len) {
+  int64_t n;
+  if (Equals(key, key_len, "lab_model")) {
+    if (Equals(value, value_len, "tlab")) {
+      lab_model_ = SCALLOC_LAB_MODEL_TLAB;
+    } else if (Equals(value, value_len, "rr")) {
+      lab_model_ = SCALLOC_LAB_MODEL_RR;
+    } else if (Equals(value, value_len, "percpu")) {
+      lab_model_ = SCALLOC_LAB_MODEL_PERCPU;
+    } else {
+      return false;
+    }
+  } else if (Equals(key, key_len, "reuse_threshold")) {
+    return ParseInt(value, value_len, 0, 100, &n) && set_reuse_threshold(n);
+  } else if (Equals(key, key_len, "cleanup_in_free")) {
+    return ParseBool(value, value_len, &cleanup_in_free_);
+  } else if (Equals(key, key_len, "background_purge")) {
+    return ParseBool(value, value_len, &background_purge_);
+  } else if (Equals(key, key_len, "span_pool_backend_limit")) {
+    if (Equals(value, value_len, "cpu")) {
+      n = INT32_MAX;
+    } else if (!ParseInt(value, value_len, 1, INT32_MAX, &n)) {
+      return false;
+    }
+    return set_span_pool_backend_limit(n);
+  } else if (Equals(key, key_len, "madvise_decay_ms")) {
+    return ParseInt(value, value_len, -1, INT32_MAX, &n) &&
+           set_madvise_decay_ms(n);
+  } else if (Equals(key, key_len, "large_object_cache_bytes")) {
+    if (!ParseInt(value, value_len, 0, INT64_MAX, &n)) {
+      return false;
+    }
+    set_large_object_cache_bytes(n);
+  } else if (Equals(key, key_len, "log_level")) {
+    if (Equals(value, value_len, "trace")) {
+      log_level_ = kTrace;
+    } else if (Equals(value, value_len, "info")) {
+      log_level_ = kInfo;
+    } else if (Equals(value, value_len, "warning")) {
+      log_level_ = kWarning;
+    } else if (Equals(value, value_len, "error")) {
+      log_level_ = kError;
+    } else if (Equals(value, value_len, "fatal")) {
+      log_level_ = kFatal;
+    } else {
+      return false;
+    }
+  } else {
+    return false;
+  }
+  return true;
+}
+
+
+bool Config::set_reuse_threshold(int64_t percent) {
+  if ((percent < 0) || (percent > 100)) {
+    return false;
+  }
+  reuse_threshold_.store(percent, std::memory_order_relaxed);
+  for (int32_t i = 0; i < kNumClasses; i++) {
+    class_reuse_thresholds_[i].store(percent, std::memory_order_relaxed);
+  }
+  return true;
+}
+
+
+bool Config::set_reuse_threshold(int32_t size_class, int64_t percent) {
+  if ((size_class < 0) || (size_class >= kNumClasses) ||
+      (percent < 0) || (percent > 100)) {
+    return false;
+  }
+  class_reuse_thresholds_[size_class].store(
+      percent, std::memory_order_relaxed);
+  return true;
+}
+
+
+bool Config::set_span_pool_backend_limit(int64_t limit) {
+  if ((limit < 1) || (limit > INT32_MAX)) {
+    return false;
+  }
+  span_pool_backend_limit_.store(limit, std::memory_order_relaxed);
+  return true;
+}
+
+
+// Decay periods only exist in builds with madvise_decay.
+bool Config::set_madvise_decay_ms(int64_t ms) {
+#ifdef SCALLOC_MADVISE_DECAY
+  if ((ms < -1) || (ms > INT32_MAX)) {
+    return false;
+  }
+  madvise_decay_ms_.store(ms, std::memory_order_relaxed);
+  return true;
+#else
+  return false;
+#endif  // SCALLOC_MADVISE_DECAY
+}
+
+
+bool Config::Equals(const char* value, size_t len, const char* s) {
+  return (strlen(s) == len) && (strncmp(value, s, len) == 0);
+}
+
+
+bool Config::ParseInt(const char* value, size_t len, int64_t min, int64_t max,
+                      int64_t* result) {
+  bool negative = false;
+  size_t i = 0;
+  if (value[0] == '-') {
+    negative = true;
+    i++;
+  }
+  if (i == len) {
+    return false;
+  }
+  int64_t n = 0;
+  for (; i < len; i++) {
+    if ((value[i] < '0') || (value[i] > '9')) {
+      return false;
+    }
+    const int64_t digit = value[i] - '0';
+    if (n > (max - min - digit) / 10) {
+      return false;
+    }
+    n = n * 10 + digit;
+  }
+  if (negative) {
+    n = -n;
+  }
+  if ((n < min) || (n > max)) {
+    return false;
+  }
+  *result = n;
+  return true;
+}
+
+
+bool Config::ParseBool(const char* value, size_t len, bool* result) {
+  if (Equals(value, len, "yes") || Equals(value, len, "true") ||
+      Equals(value, len, "1")) {
+    *result = true;
+  } else if (Equals(value, len, "no") || Equals(value, len, "false") ||
+             Equals(value, len, "0")) {
+    *result = false;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+}  // namespace scalloc
+
+#endif  // SCALLOC_CONFIG_H_
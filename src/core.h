@@ -6,55 +6,216 @@
 #define SCALLOC_CORE_H_
 
 #include <pthread.h>
+#include <sched.h>
 #include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
 
 #include "arena.h"
 #include "atomic_value.h"
+#include "config.h"
 #include "core_id.h"
-#include "deque.h"
+#include "cpu_cache.h"
 #include "globals.h"
 #include "large-objects.h"
 #include "lock.h"
+#include "numa.h"
+#include "platform/membarrier.h"
+#include "platform/rseq.h"
+#include "profiler.h"
 #include "size_classes.h"
+#include "remote_free_buffer.h"
+#include "reusable_spans.h"
 #include "span.h"
+#include "thread_cache.h"
 
 namespace scalloc {
 
-extern int seen_memalign;
+// Slow path counters of a core. They are only written by the thread currently
+// owning the core, readers get an approximate view.
+struct CoreCounters {
+  uint64_t span_refills;
+  uint64_t reused_spans;
+  uint64_t new_spans;
+  uint64_t large_allocations;
+  uint64_t remote_frees;
+  uint64_t remote_flushes;
+  uint64_t reclaimed_spans;
+  uint64_t stolen_spans;
+};
 
 
 class Core {
  public:
   always_inline Core();
   always_inline void* Allocate(size_t size);
+  // Allocates a block of the given size class, e.g., an aligned class that
+  // SizeToClass() never returns. Large objects (class 0) get a payload aligned
+  // to align, unless it is 0 (see LargeObject::AllocateAligned()).
+  always_inline void* Allocate(size_t size, int32_t size_class, size_t align);
   always_inline void Free(void* p);
+  always_inline void Free(void* p, int32_t size_class);
+  // Fills objs with up to n blocks of the given size class, taken from the
+  // free list of the hot span in one go. Returns the number of blocks, which is
+  // only smaller than n if we run out of memory.
+  always_inline size_t AllocateBatch(size_t size, int32_t size_class,
+                                     void** objs, size_t n);
+  // Frees n blocks (or large objects, or NULL). A run of blocks of the same
+  // span is returned to the span with a single update.
+  always_inline void FreeBatch(void** objs, size_t n);
   always_inline void Destroy();
   always_inline void Init(core_id id);
 
+  // All cores that have ever been initialized, most recent first. Cores are
+  // never unregistered.
+  static always_inline Core* First() { return all_cores_.load(); }
+  always_inline Core* Next() { return next_core_; }
+  always_inline const CoreCounters& counters() { return counters_; }
+
+  // The NUMA node the core has been initialized on first, i.e., the node its
+  // memory has been touched on.
+  always_inline int32_t node() { return node_; }
+  // Whether the core is a heap, see Heap.
+  always_inline bool retains_spans() { return retains_spans_; }
+
+  // Returns spans that have become empty while being linked into the reusable
+  // spans of any core to the span pool. Otherwise they stay around until their
+  // size class is refilled. Returns the number of released spans.
+  static inline int64_t ReleaseEmptySpans();
+
+#ifdef SCALLOC_SPAN_STEALING
+  static inline void InitSpanStealing();
+#endif  // SCALLOC_SPAN_STEALING
+
  protected:
   typedef Stack<64> RemoteFullSpans;
 
   always_inline core_id id() { return id_; }
 
+  static std::atomic<Core*> all_cores_;
+
+#ifdef SCALLOC_SPAN_STEALING
+  // Maximum number of other cores looked at for a reusable span.
+  static const int32_t kStealVictims = 16;
+
+  static bool steal_spans_;
+#endif  // SCALLOC_SPAN_STEALING
+
+  always_inline void Register();
+  // Initializes a core that keeps all of its spans until it goes away as a
+  // whole (see Heap). Such a core is not registered, i.e., it is invisible to
+  // other cores, statistics, and span stealing.
+  always_inline void InitRetaining(core_id id);
+  always_inline void ReclaimSpan(Span* s);
   always_inline void CheckAlignments();
+  // Cores bound to CPUs come with their own cache (see CpuCore) and bypass the
+  // thread cache, which is thus chosen per call site through kCached.
+  template<bool kCached>
+  always_inline void* AllocateObject(size_t size, int32_t sc, size_t align);
+  template<bool kCached>
+  always_inline void* AllocateUnsampled(size_t size, int32_t sc, size_t align);
+  template<bool kCached>
+  never_inline void* AllocateSampled(size_t size, int32_t sc, size_t align);
+  template<bool kCached>
+  always_inline size_t AllocateObjects(size_t size, int32_t sc, void** objs,
+                                       size_t n);
+  never_inline void FreeSampled(Span* s, void* p);
   always_inline Span* GetSpan(int32_t sc);
+  static always_inline Span* PopReusableSpan(ReusableSpans* spans);
+  never_inline void CleanupReusableSpans(int32_t sc);
+  inline int64_t ReleaseEmptySpans(int32_t sc);
+#ifdef SCALLOC_SPAN_STEALING
+  never_inline Span* StealSpan(int32_t sc);
+  always_inline bool AdoptSpan(Span* s);
+  always_inline void BeginOwnerAccess();
+  always_inline void EndOwnerAccess();
+  always_inline void WaitForOwnerAccess();
+#endif  // SCALLOC_SPAN_STEALING
+  template<bool kCached>
+  always_inline void FreeObject(Span* s, void* p, int32_t sc);
+  always_inline void FreeToSpan(Span* s, void* p);
+  always_inline void FreeRangeToSpan(Span* s, void* first, void* last,
+                                     int32_t len);
+  always_inline void UpdateSpanState(Span* s, int32_t old_epoch,
+                                     core_id old_owner, int32_t size_class,
+                                     int32_t free_objects);
+#ifdef SCALLOC_REMOTE_FREE_BUFFER
+  always_inline void BufferRemoteFree(Span* s, void* p);
+  always_inline void FlushRemoteBatch(RemoteFreeBuffer::Batch* batch);
+  always_inline void FlushRemoteFrees();
+#endif  // SCALLOC_REMOTE_FREE_BUFFER
+#ifdef SCALLOC_THREAD_CACHE
+  always_inline void RefillCache(int32_t sc);
+  always_inline void FlushCache(int32_t sc, int32_t n);
+#endif  // SCALLOC_THREAD_CACHE
 
   void* core_link_;
   core_id id_;
+  int64_t bytes_until_sample_;
   Span* hot_span_[kNumClasses];
-  Deque r_spans_[kNumClasses];
+  ReusableSpans r_spans_[kNumClasses];
+#ifdef SCALLOC_THREAD_CACHE
+  ThreadCache cache_;
+#endif  // SCALLOC_THREAD_CACHE
+#ifdef SCALLOC_REMOTE_FREE_BUFFER
+  RemoteFreeBuffer remote_frees_;
+#endif  // SCALLOC_REMOTE_FREE_BUFFER
+  Core* next_core_;
+  // All spans a retaining core has taken, chained through the spans.
+  Span* retained_spans_;
+  int32_t node_;
+  bool registered_;
+  bool retains_spans_;
+  uint64_t rand_state_;
+  CoreCounters counters_;
+#ifdef SCALLOC_SPAN_STEALING
+  // Odd while the core returns objects to a span it (possibly) owns. Written by
+  // the thread operating the core, read by thieves.
+  volatile uint64_t owner_access_;
+  Core* steal_cursor_;
+#endif  // SCALLOC_SPAN_STEALING
 
   uint8_t pad_[128 - ((
       sizeof(core_link_) +
       sizeof(id_) +
+      sizeof(bytes_until_sample_) +
+      sizeof(next_core_) +
+      sizeof(retained_spans_) +
+      sizeof(node_) +
+      sizeof(registered_) +
+      sizeof(retains_spans_) +
+      sizeof(rand_state_) +
+      sizeof(counters_) +
+#ifdef SCALLOC_SPAN_STEALING
+      sizeof(owner_access_) +
+      sizeof(steal_cursor_) +
+#endif  // SCALLOC_SPAN_STEALING
+#ifdef SCALLOC_THREAD_CACHE
+      sizeof(cache_) +
+#endif  // SCALLOC_THREAD_CACHE
+#ifdef SCALLOC_REMOTE_FREE_BUFFER
+      sizeof(remote_frees_) +
+#endif  // SCALLOC_REMOTE_FREE_BUFFER
       sizeof(hot_span_)) % 128)];
 };
 
 #define FOR_ALL_CORE_FIELDS(V)                                                 \
   V(core_link_)                                                                \
   V(id_)                                                                       \
+  V(bytes_until_sample_)                                                       \
   V(hot_span_)                                                                 \
   V(r_spans_)                                                                  \
+  V(next_core_)                                                                \
+  V(retained_spans_)                                                           \
+  V(counters_)                                                                 \
+
+
+
+std::atomic<Core*> Core::all_cores_;
+#ifdef SCALLOC_SPAN_STEALING
+bool Core::steal_spans_;
+#endif  // SCALLOC_SPAN_STEALING
 
 
 Core::Core() {
@@ -64,6 +225,21 @@ Core::Core() {
 }
 
 
+void Core::Register() {
+  if (registered_) {
+    return;
+  }
+  registered_ = true;
+  node_ = numa_topology.CurrentNode();
+  memset(&counters_, 0, sizeof(counters_));
+  Core* head;
+  do {
+    head = all_cores_.load();
+    next_core_ = head;
+  } while (!all_cores_.compare_exchange_weak(head, this));
+}
+
+
 void Core::CheckAlignments() {
   // Dynamically check field alignment for 32bit.
 
@@ -73,6 +249,15 @@ void Core::CheckAlignments() {
   }
 
 FOR_ALL_CORE_FIELDS(CHECK_FIELD)
+#ifdef SCALLOC_THREAD_CACHE
+CHECK_FIELD(cache_)
+#endif  // SCALLOC_THREAD_CACHE
+#ifdef SCALLOC_REMOTE_FREE_BUFFER
+CHECK_FIELD(remote_frees_)
+#endif  // SCALLOC_REMOTE_FREE_BUFFER
+#ifdef SCALLOC_SPAN_STEALING
+CHECK_FIELD(owner_access_)
+#endif  // SCALLOC_SPAN_STEALING
 
 #undef CHECK_FIELD
 }
@@ -80,76 +265,428 @@ FOR_ALL_CORE_FIELDS(CHECK_FIELD)
 
 void Core::Init(core_id id) {
   id_ = id;
+  retained_spans_ = nullptr;
+  if (retains_spans_) {
+    node_ = numa_topology.CurrentNode();
+    memset(&counters_, 0, sizeof(counters_));
+  } else {
+    Register();
+  }
+  // Take the first sample decision on the first allocation.
+  bytes_until_sample_ = 0;
+  rand_state_ = (reinterpret_cast<uintptr_t>(this) ^ rdtsc()) | 1;
+#ifdef SCALLOC_SPAN_STEALING
+  steal_cursor_ = this;
+#endif  // SCALLOC_SPAN_STEALING
+#ifdef SCALLOC_THREAD_CACHE
+  cache_.Init();
+#endif  // SCALLOC_THREAD_CACHE
+#ifdef SCALLOC_REMOTE_FREE_BUFFER
+  remote_frees_.Init();
+#endif  // SCALLOC_REMOTE_FREE_BUFFER
   for (int32_t i = 0 ; i < kNumClasses; i++) {
     r_spans_[i].Open(id);
   }
 }
 
 
+void Core::InitRetaining(core_id id) {
+  retains_spans_ = true;
+  Init(id);
+}
+
+
 void Core::Destroy() {
+#ifdef SCALLOC_THREAD_CACHE
+  // Cached objects still belong to our spans, so hand them back while the
+  // reusable span lists are open.
+  for (int32_t i = 0; i < ThreadCache::kCachedClasses; i++) {
+    FlushCache(i, cache_.Length(i));
+  }
+#endif  // SCALLOC_THREAD_CACHE
+#ifdef SCALLOC_REMOTE_FREE_BUFFER
+  FlushRemoteFrees();
+#endif  // SCALLOC_REMOTE_FREE_BUFFER
+  ListNode* node;
+  Span* s;
   for (size_t i = 0; i < kNumClasses; i++) {
-    r_spans_[i].Close();
+    node = r_spans_[i].Close();
 
     if (hot_span_[i] != nullptr) {
       hot_span_[i]->NewMarkFloating();
+      ReclaimSpan(hot_span_[i]);
       hot_span_[i] = nullptr;
     }
 
-    r_spans_[i].RemoveAll();
+    while (node != nullptr) {
+      s = Span::FromSpanLink(node);
+      node = node->next();
+      s->SpanLink()->clear_next();
+      if (s->ReleaseLink()) {
+        Span::Delete(s);
+      } else {
+        ReclaimSpan(s);
+      }
+    }
   }
 
   id_ = kTerminated;
 }
 
 
+// Returns a span of a terminating core to the span pool if all of its objects
+// are free. Other spans stay with the terminated core until a free revives
+// them (see UpdateSpanState()). Racing frees are resolved through the epoch.
+void Core::ReclaimSpan(Span* s) {
+  const int32_t epoch = s->epoch();
+  if ((s->owner() != id()) ||
+      !Span::IsFloatingOrReusable(epoch) ||
+      (s->NrFreeObjects() != ClassInfo[s->size_class()].objects)) {
+    return;
+  }
+  if (s->NewMarkFull(epoch)) {
+    counters_.reclaimed_spans++;
+    if (!s->DeferDelete()) {
+      Span::Delete(s);
+    }
+  }
+}
+
+
+// Pops a span off spans, deleting spans on the way that have become full
+// while they were linked.
+Span* Core::PopReusableSpan(ReusableSpans* spans) {
+  ListNode* node;
+  Span* s;
+  while ((node = spans->Pop()) != nullptr) {
+    s = Span::FromSpanLink(node);
+    if (!s->ReleaseLink()) {
+      return s;
+    }
+    Span::Delete(s);
+  }
+  return nullptr;
+}
+
+
 Span* Core::GetSpan(int32_t sc) {
+#ifdef SCALLOC_REMOTE_FREE_BUFFER
+  // We are refilling anyways, so publish whatever we hold back for others.
+  FlushRemoteFrees();
+#endif  // SCALLOC_REMOTE_FREE_BUFFER
+  counters_.span_refills++;
   Span* newspan = nullptr;
-  DoubleListNode* node = nullptr;
-  while ((node = r_spans_[sc].RemoveBack()) != nullptr) {
-    newspan = Span::FromSpanLink(node);
+  while ((newspan = PopReusableSpan(&r_spans_[sc])) != nullptr) {
     int32_t epoch = newspan->epoch();
     if (newspan->NewMarkHot(epoch)) {
       ScallocAssert(newspan->owner() == id());
       newspan->MoveRemoteToLocalObjects();
+      counters_.reused_spans++;
       break;
     }
     newspan = nullptr;
   }
+#ifdef SCALLOC_SPAN_STEALING
+  if ((newspan == nullptr) && steal_spans_ && !retains_spans_) {
+    newspan = StealSpan(sc);
+  }
+#endif  // SCALLOC_SPAN_STEALING
   if (newspan == nullptr) {
     newspan = Span::New(sc, id());
+    counters_.new_spans++;
+    if (UNLIKELY(retains_spans_)) {
+      newspan->set_next_retained(retained_spans_);
+      retained_spans_ = newspan;
+    }
+  }
+  // Reused spans are most likely cold. The first object is needed right away.
+  newspan->PrefetchNext();
+  if (!config.cleanup_in_free() && !retains_spans_) {
+    CleanupReusableSpans(sc);
   }
-#if defined(SCALLOC_NO_CLEANUP_IN_FREE)
-  Span* cleanup_span = nullptr;
-  while ((node = r_spans_[sc].RemoveBack()) != nullptr) {
-    cleanup_span = Span::FromSpanLink(node);
-    const int32_t epoch = cleanup_span->epoch();
-    if (cleanup_span->NrFreeObjects() == ClassToObjects[cleanup_span->size_class()]) {
-      const bool success = cleanup_span->NewMarkFull(epoch);
+  return newspan;
+}
+
+
+// Without cleanup in free, empty spans stay on the reusable spans of their
+// owner until it refills. Spans that are still in use are linked again.
+void Core::CleanupReusableSpans(int32_t sc) {
+  ListNode* in_use = nullptr;
+  Span* s;
+  while ((s = PopReusableSpan(&r_spans_[sc])) != nullptr) {
+    const int32_t epoch = s->epoch();
+    if (s->NrFreeObjects() == ClassInfo[s->size_class()].objects) {
+      const bool success = s->NewMarkFull(epoch);
       ScallocAssert(success);  // should always work
-      Span::Delete(cleanup_span);
+      if (!s->DeferDelete()) {
+        Span::Delete(s);
+      }
+    } else {
+      s->SpanLink()->set_next(in_use);
+      in_use = s->SpanLink();
     }
   }
-#endif  // SCALLOC_NO_CLEANUP_IN_FREE
-  return newspan;
+  while (in_use != nullptr) {
+    s = Span::FromSpanLink(in_use);
+    in_use = in_use->next();
+    s->SpanLink()->clear_next();
+    if (s->AcquireLink() && !r_spans_[sc].Push(id(), s->SpanLink())) {
+      if (s->ReleaseLink()) {
+        Span::Delete(s);
+      }
+    }
+  }
+}
+
+
+int64_t Core::ReleaseEmptySpans() {
+  int64_t released = 0;
+  for (Core* c = First(); c != nullptr; c = c->Next()) {
+    for (int32_t sc = 1; sc < kNumClasses; sc++) {
+      if (!c->r_spans_[sc].Empty()) {
+        released += c->ReleaseEmptySpans(sc);
+      }
+    }
+  }
+  return released;
+}
+
+
+// May run concurrently to the owner. Popped spans keep their link token, so
+// that freers keep deferring deletes to us until the span is linked again.
+int64_t Core::ReleaseEmptySpans(int32_t sc) {
+  const core_id owner = id();
+  int64_t released = 0;
+  ListNode* in_use = nullptr;
+  ListNode* node;
+  Span* s;
+  while ((node = r_spans_[sc].Pop()) != nullptr) {
+    s = Span::FromSpanLink(node);
+    if (s->DeleteDeferred()) {
+      s->ReleaseLink();
+      Span::Delete(s);
+      released++;
+    } else {
+      node->set_next(in_use);
+      in_use = node;
+    }
+  }
+  while (in_use != nullptr) {
+    s = Span::FromSpanLink(in_use);
+    in_use = in_use->next();
+    s->SpanLink()->clear_next();
+    if (!r_spans_[sc].Push(owner, s->SpanLink()) && s->ReleaseLink()) {
+      Span::Delete(s);
+      released++;
+    }
+  }
+  return released;
 }
 
 
+#ifdef SCALLOC_SPAN_STEALING
+// Stealing is only enabled if heavy fences are available, see AdoptSpan().
+void Core::InitSpanStealing() {
+  steal_spans_ = Membarrier::Register();
+  LOG(kTrace, "span stealing: %d", steal_spans_);
+}
+
+
+// Takes a reusable span of size class sc from another core on the same NUMA
+// node. Victims are visited round-robin, continuing after the last one looked
+// at, and at most kStealVictims cores are looked at per call.
+Span* Core::StealSpan(int32_t sc) {
+  Core* victim = steal_cursor_;
+  Span* s;
+  for (int32_t i = 0; i < kStealVictims; i++) {
+    victim = victim->Next();
+    if (victim == nullptr) {
+      victim = First();
+    }
+    if ((victim == this) ||
+        (victim->node() != node_) ||
+        victim->r_spans_[sc].Empty()) {
+      continue;
+    }
+    if ((s = PopReusableSpan(&victim->r_spans_[sc])) == nullptr) {
+      continue;
+    }
+    steal_cursor_ = victim;
+    if (AdoptSpan(s)) {
+      counters_.stolen_spans++;
+      return s;
+    }
+  }
+  steal_cursor_ = victim;
+  return nullptr;
+}
+
+
+// Makes this core the owner of a reusable span s that has already been removed
+// from the reusable spans of its owner, and marks it hot. Fails if a free
+// concurrently returned the span to the span pool or revived it.
+bool Core::AdoptSpan(Span* s) {
+  const int32_t epoch = s->epoch();
+  const core_id old_owner = s->owner();
+  if (!Span::IsReusable(epoch) || !s->TryReviveNew(old_owner, id())) {
+    return false;
+  }
+  // The old owner may still be in the middle of a free that observed it as
+  // owner, i.e., pushes to the local free list. The heavy fence makes its
+  // progress (see BeginOwnerAccess()) visible, and we wait until it is done
+  // before we touch the span.
+  Membarrier::HeavyFence();
+  old_owner.value()->WaitForOwnerAccess();
+  if (!s->NewMarkHot(epoch)) {
+    return false;
+  }
+  s->MoveRemoteToLocalObjects();
+  return true;
+}
+
+
+void Core::BeginOwnerAccess() {
+  owner_access_ = owner_access_ + 1;
+  Membarrier::LightFence();
+}
+
+
+void Core::EndOwnerAccess() {
+  Membarrier::LightFence();
+  owner_access_ = owner_access_ + 1;
+}
+
+
+// Waits for an ongoing access of a thread operating this core to finish.
+void Core::WaitForOwnerAccess() {
+  const uint64_t access = owner_access_;
+  if ((access & 1) == 0) {
+    return;
+  }
+  while (owner_access_ == access) {
+    sched_yield();
+  }
+}
+#endif  // SCALLOC_SPAN_STEALING
+
+
+#ifdef SCALLOC_THREAD_CACHE
+void Core::RefillCache(int32_t sc) {
+#ifdef SCALLOC_BUMP_CARVING
+  // Fill up the whole cache, which mostly carves up the bump region of fresh
+  // spans, at the cost of more objects held back per thread.
+  const int32_t n = ThreadCache::kCapacity - cache_.Length(sc);
+#else
+  const int32_t n = ThreadCache::kBatchSize;
+#endif  // SCALLOC_BUMP_CARVING
+  cache_.Grow(sc, hot_span_[sc]->AllocateBatch(cache_.Top(sc), n));
+}
+
+
+// Runs of objects of the same span go back with a single FreeRangeToSpan(),
+// like in FreeBatch().
+void Core::FlushCache(int32_t sc, int32_t n) {
+  int32_t i = 0;
+  void* first;
+  void* last;
+  void* obj;
+  int32_t len;
+  Span* s;
+  while (i < n) {
+    first = cache_.Oldest(sc, i++);
+    s = Span::FromObject(first);
+    last = first;
+    len = 1;
+    while ((i < n) && (Span::FromObject(obj = cache_.Oldest(sc, i)) == s)) {
+      *(reinterpret_cast<void**>(last)) = obj;
+      last = obj;
+      len++;
+      i++;
+    }
+    FreeRangeToSpan(s, first, last, len);
+  }
+  cache_.DropOldest(sc, n);
+}
+#endif  // SCALLOC_THREAD_CACHE
+
+
 void* Core::Allocate(size_t size) {
+  return AllocateObject<true>(size, SizeToClass(size), 0);
+}
+
+
+void* Core::Allocate(size_t size, int32_t size_class, size_t align) {
+  return AllocateObject<true>(size, size_class, align);
+}
+
+
+template<bool kCached>
+void* Core::AllocateObject(size_t size, int32_t sc, size_t align) {
   ScallocAssert(id() != kTerminated);
-  const size_t sc = SizeToClass(size);
+  bytes_until_sample_ -= size;
+  if (UNLIKELY(bytes_until_sample_ < 0)) {
+    return AllocateSampled<kCached>(size, sc, align);
+  }
+  return AllocateUnsampled<kCached>(size, sc, align);
+}
+
+
+template<bool kCached>
+void* Core::AllocateSampled(size_t size, int32_t sc, size_t align) {
+  heap_profiler.MaybeDump();
+  const bool sample = (heap_profiler.sample_rate() != 0);
+  bytes_until_sample_ = heap_profiler.NextSampleInterval(&rand_state_);
+  void* obj = AllocateUnsampled<kCached>(size, sc, align);
+  if (!sample || (obj == nullptr)) {
+    return obj;
+  }
+  heap_profiler.RecordAllocation(obj, size);
+  // Mark after recording, so that a free that sees the mark finds the sample.
+  if (LIKELY(object_space.Contains(obj))) {
+    Span::FromObject(obj)->AddSampledObject();
+  } else {
+    LargeObject::MarkSampled(obj);
+  }
+  return obj;
+}
+
+
+void Core::FreeSampled(Span* s, void* p) {
+  if (heap_profiler.RecordFree(p)) {
+    s->RemoveSampledObject();
+  }
+}
+
+
+template<bool kCached>
+void* Core::AllocateUnsampled(size_t size, int32_t sc, size_t align) {
+#ifdef SCALLOC_THREAD_CACHE
+  if (kCached && LIKELY(ThreadCache::Caches(sc))) {
+    void* obj = cache_.Pop(sc);
+    if (LIKELY(obj != nullptr)) {
+      return obj;
+    }
+  }
+#endif  // SCALLOC_THREAD_CACHE
   if (UNLIKELY(hot_span_[sc] == nullptr)) {
     if (UNLIKELY(sc == 0)) {
       // Could either be allocation for size 0, or a really large object.
       if (UNLIKELY(size == 0)) {
         return nullptr;
       }
-      return LargeObject::Allocate(size);
+      counters_.large_allocations++;
+      void* obj = (align != 0) ? LargeObject::AllocateAligned(size, align) :
+                                 LargeObject::Allocate(size);
+      if (UNLIKELY(obj == nullptr)) {
+        errno = ENOMEM;
+      }
+      return obj;
     }
     hot_span_[sc] = GetSpan(sc);
   }
   void* obj = hot_span_[sc]->Allocate();
   if (UNLIKELY(obj == nullptr)) {
-    if (hot_span_[sc]->NrFreeObjects() > ClassToReuseThreshold[sc]) {
+    if (hot_span_[sc]->NrFreeObjects() > ClassInfo[sc].reuse_threshold) {
       hot_span_[sc]->MoveRemoteToLocalObjects();
       obj = hot_span_[sc]->Allocate();
       return obj;
@@ -163,53 +700,278 @@ void* Core::Allocate(size_t size) {
     }
     obj = hot_span_[sc]->Allocate();
   }
+#ifdef SCALLOC_THREAD_CACHE
+  if (kCached && ThreadCache::Caches(sc)) {
+    RefillCache(sc);
+  }
+#endif  // SCALLOC_THREAD_CACHE
   return obj;
 }
 
 
+size_t Core::AllocateBatch(size_t size, int32_t size_class, void** objs,
+                           size_t n) {
+  return AllocateObjects<true>(size, size_class, objs, n);
+}
+
+
+template<bool kCached>
+size_t Core::AllocateObjects(size_t size, int32_t sc, void** objs, size_t n) {
+  ScallocAssert(id() != kTerminated);
+  size_t count = 0;
+  // Large objects, and batches that are due for a sample, take the regular
+  // path object by object. So do batches whose size overflows, like calloc().
+  const size_t bytes = size * n;
+  if (UNLIKELY((sc == 0) ||
+               ((n != 0) && ((bytes / n) != size)) ||
+               (bytes_until_sample_ < static_cast<int64_t>(bytes)))) {
+    for (; count < n; count++) {
+      if ((objs[count] = AllocateObject<kCached>(size, sc, 0)) == nullptr) {
+        break;
+      }
+    }
+    return count;
+  }
+  bytes_until_sample_ -= bytes;
+#ifdef SCALLOC_THREAD_CACHE
+  if (kCached && ThreadCache::Caches(sc)) {
+    while ((count < n) && ((objs[count] = cache_.Pop(sc)) != nullptr)) {
+      count++;
+    }
+  }
+#endif  // SCALLOC_THREAD_CACHE
+  while (count < n) {
+    if (UNLIKELY(hot_span_[sc] == nullptr)) {
+      hot_span_[sc] = GetSpan(sc);
+    }
+    count += hot_span_[sc]->AllocateBatch(objs + count, n - count);
+    if (count == n) {
+      break;
+    }
+    // Same as AllocateUnsampled(), but the span may be used up right away.
+    if (hot_span_[sc]->NrFreeObjects() > ClassInfo[sc].reuse_threshold) {
+      hot_span_[sc]->MoveRemoteToLocalObjects();
+      count += hot_span_[sc]->AllocateBatch(objs + count, n - count);
+      if (count == n) {
+        break;
+      }
+    }
+    hot_span_[sc]->NewMarkFloating();
+    hot_span_[sc] = GetSpan(sc);
+    if (UNLIKELY(hot_span_[sc] == nullptr)) {
+      errno = ENOMEM;
+      break;
+    }
+  }
+  return count;
+}
+
+
 void Core::Free(void* p) {
   ScallocAssert(id() != kTerminated);
   Span* s = Span::FromObject(p);
-  if (UNLIKELY(seen_memalign != 0)) {
-    p = s->AlignToBlockStart(p);
+  const int32_t class_info = s->class_info();
+  if (UNLIKELY(Span::IsSampled(class_info))) {
+    FreeSampled(s, p);
   }
+  FreeObject<true>(s, p, Span::SizeClassOf(class_info));
+}
 
+
+// Sized deallocation: The caller provides the size class of a block start,
+// saving the size class lookup in the span header.
+void Core::Free(void* p, int32_t size_class) {
+  ScallocAssert(id() != kTerminated);
+  Span* s = Span::FromObject(p);
+  ScallocAssert(static_cast<int32_t>(s->size_class()) == size_class);
+  if (UNLIKELY(s->HasSampledObjects())) {
+    FreeSampled(s, p);
+  }
+  FreeObject<true>(s, p, size_class);
+}
+
+
+void Core::FreeBatch(void** objs, size_t n) {
+  ScallocAssert(id() != kTerminated);
+  size_t i = 0;
+  void* p;
+  Span* s;
+  while (i < n) {
+    p = objs[i++];
+    if (UNLIKELY(!object_space.Contains(p))) {
+      if (p != nullptr) {
+        LargeObject::Free(p);
+      }
+      continue;
+    }
+    s = Span::FromObject(p);
+    const bool sampled = s->HasSampledObjects();
+    if (UNLIKELY(sampled)) {
+      FreeSampled(s, p);
+    }
+    // Link up the run of objects of s. Objects outside of the object space
+    // (including NULL) never map to s.
+    void* last = p;
+    int32_t len = 1;
+    while ((i < n) && (Span::FromObject(objs[i]) == s)) {
+      if (UNLIKELY(sampled)) {
+        FreeSampled(s, objs[i]);
+      }
+      *(reinterpret_cast<void**>(last)) = objs[i];
+      last = objs[i++];
+      len++;
+    }
+    FreeRangeToSpan(s, p, last, len);
+  }
+}
+
+
+template<bool kCached>
+void Core::FreeObject(Span* s, void* p, int32_t sc) {
+#if defined(SCALLOC_REMOTE_FREE_BUFFER) || defined(SCALLOC_THREAD_CACHE)
+  const bool local = (s->owner() == id());
+#endif  // SCALLOC_REMOTE_FREE_BUFFER || SCALLOC_THREAD_CACHE
+#ifdef SCALLOC_REMOTE_FREE_BUFFER
+  if (!local) {
+    BufferRemoteFree(s, p);
+    return;
+  }
+#endif  // SCALLOC_REMOTE_FREE_BUFFER
+#ifdef SCALLOC_THREAD_CACHE
+  // Only objects of our own spans are cached. Remote objects go back to their
+  // spans to keep spans of other cores reclaimable.
+  if (kCached && ThreadCache::Caches(sc) && local) {
+    if (UNLIKELY(!cache_.Push(sc, p))) {
+      FlushCache(sc, ThreadCache::kBatchSize);
+      cache_.Push(sc, p);
+    }
+    return;
+  }
+#endif  // SCALLOC_THREAD_CACHE
+  FreeToSpan(s, p);
+}
+
+
+void Core::FreeToSpan(Span* s, void* p) {
+#ifdef SCALLOC_SPAN_STEALING
+  BeginOwnerAccess();
+#endif  // SCALLOC_SPAN_STEALING
+  const int32_t old_epoch = s->epoch();
+  const core_id old_owner = s->owner();
+  const int32_t size_class = s->size_class();
+  UpdateSpanState(
+      s, old_epoch, old_owner, size_class, s->Free(p, id()));
+#ifdef SCALLOC_SPAN_STEALING
+  EndOwnerAccess();
+#endif  // SCALLOC_SPAN_STEALING
+}
+
+
+void Core::FreeRangeToSpan(Span* s, void* first, void* last, int32_t len) {
+#ifdef SCALLOC_SPAN_STEALING
+  BeginOwnerAccess();
+#endif  // SCALLOC_SPAN_STEALING
+  const int32_t old_epoch = s->epoch();
+  const core_id old_owner = s->owner();
+  const int32_t size_class = s->size_class();
+  UpdateSpanState(
+      s, old_epoch, old_owner, size_class,
+      s->FreeRange(first, last, len, id()));
+#ifdef SCALLOC_SPAN_STEALING
+  EndOwnerAccess();
+#endif  // SCALLOC_SPAN_STEALING
+}
+
+
+#ifdef SCALLOC_REMOTE_FREE_BUFFER
+void Core::BufferRemoteFree(Span* s, void* p) {
+  RemoteFreeBuffer::Batch* batch = remote_frees_.SlotFor(s);
+  if (batch->span() != s) {
+    if (batch->span() != nullptr) {
+      FlushRemoteBatch(batch);
+    }
+    batch->Reset(s);
+  }
+  batch->Add(p);
+  counters_.remote_frees++;
+  if (UNLIKELY(remote_frees_.Age())) {
+    FlushRemoteFrees();
+  } else if (UNLIKELY(batch->Full())) {
+    FlushRemoteBatch(batch);
+  }
+}
+
+
+void Core::FlushRemoteBatch(RemoteFreeBuffer::Batch* batch) {
+  Span* s = batch->span();
   const int32_t old_epoch = s->epoch();
-  core_id old_owner = s->owner();
+  const core_id old_owner = s->owner();
   const int32_t size_class = s->size_class();
-  const int32_t free_objects = s->Free(p, id());
+  UpdateSpanState(
+      s, old_epoch, old_owner, size_class,
+      s->FreeRemoteRange(batch->head(), batch->tail(), batch->len()));
+  batch->Reset(nullptr);
+  counters_.remote_flushes++;
+}
+
+
+void Core::FlushRemoteFrees() {
+  RemoteFreeBuffer::Batch* batch;
+  for (int32_t i = 0; i < RemoteFreeBuffer::kSlots; i++) {
+    batch = remote_frees_.At(i);
+    if (batch->span() != nullptr) {
+      FlushRemoteBatch(batch);
+    }
+  }
+  remote_frees_.ResetAge();
+}
+#endif  // SCALLOC_REMOTE_FREE_BUFFER
 
+
+// Transitions span s after objects have been returned to it, given the state
+// observed before returning them.
+void Core::UpdateSpanState(Span* s, int32_t old_epoch, core_id old_owner,
+                           int32_t size_class, int32_t free_objects) {
   if ((old_owner.value()->id() == kTerminated) ||
       (old_owner != old_owner.value()->id())) {
     if (s->TryReviveNew(old_owner, id())) {
       old_owner = id();
-      s->TryMarkFloating(old_epoch);
+      // Continue with the new epoch, as the transitions below compare against
+      // it.
+      if (s->TryMarkFloating(old_epoch)) {
+        old_epoch = Span::FloatingEpoch(old_epoch);
+      }
     }
   }
 
 
-#if !defined(SCALLOC_NO_CLEANUP_IN_FREE)
-  if (UNLIKELY((free_objects == ClassToObjects[size_class]) &&
-      Span::IsFloatingOrReusable(old_epoch))) {
-      if (s->NewMarkFull(old_epoch)) {
-        if (Span::IsReusable(old_epoch)) {
-          old_owner.value()->r_spans_[size_class].Remove(
-              old_owner, s->SpanLink());
-        }
+  // Empty spans of retaining cores are kept for reuse instead.
+  if (UNLIKELY((free_objects == ClassInfo[size_class].objects) &&
+      Span::IsFloatingOrReusable(old_epoch) &&
+      config.cleanup_in_free() &&
+      !old_owner.value()->retains_spans_)) {
+      // A span that is still linked into the reusable spans of its owner is
+      // deleted by whoever pops it.
+      if (s->NewMarkFull(old_epoch) && !s->DeferDelete()) {
         ScallocAssert(!Span::IsHot(s->epoch()));
         Span::Delete(s);
       }
-#else
-  if (false) {
-#endif  // !SCALLOC_NO_CLEANUP_IN_FREE
-  } else if (UNLIKELY((free_objects > ClassToReuseThreshold[size_class]) &&
+  } else if (UNLIKELY((free_objects > ClassInfo[size_class].reuse_threshold) &&
              !Span::IsReusable(old_epoch))) {
       // For a terminated owner that is waiting we will still add it to the list
       // to keep the code paths simple. (Yep, that's overhead in this rare
       // case.)
-      if (s->NewMarkReuse(old_epoch)) {
-        old_owner.value()->r_spans_[size_class].PushFront(
-            old_owner, s->SpanLink());
+      //
+      // Hot spans cannot be marked reusable, so only bother with the link
+      // token if the span has left the hot state in the meantime.
+      if (!Span::IsHot(s->epoch()) && s->AcquireLink()) {
+        if (!s->NewMarkReuse(old_epoch) ||
+            !old_owner.value()->r_spans_[size_class].Push(
+                old_owner, s->SpanLink())) {
+          if (s->ReleaseLink()) {
+            Span::Delete(s);
+          }
+        }
       }
   }
 }
@@ -219,14 +981,21 @@ class GuardedCore : public Core {
  public:
   always_inline GuardedCore();
   always_inline void* Allocate(size_t size);
+  always_inline void* Allocate(size_t size, int32_t size_class, size_t align);
   always_inline void Free(void* p);
+  always_inline void Free(void* p, int32_t size_class);
+  always_inline size_t AllocateBatch(size_t size, int32_t size_class,
+                                     void** objs, size_t n);
+  always_inline void FreeBatch(void** objs, size_t n);
 
   always_inline bool InUse() { return in_use_ == 1; }
   always_inline void AnnounceNewThread() { num_threads_.fetch_add(1); }
 
  protected:
-  always_inline void* AllocateLocked(size_t size);
+  always_inline void* AllocateLocked(size_t size, int32_t size_class,
+                                     size_t align);
   always_inline void FreeLocked(void* p);
+  always_inline void FreeLocked(void* p, int32_t size_class);
 
   always_inline void Acquire() { in_use_ = 1; }
   always_inline void Release() { in_use_ = 0; }
@@ -250,12 +1019,17 @@ GuardedCore::GuardedCore()
 
 
 void* GuardedCore::Allocate(size_t size) {
+  return Allocate(size, SizeToClass(size), 0);
+}
+
+
+void* GuardedCore::Allocate(size_t size, int32_t size_class, size_t align) {
   void* p;
   Acquire();
   if (LIKELY(num_threads_.load() == 1)) {
-    p = Core::Allocate(size);
+    p = Core::Allocate(size, size_class, align);
   } else {
-    p = AllocateLocked(size);
+    p = AllocateLocked(size, size_class, align);
   }
   Release();
   return p;
@@ -273,9 +1047,48 @@ void GuardedCore::Free(void* p) {
 }
 
 
-void* GuardedCore::AllocateLocked(size_t size) {
+void GuardedCore::Free(void* p, int32_t size_class) {
+  Acquire();
+  if (LIKELY(num_threads_.load() == 1)) {
+    Core::Free(p, size_class);
+  } else {
+    FreeLocked(p, size_class);
+  }
+  Release();
+}
+
+
+size_t GuardedCore::AllocateBatch(size_t size, int32_t size_class,
+                                  void** objs, size_t n) {
+  size_t count;
+  Acquire();
+  if (LIKELY(num_threads_.load() == 1)) {
+    count = Core::AllocateBatch(size, size_class, objs, n);
+  } else {
+    Lock::Guard guard(core_lock_);
+    count = Core::AllocateBatch(size, size_class, objs, n);
+  }
+  Release();
+  return count;
+}
+
+
+void GuardedCore::FreeBatch(void** objs, size_t n) {
+  Acquire();
+  if (LIKELY(num_threads_.load() == 1)) {
+    Core::FreeBatch(objs, n);
+  } else {
+    Lock::Guard guard(core_lock_);
+    Core::FreeBatch(objs, n);
+  }
+  Release();
+}
+
+
+void* GuardedCore::AllocateLocked(size_t size, int32_t size_class,
+                                  size_t align) {
   Lock::Guard guard(core_lock_);
-  return Core::Allocate(size);
+  return Core::Allocate(size, size_class, align);
 }
 
 
@@ -284,6 +1097,187 @@ void GuardedCore::FreeLocked(void* p) {
   Core::Free(p);
 }
 
+
+void GuardedCore::FreeLocked(void* p, int32_t size_class) {
+  Lock::Guard guard(core_lock_);
+  Core::Free(p, size_class);
+}
+
+
+// A core that is bound to a CPU (see PerCpuAllocationBuffer). Threads running
+// on the CPU allocate from and free to its CpuCache without locking. Everything
+// else is serialized by a lock, which is only contended when a thread gets
+// preempted or migrated in the middle of a slow path.
+class CpuCore : public Core {
+ public:
+  always_inline CpuCore() : Core() {}
+  always_inline void Init(core_id id, int32_t cpu);
+  always_inline void* Allocate(size_t size);
+  always_inline void* Allocate(size_t size, int32_t size_class, size_t align);
+  always_inline void Free(void* p);
+  always_inline void Free(void* p, int32_t size_class);
+  // Batches bypass the CPU cache.
+  always_inline size_t AllocateBatch(size_t size, int32_t size_class,
+                                     void** objs, size_t n);
+  always_inline void FreeBatch(void** objs, size_t n);
+
+ protected:
+  typedef SpinLock<64> Lock;
+
+  always_inline void LockCore();
+  always_inline void UnlockCore() { core_lock_.Unlock(); }
+  always_inline void FreeCpu(Span* s, void* p, int32_t sc);
+  never_inline void* AllocateSlow(size_t size, int32_t sc, size_t align);
+  never_inline void FreeSlow(Span* s, void* p, int32_t sc);
+  always_inline void RefillCpuCache(int32_t sc);
+  always_inline void FlushCpuCache(int32_t sc);
+
+  int32_t cpu_;
+  CpuCache cpu_cache_;
+  Lock core_lock_;
+};
+
+
+void CpuCore::Init(core_id id, int32_t cpu) {
+  cpu_ = cpu;
+  cpu_cache_.Init();
+  Core::Init(id);
+}
+
+
+void CpuCore::LockCore() {
+  // The holder has been preempted or migrated, so let it make progress.
+  while (!core_lock_.TryLock()) {
+    sched_yield();
+  }
+}
+
+
+void* CpuCore::Allocate(size_t size) {
+  return Allocate(size, SizeToClass(size), 0);
+}
+
+
+void* CpuCore::Allocate(size_t size, int32_t sc, size_t align) {
+  // Allocations from the cache bypass the sampler, so only use it while
+  // sampling is off.
+  if (LIKELY(CpuCache::Caches(sc) && (heap_profiler.sample_rate() == 0))) {
+    void* rseq = Rseq::Area();
+    if (LIKELY(rseq != nullptr)) {
+      void* obj = cpu_cache_.Pop(rseq, cpu_, sc);
+      if (LIKELY(obj != nullptr)) {
+        return obj;
+      }
+    }
+  }
+  return AllocateSlow(size, sc, align);
+}
+
+
+void CpuCore::Free(void* p) {
+  Span* s = Span::FromObject(p);
+  FreeCpu(s, p, s->size_class());
+}
+
+
+void CpuCore::Free(void* p, int32_t size_class) {
+  Span* s = Span::FromObject(p);
+  ScallocAssert(static_cast<int32_t>(s->size_class()) == size_class);
+  FreeCpu(s, p, size_class);
+}
+
+
+size_t CpuCore::AllocateBatch(size_t size, int32_t size_class, void** objs,
+                              size_t n) {
+  LockCore();
+  const size_t count = AllocateObjects<false>(size, size_class, objs, n);
+  UnlockCore();
+  return count;
+}
+
+
+void CpuCore::FreeBatch(void** objs, size_t n) {
+  LockCore();
+  Core::FreeBatch(objs, n);
+  UnlockCore();
+}
+
+
+void CpuCore::FreeCpu(Span* s, void* p, int32_t sc) {
+  // Only objects of our own spans are cached, see Core::FreeObject().
+  if (LIKELY(CpuCache::Caches(sc) &&
+             !s->HasSampledObjects() &&
+             (s->owner() == id()))) {
+    void* rseq = Rseq::Area();
+    if (LIKELY((rseq != nullptr) && cpu_cache_.Push(rseq, cpu_, sc, p))) {
+      return;
+    }
+  }
+  FreeSlow(s, p, sc);
+}
+
+
+void* CpuCore::AllocateSlow(size_t size, int32_t sc, size_t align) {
+  LockCore();
+  void* obj = AllocateObject<false>(size, sc, align);
+  if ((obj != nullptr) && (sc != 0) && CpuCache::Caches(sc)) {
+    RefillCpuCache(sc);
+  }
+  UnlockCore();
+  return obj;
+}
+
+
+void CpuCore::FreeSlow(Span* s, void* p, int32_t sc) {
+  LockCore();
+  if (UNLIKELY(s->HasSampledObjects())) {
+    FreeSampled(s, p);
+  }
+  if (CpuCache::Caches(sc) && (s->owner() == id())) {
+    // The cache is most likely full.
+    FlushCpuCache(sc);
+  }
+  FreeObject<false>(s, p, sc);
+  UnlockCore();
+}
+
+
+// Requires the core lock.
+void CpuCore::RefillCpuCache(int32_t sc) {
+  void* rseq = Rseq::Area();
+  if (rseq == nullptr) {
+    return;
+  }
+  void* obj;
+  for (int32_t i = 0; i < CpuCache::kBatchSize; i++) {
+    if ((obj = hot_span_[sc]->Allocate()) == nullptr) {
+      return;
+    }
+    if (!cpu_cache_.Push(rseq, cpu_, sc, obj)) {
+      // Full, or we are not running on our CPU anymore.
+      FreeToSpan(Span::FromObject(obj), obj);
+      return;
+    }
+  }
+}
+
+
+// Requires the core lock. Unlike ThreadCache, only the newest objects can be
+// taken out of the cache.
+void CpuCore::FlushCpuCache(int32_t sc) {
+  void* rseq = Rseq::Area();
+  if (rseq == nullptr) {
+    return;
+  }
+  void* obj;
+  for (int32_t i = 0; i < CpuCache::kBatchSize; i++) {
+    if ((obj = cpu_cache_.Pop(rseq, cpu_, sc)) == nullptr) {
+      return;
+    }
+    FreeToSpan(Span::FromObject(obj), obj);
+  }
+}
+
 }  // namespace scalloc
 
 #undef FOR_ALL_CORE_FIELDS
@@ -0,0 +1,54 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+#ifndef SCALLOC_CPU_CACHE_H_
+#define SCALLOC_CPU_CACHE_H_
+
+#include <string.h>
+
+#include "globals.h"
+#include "platform/globals.h"
+#include "platform/rseq.h"
+
+namespace scalloc {
+
+// The per-CPU counterpart of ThreadCache: A bounded cache of objects per fine
+// size class that belongs to the core of a CPU. Any thread running on that CPU
+// may access it without locking, as all modifications are restartable
+// sequences that are aborted when the thread gets preempted or migrated.
+//
+// Operations fail if the caller is not running on the cache's CPU (or rseq is
+// not available); callers then take a locked slow path.
+class CpuCache {
+ public:
+  static const int32_t kCachedClasses = kFineClasses;
+  static const int32_t kCapacity = 64;
+  static const int32_t kBatchSize = kCapacity / 2;
+
+  static always_inline bool Caches(int32_t size_class) {
+    return size_class < kCachedClasses;
+  }
+
+  always_inline void Init() {
+    memset(len_, 0, sizeof(len_));
+  }
+
+  always_inline void* Pop(void* rseq, int32_t cpu, int32_t size_class) {
+    return Rseq::Pop(rseq, cpu, &len_[size_class], objects_[size_class]);
+  }
+
+  always_inline bool Push(
+      void* rseq, int32_t cpu, int32_t size_class, void* p) {
+    return Rseq::Push(rseq, cpu, &len_[size_class], objects_[size_class],
+                      kCapacity, p);
+  }
+
+ private:
+  void* objects_[kCachedClasses][kCapacity];
+  int32_t len_[kCachedClasses];
+};
+
+}  // namespace scalloc
+
+#endif  // SCALLOC_CPU_CACHE_H_
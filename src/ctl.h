@@ -0,0 +1,492 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+#ifndef SCALLOC_CTL_H_
+#define SCALLOC_CTL_H_
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "core.h"
+#include "globals.h"
+#include "large-objects.h"
+#include "large_object_cache.h"
+#include "numa.h"
+#include "profiler.h"
+#include "size_classes.h"
+#include "span_pool.h"
+#include "stats.h"
+
+namespace scalloc {
+
+// A dotted name, e.g., "stats.classes.3.live", split into its components.
+class CtlName {
+ public:
+  static const int32_t kMaxComponents = 8;
+
+  always_inline explicit CtlName(const char* name);
+
+  always_inline bool Valid() { return valid_; }
+  always_inline int32_t Length() { return len_; }
+
+  // Returns true if component i equals s.
+  always_inline bool Is(int32_t i, const char* s);
+
+  // Parses component i as a non-negative index smaller than limit.
+  always_inline bool Index(int32_t i, int64_t limit, int64_t* index);
+
+ private:
+  const char* components_[kMaxComponents];
+  size_t lengths_[kMaxComponents];
+  int32_t len_;
+  bool valid_;
+};
+
+
+CtlName::CtlName(const char* name) : len_(0), valid_(true) {
+  const char* start = name;
+  const char* dot;
+  while (true) {
+    if (len_ == kMaxComponents) {
+      valid_ = false;
+      return;
+    }
+    dot = strchr(start, '.');
+    components_[len_] = start;
+    lengths_[len_] = (dot == NULL) ? strlen(start) : (dot - start);
+    if (lengths_[len_] == 0) {
+      valid_ = false;
+      return;
+    }
+    len_++;
+    if (dot == NULL) {
+      return;
+    }
+    start = dot + 1;
+  }
+}
+
+
+bool CtlName::Is(int32_t i, const char* s) {
+  return (i < len_) &&
+         (strlen(s) == lengths_[i]) &&
+         (strncmp(components_[i], s, lengths_[i]) == 0);
+}
+
+
+bool CtlName::Index(int32_t i, int64_t limit, int64_t* index) {
+  if (i >= len_) {
+    return false;
+  }
+  int64_t value = 0;
+  for (size_t j = 0; j < lengths_[i]; j++) {
+    const char c = components_[i][j];
+    if ((c < '0') || (c > '9')) {
+      return false;
+    }
+    value = value * 10 + (c - '0');
+    if (value >= limit) {
+      return false;
+    }
+  }
+  *index = value;
+  return true;
+}
+
+
+// Copies a value into (oldp, oldlenp) following the mallctl() conventions.
+template<typename T>
+always_inline int CtlRead(T value, void* oldp, size_t* oldlenp) {
+  if ((oldp == NULL) || (oldlenp == NULL)) {
+    return 0;
+  }
+  if (*oldlenp != sizeof(value)) {
+    *oldlenp = (*oldlenp < sizeof(value)) ? *oldlenp : sizeof(value);
+    memcpy(oldp, &value, *oldlenp);
+    return EINVAL;
+  }
+  memcpy(oldp, &value, sizeof(value));
+  return 0;
+}
+
+
+// Copies a value out of (newp, newlen) following the mallctl() conventions.
+template<typename T>
+always_inline int CtlWrite(void* newp, size_t newlen, T* value) {
+  if (newlen != sizeof(*value)) {
+    return EINVAL;
+  }
+  memcpy(value, newp, sizeof(*value));
+  return 0;
+}
+
+
+inline int CtlStatsClass(CtlName* name, void* oldp, size_t* oldlenp) {
+  int64_t sc;
+  if ((name->Length() != 4) || !name->Index(2, kNumClasses, &sc) || (sc == 0)) {
+    return ENOENT;
+  }
+  const SizeClassStats& stats = heap_stats.size_class(sc);
+  if (name->Is(3, "size")) {
+    return CtlRead<uint64_t>(ClassInfo[sc].size, oldp, oldlenp);
+  } else if (name->Is(3, "spans")) {
+    return CtlRead<uint64_t>(stats.spans, oldp, oldlenp);
+  } else if (name->Is(3, "live")) {
+    return CtlRead<uint64_t>(stats.live_objects, oldp, oldlenp);
+  } else if (name->Is(3, "free")) {
+    return CtlRead<uint64_t>(stats.free_objects, oldp, oldlenp);
+  }
+  return ENOENT;
+}
+
+
+inline int CtlStatsSpanPool(CtlName* name, void* oldp, size_t* oldlenp) {
+  if (name->Length() == 3 && name->Is(2, "backends")) {
+    return CtlRead<uint64_t>(span_pool.limit(), oldp, oldlenp);
+  }
+  // stats.span_pool.<slot>.<backend>.{depth,dirty}
+  int64_t slot;
+  int64_t backend;
+  if ((name->Length() != 5) ||
+      !name->Index(2, SpanPool::kSizeClassSlots, &slot) ||
+      !name->Index(3, span_pool.limit(), &backend)) {
+    return ENOENT;
+  }
+  if (name->Is(4, "depth")) {
+    return CtlRead<uint64_t>(span_pool.Depth(slot, backend), oldp, oldlenp);
+  } else if (name->Is(4, "dirty")) {
+    return CtlRead<uint64_t>(
+        span_pool.DirtyDepth(slot, backend), oldp, oldlenp);
+  }
+  return ENOENT;
+}
+
+
+inline int CtlStatsNuma(CtlName* name, void* oldp, size_t* oldlenp) {
+  if (name->Length() == 3 && name->Is(2, "nodes")) {
+    return CtlRead<uint64_t>(numa_topology.nodes(), oldp, oldlenp);
+  }
+  int64_t node;
+  if ((name->Length() != 4) ||
+      !name->Index(2, numa_topology.nodes(), &node)) {
+    return ENOENT;
+  }
+  if (name->Is(3, "used")) {
+    return CtlRead<uint64_t>(
+        object_space.current(node) - object_space.start(node), oldp, oldlenp);
+  } else if (name->Is(3, "pooled")) {
+    return CtlRead<uint64_t>(span_pool.NodeDepth(node), oldp, oldlenp);
+  }
+  return ENOENT;
+}
+
+
+inline int CtlStatsCores(CtlName* name, void* oldp, size_t* oldlenp) {
+  int64_t nr_cores = 0;
+  for (Core* c = Core::First(); c != nullptr; c = c->Next()) {
+    nr_cores++;
+  }
+  if (name->Length() == 3 && name->Is(2, "count")) {
+    return CtlRead<uint64_t>(nr_cores, oldp, oldlenp);
+  }
+  int64_t index;
+  if ((name->Length() != 4) || !name->Index(2, nr_cores, &index)) {
+    return ENOENT;
+  }
+  Core* c = Core::First();
+  while (index-- > 0) {
+    c = c->Next();
+  }
+  const CoreCounters& counters = c->counters();
+  if (name->Is(3, "span_refills")) {
+    return CtlRead<uint64_t>(counters.span_refills, oldp, oldlenp);
+  } else if (name->Is(3, "reused_spans")) {
+    return CtlRead<uint64_t>(counters.reused_spans, oldp, oldlenp);
+  } else if (name->Is(3, "new_spans")) {
+    return CtlRead<uint64_t>(counters.new_spans, oldp, oldlenp);
+  } else if (name->Is(3, "large_allocations")) {
+    return CtlRead<uint64_t>(counters.large_allocations, oldp, oldlenp);
+  } else if (name->Is(3, "remote_frees")) {
+    return CtlRead<uint64_t>(counters.remote_frees, oldp, oldlenp);
+  } else if (name->Is(3, "remote_flushes")) {
+    return CtlRead<uint64_t>(counters.remote_flushes, oldp, oldlenp);
+  } else if (name->Is(3, "reclaimed_spans")) {
+    return CtlRead<uint64_t>(counters.reclaimed_spans, oldp, oldlenp);
+  } else if (name->Is(3, "stolen_spans")) {
+    return CtlRead<uint64_t>(counters.stolen_spans, oldp, oldlenp);
+  }
+  return ENOENT;
+}
+
+
+inline int CtlProf(CtlName* name, void* oldp, size_t* oldlenp,
+                   void* newp, size_t newlen) {
+  if (name->Length() != 2) {
+    return ENOENT;
+  }
+  if (name->Is(1, "sample_rate")) {
+    const uint64_t old_rate = heap_profiler.sample_rate();
+    if (newp != NULL) {
+      if (newlen != sizeof(uint64_t)) {
+        return EINVAL;
+      }
+      uint64_t rate;
+      memcpy(&rate, newp, sizeof(rate));
+      heap_profiler.set_sample_rate(rate);
+    }
+    return CtlRead<uint64_t>(old_rate, oldp, oldlenp);
+  } else if (name->Is(1, "dump")) {
+    const char* path = NULL;
+    if (newp != NULL) {
+      if (newlen != sizeof(path)) {
+        return EINVAL;
+      }
+      memcpy(&path, newp, sizeof(path));
+    }
+    return heap_profiler.Dump(path);
+  }
+  return ENOENT;
+}
+
+
+inline int CtlConfigClass(CtlName* name, void* oldp, size_t* oldlenp,
+                          void* newp, size_t newlen) {
+  int64_t sc;
+  if ((name->Length() != 4) || !name->Index(2, kNumClasses, &sc) ||
+      (sc == 0) || !name->Is(3, "reuse_threshold")) {
+    return ENOENT;
+  }
+  const uint64_t old_threshold = config.reuse_threshold(sc);
+  if (newp != NULL) {
+    uint64_t threshold;
+    int ret;
+    if ((ret = CtlWrite<uint64_t>(newp, newlen, &threshold)) != 0) {
+      return ret;
+    }
+    if ((threshold > 100) || !config.set_reuse_threshold(sc, threshold)) {
+      return EINVAL;
+    }
+    UpdateReuseThreshold(sc);
+  }
+  return CtlRead<uint64_t>(old_threshold, oldp, oldlenp);
+}
+
+
+inline int CtlConfig(CtlName* name, void* oldp, size_t* oldlenp,
+                     void* newp, size_t newlen) {
+  if (name->Is(1, "classes")) {
+    return CtlConfigClass(name, oldp, oldlenp, newp, newlen);
+  }
+  if (name->Length() != 2) {
+    return ENOENT;
+  }
+
+  // Writable options.
+  int ret;
+  if (name->Is(1, "reuse_threshold")) {
+    const uint64_t old_threshold = config.reuse_threshold();
+    if (newp != NULL) {
+      uint64_t threshold;
+      if ((ret = CtlWrite<uint64_t>(newp, newlen, &threshold)) != 0) {
+        return ret;
+      }
+      if ((threshold > 100) || !config.set_reuse_threshold(threshold)) {
+        return EINVAL;
+      }
+      UpdateReuseThresholds();
+    }
+    return CtlRead<uint64_t>(old_threshold, oldp, oldlenp);
+  } else if (name->Is(1, "span_pool_backend_limit")) {
+    const uint64_t old_limit = config.span_pool_backend_limit();
+    if (newp != NULL) {
+      uint64_t limit;
+      if ((ret = CtlWrite<uint64_t>(newp, newlen, &limit)) != 0) {
+        return ret;
+      }
+      if ((limit > INT32_MAX) || !config.set_span_pool_backend_limit(limit)) {
+        return EINVAL;
+      }
+    }
+    return CtlRead<uint64_t>(old_limit, oldp, oldlenp);
+  } else if (name->Is(1, "madvise_decay_ms")) {
+    const int64_t old_decay = config.madvise_decay_ms();
+    if (newp != NULL) {
+      int64_t decay;
+      if ((ret = CtlWrite<int64_t>(newp, newlen, &decay)) != 0) {
+        return ret;
+      }
+      if (!config.set_madvise_decay_ms(decay)) {
+        return EINVAL;
+      }
+      span_pool.DecayChanged();
+    }
+    return CtlRead<int64_t>(old_decay, oldp, oldlenp);
+  } else if (name->Is(1, "large_object_cache_bytes")) {
+    const uint64_t old_bytes = config.large_object_cache_bytes();
+    if (newp != NULL) {
+      uint64_t bytes;
+      if ((ret = CtlWrite<uint64_t>(newp, newlen, &bytes)) != 0) {
+        return ret;
+      }
+      config.set_large_object_cache_bytes(bytes);
+      large_object_cache.Trim(false);
+    }
+    return CtlRead<uint64_t>(old_bytes, oldp, oldlenp);
+  }
+
+  // Options that are fixed after initialization.
+  if (newp != NULL) {
+    return EPERM;
+  }
+  if (name->Is(1, "lab_model")) {
+    return CtlRead<uint64_t>(config.lab_model(), oldp, oldlenp);
+  } else if (name->Is(1, "cleanup_in_free")) {
+    return CtlRead<uint64_t>(config.cleanup_in_free(), oldp, oldlenp);
+  } else if (name->Is(1, "background_purge")) {
+    return CtlRead<uint64_t>(config.background_purge(), oldp, oldlenp);
+  }
+  return ENOENT;
+}
+
+
+// Returns empty spans to the span pool and purges all dirty spans and cached
+// large objects. Returns the number of bytes given back to the OS.
+inline uint64_t Purge() {
+  Core::ReleaseEmptySpans();
+  return span_pool.Purge() + large_object_cache.Trim(true);
+}
+
+
+inline int CtlStats(CtlName* name, void* oldp, size_t* oldlenp) {
+  if (name->Is(1, "classes")) {
+    return CtlStatsClass(name, oldp, oldlenp);
+  } else if (name->Is(1, "span_pool")) {
+    return CtlStatsSpanPool(name, oldp, oldlenp);
+  } else if (name->Is(1, "cores")) {
+    return CtlStatsCores(name, oldp, oldlenp);
+  } else if (name->Is(1, "numa")) {
+    return CtlStatsNuma(name, oldp, oldlenp);
+  } else if (name->Is(1, "large")) {
+    if (name->Length() != 3) {
+      return ENOENT;
+    }
+    if (name->Is(2, "count")) {
+      return CtlRead<uint64_t>(LargeObject::NrObjects(), oldp, oldlenp);
+    } else if (name->Is(2, "mapped")) {
+      return CtlRead<uint64_t>(LargeObject::MappedBytes(), oldp, oldlenp);
+    } else if (name->Is(2, "cached")) {
+      return CtlRead<uint64_t>(large_object_cache.CachedBytes(), oldp, oldlenp);
+    }
+    return ENOENT;
+  } else if (name->Is(1, "spans")) {
+    if (name->Length() != 3) {
+      return ENOENT;
+    }
+    if (name->Is(2, "hot")) {
+      return CtlRead<uint64_t>(heap_stats.spans_hot(), oldp, oldlenp);
+    } else if (name->Is(2, "floating")) {
+      return CtlRead<uint64_t>(heap_stats.spans_floating(), oldp, oldlenp);
+    } else if (name->Is(2, "reusable")) {
+      return CtlRead<uint64_t>(heap_stats.spans_reusable(), oldp, oldlenp);
+    } else if (name->Is(2, "full")) {
+      return CtlRead<uint64_t>(heap_stats.spans_full(), oldp, oldlenp);
+    }
+    return ENOENT;
+  }
+
+  if (name->Length() != 2) {
+    return ENOENT;
+  }
+  if (name->Is(1, "allocated")) {
+    return CtlRead<uint64_t>(heap_stats.allocated(), oldp, oldlenp);
+  } else if (name->Is(1, "mapped")) {
+    return CtlRead<uint64_t>(heap_stats.mapped(), oldp, oldlenp);
+  } else if (name->Is(1, "madvised")) {
+    return CtlRead<uint64_t>(span_pool.MadvisedBytes(), oldp, oldlenp);
+  } else if (name->Is(1, "small_free")) {
+    return CtlRead<uint64_t>(heap_stats.small_free(), oldp, oldlenp);
+  }
+  return ENOENT;
+}
+
+
+// Named-key introspection following jemalloc's mallctl(). Values are uint64_t.
+// Statistics under "stats." are served from a snapshot that is refreshed by
+// writing (any value) to "epoch". Per-core counters, span pool depths, large
+// object counters, NUMA statistics, and "stats.madvised" are always read live.
+//
+// Keys:
+//   epoch
+//   stats.{allocated,mapped,madvised,small_free}
+//   stats.spans.{hot,floating,reusable,full}
+//   stats.classes.<size class>.{size,spans,live,free}
+//   stats.large.{count,mapped,cached}
+//   stats.span_pool.backends
+//   stats.span_pool.<slot>.<backend>.{depth,dirty}
+//   stats.numa.nodes
+//   stats.numa.<node>.{used,pooled}
+//   stats.cores.count
+//   stats.cores.<i>.{span_refills,reused_spans,new_spans,large_allocations,
+//                    remote_frees,remote_flushes,reclaimed_spans,
+//                    stolen_spans}
+//
+// Runtime configuration (see config.h). Writing returns the previous value.
+// madvise_decay_ms is an int64_t, lab_model is one of the SCALLOC_LAB_MODEL_*
+// values:
+//   config.{lab_model,cleanup_in_free,background_purge}
+//   config.{reuse_threshold,span_pool_backend_limit,madvise_decay_ms,
+//           large_object_cache_bytes}  (rw)
+//   config.classes.<size class>.reuse_threshold  (rw)
+//
+// Actions:
+//   purge              Purges all dirty spans and empties the large object
+//                      cache. Reads the number of purged bytes.
+//
+// Heap profiler (see profiler.h):
+//   prof.sample_rate   Mean bytes between samples, 0 disables sampling. (rw)
+//   prof.dump          Writes a profile to the path given as const char*, or
+//                      to a default location if no value is given.
+inline int mallctl(const char* name, void* oldp, size_t* oldlenp,
+                   void* newp, size_t newlen) {
+  if (name == NULL) {
+    return EINVAL;
+  }
+  CtlName n(name);
+  if (!n.Valid()) {
+    return ENOENT;
+  }
+
+  if (n.Is(0, "epoch") && (n.Length() == 1)) {
+    if (newp != NULL) {
+      if (newlen != sizeof(uint64_t)) {
+        return EINVAL;
+      }
+      heap_stats.Refresh();
+    }
+    return CtlRead<uint64_t>(heap_stats.epoch(), oldp, oldlenp);
+  }
+
+  if (n.Is(0, "prof")) {
+    return CtlProf(&n, oldp, oldlenp, newp, newlen);
+  } else if (n.Is(0, "config")) {
+    return CtlConfig(&n, oldp, oldlenp, newp, newlen);
+  } else if (n.Is(0, "purge") && (n.Length() == 1)) {
+    return CtlRead<uint64_t>(Purge(), oldp, oldlenp);
+  }
+
+  if (newp != NULL) {
+    // All other keys are read-only.
+    return EPERM;
+  }
+  if (n.Is(0, "stats")) {
+    return CtlStats(&n, oldp, oldlenp);
+  }
+  return ENOENT;
+}
+
+}  // namespace scalloc
+
+#endif  // SCALLOC_CTL_H_
@@ -15,8 +15,15 @@ class IncrementalFreeList {
  public:
   always_inline IncrementalFreeList(intptr_t start, size_t size_class);
   always_inline int32_t Push(void* obj);
+  // Pushes a chain of len objects, already linked from first to last.
+  always_inline int32_t PushRange(void* first, void* last, int32_t len);
   always_inline void* Pop();
+  // Pops up to n objects into objs and returns how many. Objects from the bump
+  // region are handed out without touching them.
+  always_inline size_t PopBatch(void** objs, size_t n);
   always_inline void SetList(void* objs, size_t len);
+  // Prefetches the object the next Pop() returns.
+  always_inline void PrefetchNext();
 
   always_inline int_fast32_t Length() { return len_; }
 
@@ -31,8 +38,8 @@ class IncrementalFreeList {
 IncrementalFreeList::IncrementalFreeList(intptr_t start, size_t size_class)
     : list_(NULL)
     , bump_pointer_(start)
-    , len_(ClassToObjects[size_class])
-    , increment_(ClassToSize[size_class]) {
+    , len_(ClassInfo[size_class].objects)
+    , increment_(ClassInfo[size_class].size) {
 }
 
 
@@ -44,16 +51,31 @@ int32_t IncrementalFreeList::Push(void* obj) {
 }
 
 
+int32_t IncrementalFreeList::PushRange(void* first, void* last, int32_t len) {
+  *(reinterpret_cast<void**>(last)) = list_;
+  list_ = first;
+  len_ += len;
+  return len_;
+}
+
+
 void IncrementalFreeList::SetList(void* objs, size_t len) {
   list_ = objs;
   len_ = len;
 }
 
 
+void IncrementalFreeList::PrefetchNext() {
+  PREFETCH_W((list_ != NULL) ? list_ : reinterpret_cast<void*>(bump_pointer_));
+}
+
+
 void* IncrementalFreeList::Pop() {
   void* result = list_;
   if (result != NULL) {
     list_ = *(reinterpret_cast<void**>(list_));
+    // Following the list is a dependent load, so get the next one going.
+    PREFETCH_W(list_);
     len_--;
   } else {
     if (UNLIKELY(len_ == 0)) {
@@ -66,6 +88,28 @@ void* IncrementalFreeList::Pop() {
   return result;
 }
 
+
+size_t IncrementalFreeList::PopBatch(void** objs, size_t n) {
+  size_t count = 0;
+  while ((count < n) && (list_ != NULL)) {
+    objs[count++] = list_;
+    list_ = *(reinterpret_cast<void**>(list_));
+  }
+  len_ -= count;
+  // The list is empty at this point (or we are done), so len_ is what is left
+  // of the bump region, which is carved up in a counted (vectorizable) loop.
+  size_t bump = n - count;
+  if (bump > static_cast<size_t>(len_)) {
+    bump = len_;
+  }
+  for (size_t i = 0; i < bump; i++) {
+    objs[count + i] = reinterpret_cast<void*>(bump_pointer_ + i * increment_);
+  }
+  bump_pointer_ += bump * increment_;
+  len_ -= bump;
+  return count + bump;
+}
+
 }  // namespace scalloc
 
 #endif  // SCALLOC_FREE_LIST_H_
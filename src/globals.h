@@ -6,19 +6,23 @@
 #define SCALLOC_GLOBALS_H_
 
 #include "platform/globals.h"
+#include "size_classes_raw.h"
 
 const size_t kPageSize = 4096;
 const uint64_t kPageNrMask = ~(static_cast<uint64_t>(kPageSize) - 1);
 const uint64_t kPageOffsetMask = static_cast<uint64_t>(kPageSize) - 1;
 
-const size_t kMaxThreads = 128;
+const int32_t kMaxNumaNodes = 64;
+const int32_t kMaxCpus = 1024;
 
 const uint64_t kKilo = 1UL << 10;
 const uint64_t kMega = kKilo * kKilo;
 const uint64_t kGiga = kMega * kKilo;
 const uint64_t kTera = kGiga * kKilo;
 
-const uint64_t kLABSpaceSize = 100 * kPageSize;
+// Address space reserved for cores. Only the cores that are actually used
+// are backed by memory.
+const uint64_t kLABSpaceSize = 4 * kGiga;
 const uint64_t kObjectSpaceSize = 35 * kTera;
 
 // TODO: Cleanup.
@@ -32,8 +36,11 @@ const size_t kMaxMediumSize = 1UL << kMaxMediumShift;
 const size_t kVirtualSpanSize = 1UL << kVirtualSpanShift;
 const uintptr_t kVirtualSpanMask = ~(kVirtualSpanSize - 1);
 const size_t kFineClasses = kMaxSmallSize / kMinAlignment + 1;
-const size_t kCoarseClasses = kMaxMediumShift - kMaxSmallShift;
-const int32_t kNumClasses = kFineClasses + kCoarseClasses;
+// kCoarseClasses and kAlignedClasses come with the generated size classes.
+// Aligned classes are only used for aligned allocations, see
+// AlignedSizeToClass().
+const int32_t kFirstAlignedClass = kFineClasses + kCoarseClasses;
+const int32_t kNumClasses = kFirstAlignedClass + kAlignedClasses;
 
 namespace scalloc {
 
@@ -43,8 +50,10 @@ namespace scalloc {
 #define SCALLOC_REUSE_THRESHOLD (80)
 #endif  // SCALLOC_REUSE_THRESHOLD
 
+// The LAB model of a build is only the default, see Config.
 #define SCALLOC_LAB_MODEL_TLAB  0
 #define SCALLOC_LAB_MODEL_RR    1
+#define SCALLOC_LAB_MODEL_PERCPU 2
 #ifndef SCALLOC_LAB_MODEL
 #define SCALLOC_LAB_MODEL SCALLOC_LAB_MODEL_TLAB
 #endif  // SCALLOC_LAB_MODEL
@@ -53,29 +62,81 @@ namespace scalloc {
 #define SCALLOC_MADVISE 1
 #endif  // !SCALLOC_NO_MADVISE
 
-#ifndef SCALLOC_NO_MADVISE_EAGER
+#if defined(SCALLOC_MADVISE) && !defined(SCALLOC_NO_MADVISE_DECAY)
+#define SCALLOC_MADVISE_DECAY 1
+#endif  // SCALLOC_MADVISE && !SCALLOC_NO_MADVISE_DECAY
+
+#ifndef SCALLOC_MADVISE_DECAY_MS
+#define SCALLOC_MADVISE_DECAY_MS (1000)
+#endif  // SCALLOC_MADVISE_DECAY_MS
+
+// Decay-based purging replaces eager purging.
+#if !defined(SCALLOC_NO_MADVISE_EAGER) && !defined(SCALLOC_MADVISE_DECAY)
 #define SCALLOC_MADVISE_EAGER 1
-#endif  // !SCALLOC_NO_MADVISE_EAGER
+#endif  // !SCALLOC_NO_MADVISE_EAGER && !SCALLOC_MADVISE_DECAY
+
+// Span pool backends are bounded by the number of CPUs anyways.
+#ifndef SCALLOC_SPAN_POOL_BACKEND_LIMIT
+#define SCALLOC_SPAN_POOL_BACKEND_LIMIT (16384)
+#endif  // SCALLOC_SPAN_POOL_BACKEND_LIMIT
+
+#ifndef SCALLOC_NO_REMOTE_FREE_BUFFER
+#define SCALLOC_REMOTE_FREE_BUFFER 1
+#endif  // !SCALLOC_NO_REMOTE_FREE_BUFFER
+
+// Per-CPU cores come with their own cache (see CpuCache) and bypass the thread
+// cache.
+#ifndef SCALLOC_NO_THREAD_CACHE
+#define SCALLOC_THREAD_CACHE 1
+#endif  // !SCALLOC_NO_THREAD_CACHE
+
+#ifndef SCALLOC_NO_NUMA
+#define SCALLOC_NUMA 1
+#endif  // !SCALLOC_NO_NUMA
+
+#if defined(SCALLOC_HUGEPAGES) && defined(SCALLOC_DISABLE_TRANSPARENT_HUGEPAGES)
+#error "hugepages and disable_transparent_hugepages are mutually exclusive"
+#endif  // SCALLOC_HUGEPAGES && SCALLOC_DISABLE_TRANSPARENT_HUGEPAGES
+
+#ifndef SCALLOC_NO_SPAN_STEALING
+#define SCALLOC_SPAN_STEALING 1
+#endif  // !SCALLOC_NO_SPAN_STEALING
+
+#ifndef SCALLOC_NO_LARGE_OBJECT_CACHE
+#define SCALLOC_LARGE_OBJECT_CACHE 1
+#endif  // !SCALLOC_NO_LARGE_OBJECT_CACHE
 
 const int32_t kReuseThreshold = SCALLOC_REUSE_THRESHOLD;
+const uint64_t kMadviseDecayMs = SCALLOC_MADVISE_DECAY_MS;
+const int32_t kSpanPoolBackendLimit = SCALLOC_SPAN_POOL_BACKEND_LIMIT;
+const uint64_t kLargeObjectCacheBytes = 256 * kMega;
 
-#if SCALLOC_LAB_MODEL == SCALLOC_LAB_MODEL_TLAB
-class ThreadLocalAllocationBuffer;
-typedef ThreadLocalAllocationBuffer ABProvider;
-#elif SCALLOC_LAB_MODEL == SCALLOC_LAB_MODEL_RR
-class RoundRobinAllocationBuffer;
-typedef RoundRobinAllocationBuffer ABProvider;
-#else
+#if (SCALLOC_LAB_MODEL != SCALLOC_LAB_MODEL_TLAB) && \
+    (SCALLOC_LAB_MODEL != SCALLOC_LAB_MODEL_RR) && \
+    (SCALLOC_LAB_MODEL != SCALLOC_LAB_MODEL_PERCPU)
 #error "unknown LAB model"
 #endif  // SCALLOC_LAB_MODEL
 
+class ABProvider;
 class Arena;
+class BackgroundPurger;
+class Config;
+class HeapProfiler;
+class HeapStats;
+class LargeObjectCache;
+class NumaTopology;
 class SpanPool;
 
+extern Config config;
+extern NumaTopology numa_topology;
 extern Arena object_space;
 extern Arena core_space;
 extern SpanPool span_pool;
 extern ABProvider ab_scheduler;
+extern HeapStats heap_stats;
+extern HeapProfiler heap_profiler;
+extern LargeObjectCache large_object_cache;
+extern BackgroundPurger background_purger;
 
 }  // namespace scalloc
 
@@ -8,52 +8,89 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <new>
+#if defined(__GLIBCXX__)
+// std::__throw_bad_alloc(), which libc++ declares in <new>.
+#include <bits/functexcept.h>
+#endif  // __GLIBCXX__
+
 #include "arena.h"
+#include "config.h"
 #include "globals.h"
 #include "lab.h"
+#include "large_object_cache.h"
 #include "log.h"
+#include "numa.h"
 #include "platform/override.h"
+#include "profiler.h"
+#include "purger.h"
+#include "scalloc.h"
 #include "size_classes_raw.h"
 #include "size_classes.h"
 #include "span_pool.h"
+#include "stats.h"
 
 
 namespace scalloc {
 
-cache_aligned const int32_t ClassToObjects[] = {
-#define NR_OBJECTS(a, b, c, d) (d),
-FOR_ALL_SIZE_CLASSES(NR_OBJECTS)
-#undef NR_OBJECTS
+#ifdef SCALLOC_HUGEPAGES
+// In hugepage mode every span fills its whole virtual span, i.e., a single
+// hugepage. Remote free lists count objects in a 16 bit tag, which bounds the
+// number of objects of the smallest classes.
+constexpr int32_t HugeSpanObjects(int32_t size_class, int32_t size) {
+  return (size == 0) ? 0 :
+      (((kVirtualSpanSize - ClassBlockOffset(size_class, size)) / size) > TaggedValue<void*>::kMaxTag) ?  // NOLINT
+          TaggedValue<void*>::kMaxTag :
+          ((kVirtualSpanSize - ClassBlockOffset(size_class, size)) / size);
+}
+#define SPAN_OBJECTS(sc, size, objects) HugeSpanObjects(sc, size)
+#define SPAN_BYTES(size, bytes) (((size) == 0) ? 0 : kVirtualSpanSize)
+#else
+#define SPAN_OBJECTS(sc, size, objects) (objects)
+#define SPAN_BYTES(size, bytes) (bytes)
+#endif  // SCALLOC_HUGEPAGES
+
+// Reuse thresholds are recomputed from the configured percentages, see
+// UpdateReuseThreshold().
+cache_aligned SizeClassInfo ClassInfo[] = {
+#define CLASS_INFO(a, b, c, d)                                                 \
+  { (b), SPAN_OBJECTS(a, b, d), SPAN_BYTES(b, c),                              \
+    ((SPAN_OBJECTS(a, b, d) * kReuseThreshold)/100) },
+FOR_ALL_SIZE_CLASSES(CLASS_INFO)
+#undef CLASS_INFO
 };
 
-cache_aligned const int32_t ClassToSize[] = {
-#define OBJECT_SIZE(a, b, c, d) (b),
-FOR_ALL_SIZE_CLASSES(OBJECT_SIZE)
-#undef OBJECT_SIZE
+cache_aligned const uint8_t DirectSizeToClass[] = {
+#define DIRECT_SIZE(a, b) (b),
+FOR_ALL_DIRECT_SIZES(DIRECT_SIZE)
+#undef DIRECT_SIZE
 };
 
-cache_aligned const int32_t ClassToSpanSize[] = {
-#define SPAN_SIZE(a, b, c, d) (c),
-FOR_ALL_SIZE_CLASSES(SPAN_SIZE)
-#undef SPAN_SIZE
+cache_aligned const uint8_t MediumSizeToClass[] = {
+#define MEDIUM_BIN(a, b) (b),
+FOR_ALL_MEDIUM_BINS(MEDIUM_BIN)
+#undef MEDIUM_BIN
 };
 
-cache_aligned const int32_t ClassToReuseThreshold[] = {
-#define REUSE_TH(a, b, c, d) (((d) * kReuseThreshold)/100),
-FOR_ALL_SIZE_CLASSES(REUSE_TH)
-#undef REUSE_TH
-};
+#undef SPAN_OBJECTS
+#undef SPAN_BYTES
 
 // Be careful with order here! Since we define all globals in a single
 // translation unit we can rely on order.
 
+cache_aligned Config config;
+cache_aligned NumaTopology numa_topology;
 cache_aligned Arena core_space;
 cache_aligned Arena object_space;
 cache_aligned SpanPool span_pool;
 cache_aligned ABProvider ab_scheduler;
+cache_aligned HeapStats heap_stats;
+cache_aligned HeapProfiler heap_profiler;
+cache_aligned LargeObjectCache large_object_cache;
+cache_aligned BackgroundPurger background_purger;
 cache_aligned ScallocGuard StartupExitHook;
 /*cache_aligned*/ int32_t ScallocGuardRefcount;
-/*cache_aligned*/ int32_t seen_memalign;
+int log_verbosity = kVerbosity;
 
 #ifdef PROFILE
 cache_aligned std::atomic<int32_t> local_frees;
@@ -70,14 +107,37 @@ void exitHandler() {
 
 
 static void ScallocInit() {
+  config.Init();
+  UpdateReuseThresholds();
   core_space.Init(kLABSpaceSize, kPageSize, "LAB");
+  numa_topology.Init();
   object_space.Init(kObjectSpaceSize, kObjectSpaceSize, "object");
+  // One partition of the object space per NUMA node.
+  object_space.Partition(numa_topology.nodes());
+  for (int32_t i = 0; i < numa_topology.nodes(); i++) {
+    numa_topology.Bind(
+        object_space.start(i), object_space.partition_len(), i);
+  }
+#if defined(SCALLOC_HUGEPAGES) && defined(MADV_HUGEPAGE)
+  // Spans are hugepage aligned. Ask for hugepages even if THP is only enabled
+  // on request.
+  if (madvise(reinterpret_cast<void*>(object_space.start(0)),
+              kObjectSpaceSize, MADV_HUGEPAGE) != 0) {
+    LOG(kWarning, "madvise MADV_HUGEPAGE failed");
+  }
+#endif  // SCALLOC_HUGEPAGES && MADV_HUGEPAGE
   span_pool.Init();
-  ab_scheduler.Init();
+#ifdef SCALLOC_SPAN_STEALING
+  Core::InitSpanStealing();
+#endif  // SCALLOC_SPAN_STEALING
+  heap_profiler.Init();
+  ab_scheduler.Init(config.lab_model());
 
   ab_scheduler.GetMeALAB();
   ReplaceSystemAllocator();
   atexit(exitHandler);
+  // Last, as starting a thread allocates.
+  background_purger.Start();
 }
 
 
@@ -118,6 +178,16 @@ void scalloc_free(void* p) __THROW {
 }
 
 
+void scalloc_free_sized(void* p, size_t size) __THROW {
+  scalloc::free_sized(p, size);
+}
+
+
+void scalloc_free_aligned_sized(void* p, size_t alignment, size_t size) __THROW {
+  scalloc::free_aligned_sized(p, alignment, size);
+}
+
+
 void* scalloc_calloc(size_t nmemb, size_t size) __THROW {
   return scalloc::calloc(nmemb, size);
 }
@@ -153,6 +223,16 @@ void* scalloc_pvalloc(size_t __size) __THROW {
 }
 
 
+size_t scalloc_malloc_usable_size(void* p) __THROW {
+  return scalloc::malloc_usable_size(p);
+}
+
+
+size_t scalloc_nallocx(size_t size, int flags) __THROW {
+  return scalloc::nallocx(size, flags);
+}
+
+
 void scalloc_malloc_stats() __THROW {
   scalloc::malloc_stats();
 }
@@ -163,6 +243,61 @@ int scalloc_mallopt(int cmd, int value) __THROW {
 }
 
 
+int scalloc_malloc_trim(size_t pad) __THROW {
+  return scalloc::malloc_trim(pad);
+}
+
+
+size_t scalloc_malloc_batch(size_t size, void** ptrs, size_t n) __THROW {
+  return scalloc::malloc_batch(size, ptrs, n);
+}
+
+
+void scalloc_free_batch(void** ptrs, size_t n) __THROW {
+  scalloc::free_batch(ptrs, n);
+}
+
+
+void* scalloc_heap_create() __THROW {
+  return scalloc::heap_create();
+}
+
+
+void* scalloc_heap_malloc(void* heap, size_t size) __THROW {
+  return scalloc::heap_malloc(heap, size);
+}
+
+
+void scalloc_heap_free(void* heap, void* p) __THROW {
+  scalloc::heap_free(heap, p);
+}
+
+
+void scalloc_heap_destroy(void* heap) __THROW {
+  scalloc::heap_destroy(heap);
+}
+
+
+int scalloc_mallctl(const char* name, void* oldp, size_t* oldlenp,
+                    void* newp, size_t newlen) __THROW {
+  return scalloc::mallctl(name, oldp, oldlenp, newp, newlen);
+}
+
+
+#if defined(__GLIBC__)
+struct mallinfo scalloc_mallinfo() __THROW {
+  return scalloc::mallinfo();
+}
+
+
+#if __GLIBC_PREREQ(2, 33)
+struct mallinfo2 scalloc_mallinfo2() __THROW {
+  return scalloc::mallinfo2();
+}
+#endif  // __GLIBC_PREREQ(2, 33)
+#endif  // __GLIBC__
+
+
 void* scalloc_thread_start(void* arg) {
   scalloc::ab_scheduler.GetMeALAB();
 
@@ -171,3 +306,173 @@ void* scalloc_thread_start(void* arg) {
   return fake_args.real_start(fake_args.real_args);
 }
 }
+
+
+// C++ allocation and deallocation functions. We are built without exceptions,
+// so a failing throwing new that cannot make progress through a new_handler
+// has the C++ library throw std::bad_alloc for us, like its own new does.
+
+namespace {
+
+always_inline void* CppNew(size_t size, bool nothrow) {
+  // Unlike malloc(), new has to return a unique pointer for size 0.
+  if (UNLIKELY(size == 0)) {
+    size = 1;
+  }
+  void* p;
+  while ((p = scalloc::malloc(size)) == NULL) {
+    std::new_handler handler = std::get_new_handler();
+    if (handler == NULL) {
+      if (nothrow) {
+        return NULL;
+      }
+      std::__throw_bad_alloc();
+    }
+    handler();
+  }
+  return p;
+}
+
+
+always_inline void* CppNewAligned(size_t size, size_t alignment, bool nothrow) {
+  if (UNLIKELY(size == 0)) {
+    size = 1;
+  }
+  // A bad alignment fails the same way on every try, so only running out of
+  // memory goes through the new_handler.
+  if (UNLIKELY((alignment & (alignment - 1)) != 0)) {
+    if (nothrow) {
+      return NULL;
+    }
+    std::__throw_bad_alloc();
+  }
+  void* p;
+  while ((p = scalloc::aligned_malloc(alignment, size)) == NULL) {
+    std::new_handler handler = std::get_new_handler();
+    if (handler == NULL) {
+      if (nothrow) {
+        return NULL;
+      }
+      std::__throw_bad_alloc();
+    }
+    handler();
+  }
+  return p;
+}
+
+}  // namespace
+
+
+void* operator new(size_t size) {
+  return CppNew(size, false);
+}
+
+
+void* operator new[](size_t size) {
+  return CppNew(size, false);
+}
+
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  return CppNew(size, true);
+}
+
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+  return CppNew(size, true);
+}
+
+
+void operator delete(void* p) noexcept {
+  scalloc::free(p);
+}
+
+
+void operator delete[](void* p) noexcept {
+  scalloc::free(p);
+}
+
+
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+  scalloc::free(p);
+}
+
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+  scalloc::free(p);
+}
+
+
+// Sized deallocation (C++14). Zero-sized requests have been served from size 1.
+void operator delete(void* p, size_t size) noexcept {
+  scalloc::free_sized(p, size ? size : 1);
+}
+
+
+void operator delete[](void* p, size_t size) noexcept {
+  scalloc::free_sized(p, size ? size : 1);
+}
+
+
+#if defined(__cpp_aligned_new)
+// Aligned allocation (C++17).
+
+void* operator new(size_t size, std::align_val_t alignment) {
+  return CppNewAligned(size, static_cast<size_t>(alignment), false);
+}
+
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+  return CppNewAligned(size, static_cast<size_t>(alignment), false);
+}
+
+
+void* operator new(size_t size, std::align_val_t alignment,
+                   const std::nothrow_t&) noexcept {
+  return CppNewAligned(size, static_cast<size_t>(alignment), true);
+}
+
+
+void* operator new[](size_t size, std::align_val_t alignment,
+                     const std::nothrow_t&) noexcept {
+  return CppNewAligned(size, static_cast<size_t>(alignment), true);
+}
+
+
+void operator delete(void* p, std::align_val_t) noexcept {
+  scalloc::free(p);
+}
+
+
+void operator delete[](void* p, std::align_val_t) noexcept {
+  scalloc::free(p);
+}
+
+
+// Sized aligned deallocation. Zero-sized requests have been served from size 1,
+// see CppNewAligned().
+void operator delete(void* p, size_t size,
+                     std::align_val_t alignment) noexcept {
+  scalloc::free_aligned_sized(p, static_cast<size_t>(alignment),
+                              size ? size : 1);
+}
+
+
+void operator delete[](void* p, size_t size,
+                       std::align_val_t alignment) noexcept {
+  scalloc::free_aligned_sized(p, static_cast<size_t>(alignment),
+                              size ? size : 1);
+}
+
+
+void operator delete(void* p, std::align_val_t,
+                     const std::nothrow_t&) noexcept {
+  scalloc::free(p);
+}
+
+
+void operator delete[](void* p, std::align_val_t,
+                       const std::nothrow_t&) noexcept {
+  scalloc::free(p);
+}
+#endif  // __cpp_aligned_new
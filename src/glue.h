@@ -8,19 +8,26 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif  // __GLIBC__
 
 #include "arena.h"
+#include "ctl.h"
 #include "globals.h"
+#include "heap.h"
 #include "lab.h"
 #include "large-objects.h"
 #include "log.h"
+#include "scalloc.h"
 #include "size_classes.h"
 #include "span.h"
+#include "stats.h"
 
 namespace scalloc {
 
-extern int seen_memalign;
-
 class ScallocGuard {
  public:
   always_inline ScallocGuard();
@@ -30,7 +37,7 @@ class ScallocGuard {
 
 always_inline void* malloc(const size_t size) {
   LOG(kTrace, "malloc: size: %lu", size);
-  void* obj = ab_scheduler.GetAB().Allocate(size);
+  void* obj = ab_scheduler.Allocate(size);
   LOG(kTrace, "returning %p", obj);
   // errno is set in a slow path as soon as we know we cannot serve the request.
   // See core.h
@@ -44,7 +51,7 @@ always_inline void free(void* p) {
   // path anyways.
 
   if (LIKELY(object_space.Contains(p))) {
-    ab_scheduler.GetAB().Free(p);
+    ab_scheduler.Free(p);
   } else {
     // We are in the path for super large objects. Check for NULL here.
     if (UNLIKELY(p == NULL)) {
@@ -55,6 +62,36 @@ always_inline void free(void* p) {
 }
 
 
+// Sized deallocation for blocks obtained from malloc, calloc, or realloc with
+// the given (last requested) size. Any non-zero size up to kMaxMediumSize
+// identifies a block in the object space of that size class.
+always_inline void free_sized(void* p, size_t size) {
+  const int32_t sc = SizeToClass(size);
+  if (LIKELY((sc != 0) && (p != NULL))) {
+    ab_scheduler.Free(p, sc);
+  } else {
+    free(p);
+  }
+}
+
+
+// Sized deallocation for blocks obtained from aligned_alloc() or memalign()
+// with the given alignment and size, see aligned_malloc().
+always_inline void free_aligned_sized(void* p, size_t align, size_t size) {
+  if (align <= kMinAlignment) {
+    free_sized(p, size);
+    return;
+  }
+  const int32_t sc = (((align & (align - 1)) == 0) && (size != 0)) ?
+      AlignedSizeToClass(align, size) : 0;
+  if (LIKELY((sc != 0) && (p != NULL))) {
+    ab_scheduler.Free(p, sc);
+  } else {
+    free(p);
+  }
+}
+
+
 always_inline void* calloc(size_t nmemb, size_t size) {
   LOG(kTrace, "calloc: size: %lu", size);
   const size_t malloc_size = nmemb * size;
@@ -74,35 +111,63 @@ always_inline void* realloc(void* ptr, size_t size) {
   if (UNLIKELY(ptr == NULL)) {
     return malloc(size);
   }
+  // Small blocks are only kept in place if the new size still maps to their
+  // size class, which keeps free_sized() valid for the last requested size.
   void* new_obj = NULL;
-  if (LIKELY(object_space.Contains(ptr))) {
-    Span* s = Span::FromObject(ptr);
-    const size_t old_size = ClassToSize[s->size_class()];
-    if (old_size >= size) {
+  size_t copy_size;
+  const bool small = object_space.Contains(ptr);
+  if (LIKELY(small)) {
+    const int32_t old_sc = Span::FromObject(ptr)->size_class();
+    if ((size == 0) || (SizeToClass(size) == old_sc)) {
       return ptr;
     }
-    new_obj = malloc(size);
-    if (new_obj == nullptr) return nullptr;
-    memmove(new_obj, ptr, old_size);
-    free(ptr);
+    copy_size = ClassInfo[old_sc].size;
   } else {
-    const size_t old_size = LargeObject::PayloadSize(ptr);
-    if (old_size >= size) {
+    if (size == 0) {
       return ptr;
     }
-    new_obj = malloc(size);
-    if (new_obj == nullptr) return nullptr;
-    memmove(new_obj, ptr, old_size);
-    free(ptr);
+    // Large objects stay large: Grow and shrink the mapping instead of
+    // copying.
+    if (size > kMaxMediumSize) {
+      new_obj = LargeObject::Reallocate(ptr, size);
+      if (new_obj != nullptr) {
+        return new_obj;
+      }
+    }
+    copy_size = LargeObject::PayloadSize(ptr);
+  }
+  new_obj = malloc(size);
+  if (new_obj == nullptr) return nullptr;
+  memmove(new_obj, ptr, (copy_size < size) ? copy_size : size);
+  // We already know where the old block lives.
+  if (LIKELY(small)) {
+    ab_scheduler.Free(ptr);
+  } else {
+    LargeObject::Free(ptr);
   }
   return new_obj;
 }
 
 
+// Aligned blocks come from classes whose blocks are all aligned (see
+// AlignedSizeToClass()), or from large objects with an aligned payload. Either
+// way, they are block starts like any other.
+always_inline void* aligned_malloc(size_t align, size_t size) {
+  if ((align <= kMinAlignment) || (size == 0)) {
+    return malloc(size);
+  }
+  void* p = ab_scheduler.Allocate(size, AlignedSizeToClass(align, size), align);
+  if (UNLIKELY(p == nullptr)) {
+    errno = ENOMEM;
+  }
+  return p;
+}
+
+
 always_inline int posix_memalign(void** ptr, size_t align, size_t size) {
   LOG(kTrace, "posix memalign: size: %lu", size);
-  if (seen_memalign == 0) {
-    seen_memalign = 1;
+  if (UNLIKELY(((align & (align - 1)) != 0) || (align < sizeof(void*)))) {
+    return EINVAL;
   }
 
   // Return free-able pointer for size 0.
@@ -111,41 +176,33 @@ always_inline int posix_memalign(void** ptr, size_t align, size_t size) {
     return 0;
   }
 
-  const size_t size_needed = align + size;
-
-  // TODO: check align for power of 2
-  // TODO: check size_needed for overflow
-
-  uintptr_t start = reinterpret_cast<uintptr_t>(malloc(size_needed));
-  if (UNLIKELY(start == 0)) {
+  void* p = aligned_malloc(align, size);
+  if (UNLIKELY(p == NULL)) {
     return ENOMEM;
   }
-
-  uintptr_t new_start = start + align - (start % align);
-  if (new_start != start) {
-    // We add a magicnumber to force recalculation of free() address. This is
-    // valid because we only transition into a slow path but handle the
-    // free still correct.
-    *(reinterpret_cast<uint32_t*>(new_start - sizeof(uint32_t))) = 0xAAAAAAAA;
-  }
-  *ptr = reinterpret_cast<void*>(new_start);
+  *ptr = p;
   return 0;
 }
 
 
 always_inline void* memalign(size_t __alignment, size_t __size) {
-  void* mem;
-  if (posix_memalign(&mem, __alignment, __size)) {
+  // Like glibc, round other alignments up to a power of two.
+  if (UNLIKELY(__alignment > ((~static_cast<size_t>(0) >> 1) + 1))) {
+    errno = EINVAL;
     return NULL;
   }
-  return mem;
+  size_t align = kMinAlignment;
+  while (align < __alignment) {
+    align <<= 1;
+  }
+  return aligned_malloc(align, __size);
 }
 
 
 always_inline void* aligned_alloc(size_t alignment, size_t size) {
   // The function aligned_alloc() is the same as memalign(), except for the
   // added restriction that size should be a multiple of alignment.
-  if (size % alignment != 0) {
+  if ((alignment == 0) || (size % alignment != 0)) {
     errno = EINVAL;
     return NULL;
   }
@@ -163,12 +220,159 @@ always_inline void* pvalloc(size_t __size) {
 }
 
 
+// Returns the number of bytes that may be used in the block at p, which is at
+// least the requested size.
+always_inline size_t malloc_usable_size(void* p) {
+  if (LIKELY(object_space.Contains(p))) {
+    return ClassInfo[Span::FromObject(p)->size_class()].size;
+  }
+  if (p == NULL) {
+    return 0;
+  }
+  return LargeObject::PayloadSize(p);
+}
+
+
+// jemalloc's MALLOCX_LG_ALIGN() bits of nallocx() flags. Other flags do not
+// change the size of a block and are ignored.
+#define SCALLOC_MALLOCX_LG_ALIGN_MASK 0x3f
+
+// Returns the usable size of a block that malloc() (or, with an alignment in
+// flags, aligned_alloc()) would return for size, without allocating it, or 0
+// if the request cannot be served.
+always_inline size_t nallocx(size_t size, int flags) {
+  if (UNLIKELY(size == 0)) {
+    return 0;
+  }
+  const size_t align =
+      static_cast<size_t>(1) << (flags & SCALLOC_MALLOCX_LG_ALIGN_MASK);
+  const int32_t sc = (align <= kMinAlignment) ?
+      SizeToClass(size) : AlignedSizeToClass(align, size);
+  if (LIKELY(sc != 0)) {
+    return ClassInfo[sc].size;
+  }
+  return LargeObject::PayloadSize(size, (align <= kMinAlignment) ? 0 : align);
+}
+
+
 inline void malloc_stats(void) {
+  heap_stats.Print(STDERR_FILENO);
+}
+
+
+#if defined(__GLIBC__)
+// Fills in glibc's mallinfo/mallinfo2 from a fresh statistics snapshot. Small
+// objects are reported as "arena" (ordinary blocks), large objects as mmapped
+// blocks.
+template<typename T, typename V>
+always_inline T FillMallinfo() {
+  T info;
+  memset(&info, 0, sizeof(info));
+  heap_stats.Refresh();
+  uint64_t free_objects = 0;
+  for (int32_t i = 1; i < kNumClasses; i++) {
+    free_objects += heap_stats.size_class(i).free_objects;
+  }
+  info.arena = static_cast<V>(heap_stats.object_space_used());
+  info.ordblks = static_cast<V>(free_objects);
+  info.hblks = static_cast<V>(LargeObject::NrObjects());
+  info.hblkhd = static_cast<V>(LargeObject::MappedBytes());
+  info.uordblks = static_cast<V>(heap_stats.small_allocated());
+  info.fordblks = static_cast<V>(heap_stats.small_free());
+  return info;
+}
+
+
+inline struct mallinfo mallinfo(void) {
+  return FillMallinfo<struct mallinfo, int>();
 }
 
 
+#if __GLIBC_PREREQ(2, 33)
+inline struct mallinfo2 mallinfo2(void) {
+  return FillMallinfo<struct mallinfo2, size_t>();
+}
+#endif  // __GLIBC_PREREQ(2, 33)
+#endif  // __GLIBC__
+
+
+// Returns 1 on success and 0 otherwise, like glibc. Parameters of other
+// allocators are accepted and ignored.
 inline int mallopt(int cmd, int value) {
-  return 0;
+  switch (cmd) {
+    case M_SCALLOC_REUSE_THRESHOLD:
+      if (!config.set_reuse_threshold(value)) {
+        return 0;
+      }
+      UpdateReuseThresholds();
+      return 1;
+    case M_SCALLOC_MADVISE_DECAY_MS:
+      if (!config.set_madvise_decay_ms(value)) {
+        return 0;
+      }
+      span_pool.DecayChanged();
+      return 1;
+    case M_SCALLOC_SPAN_POOL_BACKEND_LIMIT:
+      return config.set_span_pool_backend_limit(value) ? 1 : 0;
+    case M_SCALLOC_LARGE_OBJECT_CACHE_MB:
+      if (value < 0) {
+        return 0;
+      }
+      config.set_large_object_cache_bytes(static_cast<uint64_t>(value) * kMega);
+      large_object_cache.Trim(false);
+      return 1;
+    case M_SCALLOC_PURGE:
+      Purge();
+      return 1;
+  }
+  return 1;
+}
+
+
+// Allocates n blocks of the given size into ptrs and returns the number of
+// blocks allocated, which is only smaller than n if we run out of memory.
+always_inline size_t malloc_batch(size_t size, void** ptrs, size_t n) {
+  if (UNLIKELY(size == 0)) {
+    return 0;
+  }
+  return ab_scheduler.AllocateBatch(size, SizeToClass(size), ptrs, n);
+}
+
+
+// Frees n blocks of any size. Blocks that have been allocated together are
+// returned to their spans together.
+always_inline void free_batch(void** ptrs, size_t n) {
+  ab_scheduler.FreeBatch(ptrs, n);
+}
+
+
+// Explicit heaps, see Heap. Handles are opaque to callers.
+inline void* heap_create() {
+  return Heap::New();
+}
+
+
+always_inline void* heap_malloc(void* heap, size_t size) {
+  return reinterpret_cast<Heap*>(heap)->Allocate(size);
+}
+
+
+always_inline void heap_free(void* heap, void* p) {
+  reinterpret_cast<Heap*>(heap)->Free(p);
+}
+
+
+inline void heap_destroy(void* heap) {
+  if (heap != NULL) {
+    reinterpret_cast<Heap*>(heap)->Destroy();
+  }
+}
+
+
+// Returns 1 if any memory has been given back to the OS. The padding is
+// ignored as scalloc does not have a heap top.
+inline int malloc_trim(size_t pad) {
+  return (Purge() > 0) ? 1 : 0;
 }
 
 }  // namespace scalloc
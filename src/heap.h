@@ -0,0 +1,220 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+#ifndef SCALLOC_HEAP_H_
+#define SCALLOC_HEAP_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <new>
+
+#include "arena.h"
+#include "core.h"
+#include "core_id.h"
+#include "globals.h"
+#include "lab.h"
+#include "large-objects.h"
+#include "lock.h"
+#include "platform/assert.h"
+#include "span.h"
+#include "stack.h"
+#include "utils.h"
+
+namespace scalloc {
+
+// An explicit heap for region-scoped allocation. A heap is a core of its own
+// that keeps all spans it ever takes (see Core::InitRetaining()), so that
+// destroying it returns them to the span pool without looking at individual
+// objects. Large objects of a heap are chained up for the same purpose.
+//
+// Objects of a heap may only be freed through the heap, or all at once by
+// destroying it. Heaps may be shared between threads, in which case their
+// operations are serialized by a lock. Allocations from heaps are not sampled
+// by the heap profiler.
+class Heap : public Core {
+ public:
+  static inline Heap* New();
+
+  // Returns all spans and large objects of the heap to the system. The heap
+  // must not be used afterwards.
+  inline void Destroy();
+
+  always_inline void* Allocate(size_t size);
+  always_inline void Free(void* p);
+
+ private:
+  typedef SpinLock<64> Lock;
+  typedef Stack<128> FreeHeaps;
+
+  // Header in front of a large object of a heap.
+  struct LargeLink {
+    LargeLink* prev;
+    LargeLink* next;
+    Heap* heap;
+    uint64_t pad;
+  };
+
+  // Payloads of large objects of heaps start at this offset into their
+  // mapping. Other large objects start right after the header or at a power
+  // of two (see LargeObject::AllocateAligned()), which tells them apart.
+  static const size_t kLargeOffset = sizeof(LargeObject) + sizeof(LargeLink);
+  static_assert((kLargeOffset & (kLargeOffset - 1)) != 0,
+                "heap payloads must not look aligned");
+  static_assert((kLargeOffset % kMinAlignment) == 0,
+                "heap payloads must be aligned to kMinAlignment");
+
+  always_inline Heap() : Core() {}
+
+  // Returns the link of a large object of any heap, or nullptr for other large
+  // objects.
+  static always_inline LargeLink* LinkOf(void* p);
+
+  never_inline void* AllocateLarge(size_t size);
+  never_inline void FreeLarge(LargeLink* link);
+
+  // Destroyed heaps, reused by New().
+  static FreeHeaps free_heaps_;
+  static std::atomic<int_fast32_t> heap_ids_;
+
+  LargeLink* large_objects_;
+  Lock heap_lock_;
+};
+
+
+Stack<128> Heap::free_heaps_;
+std::atomic<int_fast32_t> Heap::heap_ids_;
+
+
+Heap* Heap::New() {
+  Heap* heap = reinterpret_cast<Heap*>(free_heaps_.Pop());
+  if (heap == nullptr) {
+    heap = new(core_space.Allocate(PadSize(sizeof(Heap), 128))) Heap();
+  }
+  heap->large_objects_ = nullptr;
+  heap->InitRetaining(core_id(heap, heap_ids_.fetch_add(1) + 1));
+  return heap;
+}
+
+
+void Heap::Destroy() {
+  // Cached objects and reusable spans are covered by the retained spans.
+  for (int32_t i = 0; i < kNumClasses; i++) {
+    r_spans_[i].Close();
+    hot_span_[i] = nullptr;
+  }
+  Span* s = retained_spans_;
+  Span* next;
+  while (s != nullptr) {
+    next = s->next_retained();
+    // Spans are always deleted in the full state, see
+    // Core::UpdateSpanState().
+    s->NewMarkFloating();
+    s->NewMarkFull(s->epoch());
+    s->SpanLink()->clear_next();
+    s->ReleaseLink();
+    Span::Delete(s);
+    s = next;
+  }
+  retained_spans_ = nullptr;
+  LargeLink* link = large_objects_;
+  LargeLink* next_link;
+  while (link != nullptr) {
+    next_link = link->next;
+    LargeObject::Free(link);
+    link = next_link;
+  }
+  large_objects_ = nullptr;
+  id_ = kTerminated;
+  free_heaps_.Push(this);
+}
+
+
+void* Heap::Allocate(size_t size) {
+  if (UNLIKELY(size > kMaxMediumSize)) {
+    return AllocateLarge(size);
+  }
+  Lock::Guard guard(heap_lock_);
+  return AllocateUnsampled<true>(size, SizeToClass(size), 0);
+}
+
+
+void Heap::Free(void* p) {
+  if (UNLIKELY(!object_space.Contains(p))) {
+    if (p != nullptr) {
+      LargeLink* link = LinkOf(p);
+      if (link != nullptr) {
+        link->heap->FreeLarge(link);
+      } else {
+        // Not from a heap, so this is an ordinary large object.
+        LargeObject::Free(p);
+      }
+    }
+    return;
+  }
+  const core_id owner = Span::FromObject(p)->owner();
+  if (UNLIKELY(owner != id())) {
+    if (owner.value()->retains_spans()) {
+      // An object of another heap goes straight back to it. A remote free
+      // would be buffered and could outlive the spans of that heap.
+      static_cast<Heap*>(owner.value())->Free(p);
+    } else {
+      // Not from a heap, so this is an ordinary object.
+      ab_scheduler.Free(p);
+    }
+    return;
+  }
+  Lock::Guard guard(heap_lock_);
+  Core::Free(p);
+}
+
+
+Heap::LargeLink* Heap::LinkOf(void* p) {
+  if (LargeObject::PayloadOffset(p) != kLargeOffset) {
+    return nullptr;
+  }
+  return reinterpret_cast<LargeLink*>(p) - 1;
+}
+
+
+void* Heap::AllocateLarge(size_t size) {
+  if (UNLIKELY(size > (SIZE_MAX - sizeof(LargeLink)))) {
+    return nullptr;
+  }
+  LargeLink* link = reinterpret_cast<LargeLink*>(
+      LargeObject::Allocate(size + sizeof(LargeLink)));
+  if (UNLIKELY(link == nullptr)) {
+    return nullptr;
+  }
+  ScallocAssert(LinkOf(link + 1) == link);
+  link->heap = this;
+  Lock::Guard guard(heap_lock_);
+  link->prev = nullptr;
+  link->next = large_objects_;
+  if (large_objects_ != nullptr) {
+    large_objects_->prev = link;
+  }
+  large_objects_ = link;
+  return link + 1;
+}
+
+
+void Heap::FreeLarge(LargeLink* link) {
+  {
+    Lock::Guard guard(heap_lock_);
+    if (link->prev != nullptr) {
+      link->prev->next = link->next;
+    } else {
+      large_objects_ = link->next;
+    }
+    if (link->next != nullptr) {
+      link->next->prev = link->prev;
+    }
+  }
+  LargeObject::Free(link);
+}
+
+}  // namespace scalloc
+
+#endif  // SCALLOC_HEAP_H_
@@ -15,6 +15,9 @@
 #include "core_id.h"
 #include "globals.h"
 #include "log.h"
+#include "numa.h"
+#include "platform/rseq.h"
+#include "utils.h"
 
 namespace scalloc {
 
@@ -92,6 +95,9 @@ class ThreadLocalAllocationBuffer : public TLSBase<Core> {
   always_inline Core& GetAB();
   always_inline void GetMeALAB();
 
+  // The core of the calling thread, or nullptr if it has none.
+  always_inline Core* Current() { return GetTLS(); }
+
  private:
   typedef Stack<128> FreeAllocationBuffers;
 
@@ -100,12 +106,14 @@ class ThreadLocalAllocationBuffer : public TLSBase<Core> {
   always_inline Core* FindFreeAB();
 
   static std::atomic<int_fast32_t> thread_ids_ __attribute__((aligned(128)));
-  static FreeAllocationBuffers free_abs_ __attribute__((aligned(128)));
+  // Cores of terminated threads, per NUMA node of their memory.
+  static FreeAllocationBuffers free_abs_[kMaxNumaNodes]
+      __attribute__((aligned(128)));
 };
 
 
 std::atomic<int_fast32_t> ThreadLocalAllocationBuffer::thread_ids_;
-Stack<128> ThreadLocalAllocationBuffer::free_abs_;
+Stack<128> ThreadLocalAllocationBuffer::free_abs_[kMaxNumaNodes];
 
 
 void ThreadLocalAllocationBuffer::Init() {
@@ -114,7 +122,13 @@ void ThreadLocalAllocationBuffer::Init() {
 
 
 Core* ThreadLocalAllocationBuffer::FindFreeAB() {
-  Core* ab = reinterpret_cast<Core*>(free_abs_.Pop());
+  // Prefer cores that live on our node.
+  const int32_t nodes = numa_topology.nodes();
+  const int32_t node = numa_topology.CurrentNode();
+  Core* ab = nullptr;
+  for (int32_t i = 0; (ab == nullptr) && (i < nodes); i++) {
+    ab = reinterpret_cast<Core*>(free_abs_[(node + i) % nodes].Pop());
+  }
   if (ab == NULL) {
     ab =  new(core_space.Allocate(sizeof(Core))) Core();
   }
@@ -126,7 +140,7 @@ void ThreadLocalAllocationBuffer::ThreadDestructor(void* tlab) {
   LOG(kTrace, "Destroy at %p", tlab);
   reinterpret_cast<Core*>(tlab)->Destroy();
   span_pool.AnnounceLeavingThread();
-  free_abs_.Push(tlab);
+  free_abs_[reinterpret_cast<Core*>(tlab)->node()].Push(tlab);
 }
 
 
@@ -158,20 +172,27 @@ class RoundRobinAllocationBuffer : public TLSBase<GuardedCore> {
 
   always_inline void Init();
   always_inline GuardedCore& GetAB();
+  always_inline void GetMeALAB() {}
 
  private:
+  typedef SpinLock<64> Lock;
+
   static inline void ThreadDestructor(void* lab);
 
-  static GuardedCore allocation_buffers_[kMaxThreads];
+  never_inline GuardedCore* CreateCore(int32_t i);
+
+  // One core per CPU, created on first use.
+  Lock lock_;
+  std::atomic<GuardedCore*> allocation_buffers_[kMaxCpus];
   std::atomic<uint_fast64_t> thread_counter_;
 };
 
 
-GuardedCore RoundRobinAllocationBuffer::allocation_buffers_[kMaxThreads];
-
-
 void RoundRobinAllocationBuffer::Init() {
   TLSBase<scalloc::GuardedCore>::Init(ThreadDestructor);
+  for (int32_t i = 0; i < kMaxCpus; i++) {
+    allocation_buffers_[i].store(nullptr);
+  }
   thread_counter_ = 0;
 }
 
@@ -180,11 +201,28 @@ void RoundRobinAllocationBuffer::ThreadDestructor(void* lab) {
 }
 
 
+GuardedCore* RoundRobinAllocationBuffer::CreateCore(int32_t i) {
+  Lock::Guard guard(lock_);
+  GuardedCore* ab = allocation_buffers_[i].load();
+  if (ab == nullptr) {
+    ab = new(core_space.Allocate(PadSize(sizeof(GuardedCore), 128)))
+        GuardedCore();
+    ab->Init(core_id(ab, i + 1));
+    span_pool.AnnounceNewThread();
+    allocation_buffers_[i].store(ab, std::memory_order_release);
+  }
+  return ab;
+}
+
+
 GuardedCore& RoundRobinAllocationBuffer::GetAB() {
   GuardedCore* ab = GetTLS();
   if (UNLIKELY(ab == NULL)) {
-    int32_t num_cores = CpusOnline();
-    ab = &allocation_buffers_[thread_counter_.fetch_add(1) % num_cores];
+    const int32_t i = thread_counter_.fetch_add(1) % CpusOnline() % kMaxCpus;
+    ab = allocation_buffers_[i].load(std::memory_order_acquire);
+    if (ab == nullptr) {
+      ab = CreateCore(i);
+    }
     SetTLS(ab);
     LOG(kTrace, "RoundRobinAllocationBuffer: tid: %lu", thread_counter_.load());
     ab->AnnounceNewThread();
@@ -194,6 +232,199 @@ GuardedCore& RoundRobinAllocationBuffer::GetAB() {
   return *ab;
 }
 
+
+// Binds cores to CPUs instead of threads, which keeps the number of cores (and
+// their spans) bounded by the number of CPUs, independent of the number of
+// threads. Cores are created lazily by the first thread running on a CPU and
+// are never destroyed. See CpuCore for how threads share a core.
+class PerCpuAllocationBuffer {
+ public:
+  // Globally constructed, hence we use staged construction.
+  always_inline PerCpuAllocationBuffer() {}
+  always_inline ~PerCpuAllocationBuffer() {}
+
+  always_inline void Init();
+  always_inline CpuCore& GetAB();
+  always_inline void GetMeALAB() {}
+
+ private:
+  typedef SpinLock<64> Lock;
+
+  never_inline CpuCore* CreateCore(int32_t cpu);
+
+  Lock lock_;
+  std::atomic<CpuCore*> cores_[kMaxCpus];
+};
+
+
+void PerCpuAllocationBuffer::Init() {
+  for (int32_t i = 0; i < kMaxCpus; i++) {
+    cores_[i].store(nullptr);
+  }
+}
+
+
+CpuCore& PerCpuAllocationBuffer::GetAB() {
+  void* rseq = Rseq::Area();
+  int32_t cpu = (rseq != nullptr) ? Rseq::Cpu(rseq) : -1;
+  if (UNLIKELY((cpu < 0) || (cpu >= kMaxCpus))) {
+    cpu = CurrentCpu() % kMaxCpus;
+  }
+  CpuCore* core = cores_[cpu].load(std::memory_order_acquire);
+  if (UNLIKELY(core == nullptr)) {
+    core = CreateCore(cpu);
+  }
+  return *core;
+}
+
+
+CpuCore* PerCpuAllocationBuffer::CreateCore(int32_t cpu) {
+  Lock::Guard guard(lock_);
+  CpuCore* core = cores_[cpu].load();
+  if (core == nullptr) {
+    core = new(core_space.Allocate(PadSize(sizeof(CpuCore), 128))) CpuCore();
+    core->Init(core_id(core, cpu + 1), cpu);
+    span_pool.AnnounceNewThread();
+    cores_[cpu].store(core, std::memory_order_release);
+  }
+  return core;
+}
+
+
+// Dispatches to the LAB model chosen at startup (see Config). Each model keeps
+// its own fully inlined fast path. Only threads of the TLAB model have a core
+// in their thread-local storage, so the TLAB model is detected without looking
+// at the model at all. The model does not change after initialization, so the
+// remaining branches are predicted perfectly.
+class ABProvider {
+ public:
+  // Globally constructed, hence we use staged construction.
+  always_inline ABProvider() {}
+  always_inline ~ABProvider() {}
+
+  always_inline void Init(int32_t model);
+  always_inline void GetMeALAB();
+  always_inline void* Allocate(size_t size);
+  always_inline void* Allocate(size_t size, int32_t size_class, size_t align);
+  always_inline void Free(void* p);
+  always_inline void Free(void* p, int32_t size_class);
+  always_inline size_t AllocateBatch(size_t size, int32_t size_class,
+                                     void** objs, size_t n);
+  always_inline void FreeBatch(void** objs, size_t n);
+
+  always_inline int32_t model() { return model_; }
+
+ private:
+  int32_t model_;
+  ThreadLocalAllocationBuffer tlab_;
+  RoundRobinAllocationBuffer rr_;
+  PerCpuAllocationBuffer percpu_;
+};
+
+
+void ABProvider::Init(int32_t model) {
+  model_ = model;
+  if (model_ == SCALLOC_LAB_MODEL_TLAB) {
+    tlab_.Init();
+  } else if (model_ == SCALLOC_LAB_MODEL_RR) {
+    rr_.Init();
+  } else {
+    percpu_.Init();
+  }
+}
+
+
+void ABProvider::GetMeALAB() {
+  if (LIKELY(model_ == SCALLOC_LAB_MODEL_TLAB)) {
+    tlab_.GetMeALAB();
+  }
+}
+
+
+void* ABProvider::Allocate(size_t size) {
+  Core* core = tlab_.Current();
+  if (LIKELY(core != nullptr)) {
+    return core->Allocate(size);
+  }
+  if (model_ == SCALLOC_LAB_MODEL_PERCPU) {
+    return percpu_.GetAB().Allocate(size);
+  } else if (model_ == SCALLOC_LAB_MODEL_RR) {
+    return rr_.GetAB().Allocate(size);
+  }
+  return tlab_.GetAB().Allocate(size);
+}
+
+
+void* ABProvider::Allocate(size_t size, int32_t size_class, size_t align) {
+  Core* core = tlab_.Current();
+  if (LIKELY(core != nullptr)) {
+    return core->Allocate(size, size_class, align);
+  }
+  if (model_ == SCALLOC_LAB_MODEL_PERCPU) {
+    return percpu_.GetAB().Allocate(size, size_class, align);
+  } else if (model_ == SCALLOC_LAB_MODEL_RR) {
+    return rr_.GetAB().Allocate(size, size_class, align);
+  }
+  return tlab_.GetAB().Allocate(size, size_class, align);
+}
+
+
+void ABProvider::Free(void* p) {
+  Core* core = tlab_.Current();
+  if (LIKELY(core != nullptr)) {
+    core->Free(p);
+  } else if (model_ == SCALLOC_LAB_MODEL_PERCPU) {
+    percpu_.GetAB().Free(p);
+  } else if (model_ == SCALLOC_LAB_MODEL_RR) {
+    rr_.GetAB().Free(p);
+  } else {
+    tlab_.GetAB().Free(p);
+  }
+}
+
+
+void ABProvider::Free(void* p, int32_t size_class) {
+  Core* core = tlab_.Current();
+  if (LIKELY(core != nullptr)) {
+    core->Free(p, size_class);
+  } else if (model_ == SCALLOC_LAB_MODEL_PERCPU) {
+    percpu_.GetAB().Free(p, size_class);
+  } else if (model_ == SCALLOC_LAB_MODEL_RR) {
+    rr_.GetAB().Free(p, size_class);
+  } else {
+    tlab_.GetAB().Free(p, size_class);
+  }
+}
+
+
+size_t ABProvider::AllocateBatch(size_t size, int32_t size_class, void** objs,
+                                 size_t n) {
+  Core* core = tlab_.Current();
+  if (LIKELY(core != nullptr)) {
+    return core->AllocateBatch(size, size_class, objs, n);
+  }
+  if (model_ == SCALLOC_LAB_MODEL_PERCPU) {
+    return percpu_.GetAB().AllocateBatch(size, size_class, objs, n);
+  } else if (model_ == SCALLOC_LAB_MODEL_RR) {
+    return rr_.GetAB().AllocateBatch(size, size_class, objs, n);
+  }
+  return tlab_.GetAB().AllocateBatch(size, size_class, objs, n);
+}
+
+
+void ABProvider::FreeBatch(void** objs, size_t n) {
+  Core* core = tlab_.Current();
+  if (LIKELY(core != nullptr)) {
+    core->FreeBatch(objs, n);
+  } else if (model_ == SCALLOC_LAB_MODEL_PERCPU) {
+    percpu_.GetAB().FreeBatch(objs, n);
+  } else if (model_ == SCALLOC_LAB_MODEL_RR) {
+    rr_.GetAB().FreeBatch(objs, n);
+  } else {
+    tlab_.GetAB().FreeBatch(objs, n);
+  }
+}
+
 }  // namespace scalloc
 
 #endif  // SCALLOC_LAB_H_
@@ -6,22 +6,54 @@
 #define SCALLOC_LARGE_OBJECTS_H_
 
 #include <stdint.h>
+#include <sys/mman.h>
 
+#include <atomic>
 #include <new>
 
 #include "globals.h"
+#include "large_object_cache.h"
+#include "platform/assert.h"
+#include "profiler.h"
 #include "utils.h"
 
 namespace scalloc {
 
 class LargeObject {
  public:
+  // Returns nullptr if the size overflows or the mapping fails.
   static always_inline void* Allocate(size_t size);
+  // Allocates a large object whose payload is aligned to align, a power of two
+  // larger than kMinAlignment. Returns nullptr if the mapping fails.
+  static always_inline void* AllocateAligned(size_t size, size_t align);
   static always_inline void Free(void* p);
+  // Resizes the mapping of a large object in place (or by moving it within
+  // the page tables) and returns the new mutator pointer, or nullptr if the
+  // caller has to fall back to copying.
+  static always_inline void* Reallocate(void* p, size_t size);
   static always_inline size_t PayloadSize(void* p);
+  // Offset of a payload from the start of its mapping, i.e., the size of the
+  // header for unaligned objects.
+  static always_inline size_t PayloadOffset(void* p);
+  // Smallest payload size of a large object allocated for the given size and
+  // alignment (0 for unaligned objects), or 0 on overflow. Mappings that are
+  // reused from the large object cache may be larger.
+  static always_inline size_t PayloadSize(size_t size, size_t align);
+
+  // Large objects tracked by the heap profiler carry a different magic.
+  static always_inline void MarkSampled(void* p);
+  static always_inline bool IsSampled(void* p);
+
+  // Number and mapped bytes (including headers) of live large objects.
+  static always_inline uint64_t NrObjects() { return nr_objects_.load(); }
+  static always_inline uint64_t MappedBytes() { return mapped_bytes_.load(); }
 
  private:
   static const uint64_t kMagic = 0xAAAAAAAAAAAAAAAA;
+  static const uint64_t kSampledMagic = 0xAAAAAAAAAAAAAAAB;
+
+  static std::atomic<uint64_t> nr_objects_;
+  static std::atomic<uint64_t> mapped_bytes_;
 
   static always_inline LargeObject* FromMutatorPtr(void* p);
 
@@ -29,7 +61,6 @@ class LargeObject {
   always_inline void* ObjectStart();
   always_inline bool Validate();
 
-  always_inline size_t payload_size() { return actual_size_ - sizeof(*this); }
   always_inline size_t actual_size() { return actual_size_; }
 
   size_t actual_size_;
@@ -37,15 +68,21 @@ class LargeObject {
 };
 
 
+std::atomic<uint64_t> LargeObject::nr_objects_;
+std::atomic<uint64_t> LargeObject::mapped_bytes_;
+
+
 bool LargeObject::Validate() {
-  return magic_ == kMagic;
+  return (magic_ == kMagic) || (magic_ == kSampledMagic);
 }
 
 
 LargeObject* LargeObject::FromMutatorPtr(void* p) {
-  // LargeObject is always allocated using mmap, hence it is page aligned.
+  // LargeObject is always allocated using mmap, hence it is page aligned. The
+  // payload starts within the first page after the header, or right after it
+  // for page-aligned payloads.
   LargeObject* obj = reinterpret_cast<LargeObject*>(
-      reinterpret_cast<intptr_t>(p) & kPageNrMask);
+      (reinterpret_cast<intptr_t>(p) - 1) & kPageNrMask);
   if (!obj->Validate()) {
     Fatal("invalid large object: %p", p);
   }
@@ -54,8 +91,20 @@ LargeObject* LargeObject::FromMutatorPtr(void* p) {
 
 
 void* LargeObject::Allocate(size_t size) {
-  const size_t actual_size = PadSize(size + sizeof(LargeObject), kPageSize);
-  LargeObject* obj = new(SystemMmapFail(actual_size)) LargeObject(actual_size);
+  size_t actual_size = PadSize(size + sizeof(LargeObject), kPageSize);
+  if (actual_size < size) {
+    return nullptr;
+  }
+  void* mem = nullptr;
+#ifdef SCALLOC_LARGE_OBJECT_CACHE
+  mem = large_object_cache.Get(actual_size, &actual_size);
+#endif  // SCALLOC_LARGE_OBJECT_CACHE
+  if ((mem == nullptr) && ((mem = SystemMmap(actual_size)) == nullptr)) {
+    return nullptr;
+  }
+  LargeObject* obj = new(mem) LargeObject(actual_size);
+  nr_objects_.fetch_add(1, std::memory_order_relaxed);
+  mapped_bytes_.fetch_add(actual_size, std::memory_order_relaxed);
 #ifdef DEBUG
   // Force the check by going through the mutator pointer.
   obj = LargeObject::FromMutatorPtr(obj->ObjectStart());
@@ -64,17 +113,144 @@ void* LargeObject::Allocate(size_t size) {
 }
 
 
+void* LargeObject::AllocateAligned(size_t size, size_t align) {
+  // Payloads aligned to less than a page start within the first page. Larger
+  // alignments get a page of their own for the header.
+  const size_t offset = (align < kPageSize) ? align : kPageSize;
+  const size_t slack = (align < kPageSize) ? 0 : (align - kPageSize);
+  const size_t actual_size = PadSize(size + offset, kPageSize);
+  if ((actual_size < size) || ((actual_size + slack) < actual_size)) {
+    return nullptr;
+  }
+  size_t mapped_size = actual_size + slack;
+  void* mem = nullptr;
+#ifdef SCALLOC_LARGE_OBJECT_CACHE
+  mem = large_object_cache.Get(mapped_size, &mapped_size);
+#endif  // SCALLOC_LARGE_OBJECT_CACHE
+  if ((mem == nullptr) && ((mem = SystemMmap(mapped_size)) == nullptr)) {
+    return nullptr;
+  }
+  // Return the slack in front of the header and behind the payload.
+  const uintptr_t start = reinterpret_cast<uintptr_t>(mem);
+  const uintptr_t payload_start = PadSize(start + offset, align);
+  const uintptr_t header = payload_start - offset;
+  if ((header > start) && (munmap(mem, header - start) != 0)) {
+    Fatal("munmap failed");
+  }
+  if (((start + mapped_size) > (header + actual_size)) &&
+      (munmap(reinterpret_cast<void*>(header + actual_size),
+              start + mapped_size - (header + actual_size)) != 0)) {
+    Fatal("munmap failed");
+  }
+  LargeObject* obj = new(reinterpret_cast<void*>(header))
+      LargeObject(actual_size);
+  nr_objects_.fetch_add(1, std::memory_order_relaxed);
+  mapped_bytes_.fetch_add(actual_size, std::memory_order_relaxed);
+  ScallocAssert(FromMutatorPtr(reinterpret_cast<void*>(payload_start)) == obj);
+  return reinterpret_cast<void*>(payload_start);
+}
+
+
 void LargeObject::Free(void* p) {
   LargeObject* obj = FromMutatorPtr(p);
+  if (UNLIKELY(obj->magic_ == kSampledMagic)) {
+    heap_profiler.RecordFree(p);
+  }
+  nr_objects_.fetch_sub(1, std::memory_order_relaxed);
+  mapped_bytes_.fetch_sub(obj->actual_size(), std::memory_order_relaxed);
+#ifdef SCALLOC_LARGE_OBJECT_CACHE
+  if (large_object_cache.Put(obj, obj->actual_size())) {
+    return;
+  }
+#endif  // SCALLOC_LARGE_OBJECT_CACHE
   if (munmap(obj, obj->actual_size()) != 0) {
     Fatal("munmap failed");
   }
 }
 
 
+void* LargeObject::Reallocate(void* p, size_t size) {
+  LargeObject* obj = FromMutatorPtr(p);
+  // Aligned payloads start further into the mapping, see AllocateAligned().
+  const size_t offset =
+      reinterpret_cast<uintptr_t>(p) - reinterpret_cast<uintptr_t>(obj);
+  const size_t old_size = obj->actual_size();
+  const size_t new_size = PadSize(size + offset, kPageSize);
+  if (UNLIKELY(new_size < size)) {
+    return nullptr;
+  }
+  if (new_size == old_size) {
+    return p;
+  }
+  if (new_size < old_size) {
+    // Return the tail pages.
+    if (munmap(reinterpret_cast<void*>(
+                   reinterpret_cast<uintptr_t>(obj) + new_size),
+               old_size - new_size) != 0) {
+      Fatal("munmap failed");
+    }
+    obj->actual_size_ = new_size;
+    mapped_bytes_.fetch_sub(old_size - new_size, std::memory_order_relaxed);
+    return p;
+  }
+#if defined(__linux__)
+  // Let the kernel move the page table entries instead of copying the payload.
+  void* new_obj = mremap(obj, old_size, new_size, MREMAP_MAYMOVE);
+  if (new_obj == MAP_FAILED) {
+    return nullptr;
+  }
+  obj = reinterpret_cast<LargeObject*>(new_obj);
+  obj->actual_size_ = new_size;
+  mapped_bytes_.fetch_add(new_size - old_size, std::memory_order_relaxed);
+  void* moved = reinterpret_cast<void*>(
+      reinterpret_cast<uintptr_t>(new_obj) + offset);
+  if (UNLIKELY((obj->magic_ == kSampledMagic) && (moved != p))) {
+    heap_profiler.RecordMove(p, moved);
+  }
+  return moved;
+#else
+  return nullptr;
+#endif  // __linux__
+}
+
+
+void LargeObject::MarkSampled(void* p) {
+  FromMutatorPtr(p)->magic_ = kSampledMagic;
+}
+
+
+bool LargeObject::IsSampled(void* p) {
+  return FromMutatorPtr(p)->magic_ == kSampledMagic;
+}
+
+
+size_t LargeObject::PayloadOffset(void* p) {
+  return reinterpret_cast<uintptr_t>(p) -
+         reinterpret_cast<uintptr_t>(FromMutatorPtr(p));
+}
+
+
 size_t LargeObject::PayloadSize(void* p) {
   LargeObject* obj = FromMutatorPtr(p);
-  return obj->payload_size();
+  return obj->actual_size() -
+         (reinterpret_cast<uintptr_t>(p) - reinterpret_cast<uintptr_t>(obj));
+}
+
+
+size_t LargeObject::PayloadSize(size_t size, size_t align) {
+  // Mirrors the header placement and overflow checks of Allocate() and
+  // AllocateAligned().
+  size_t offset = sizeof(LargeObject);
+  size_t slack = 0;
+  if (align > kMinAlignment) {
+    offset = (align < kPageSize) ? align : kPageSize;
+    slack = (align < kPageSize) ? 0 : (align - kPageSize);
+  }
+  const size_t actual_size = PadSize(size + offset, kPageSize);
+  if ((actual_size < size) || ((actual_size + slack) < actual_size)) {
+    return 0;
+  }
+  return actual_size - offset;
 }
 
 
@@ -0,0 +1,286 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+#ifndef SCALLOC_LARGE_OBJECT_CACHE_H_
+#define SCALLOC_LARGE_OBJECT_CACHE_H_
+
+#include <stdint.h>
+#include <sys/mman.h>
+
+#include <atomic>
+
+#include "config.h"
+#include "globals.h"
+#include "lock.h"
+#include "log.h"
+#include "utils.h"
+
+namespace scalloc {
+
+// A bounded cache of mappings of freed large objects, which saves the
+// mmap/munmap round trip through the kernel for objects that are allocated and
+// freed over and over again.
+//
+// The cache is sharded by CPU. Each shard keeps a few mappings per size bucket
+// (power of two number of pages). A request is served from a cached mapping
+// that is at most 1/kMaxWasteFraction larger than needed. Mappings that have
+// not been reused for kDecayMs are returned to the OS on the next operation
+// on their shard, or by the background purger (see BackgroundPurger), as are
+// the oldest mappings once a shard goes over its byte limit. Shards share the
+// configured limit (see Config) evenly.
+class LargeObjectCache {
+ public:
+  // Mappings above this size always go back to the OS.
+  static const size_t kMaxCachedSize = 32 * kMega;
+  static const uint64_t kDecayMs = 1000;
+
+  // Globally constructed, hence we use staged construction.
+  always_inline LargeObjectCache() {}
+  always_inline ~LargeObjectCache() {}
+
+  // Returns a mapping of at least size bytes (and its actual size in
+  // actual_size) or nullptr.
+  always_inline void* Get(size_t size, size_t* actual_size);
+
+  // Takes over the mapping [p, p + size). Returns false if the mapping should
+  // be unmapped by the caller.
+  always_inline bool Put(void* p, size_t size);
+
+  always_inline uint64_t CachedBytes() {
+    return cached_bytes_.load(std::memory_order_relaxed);
+  }
+
+  // Returns mappings that are decayed or over the limit to the OS, or all
+  // mappings if all is set. Returns the number of unmapped bytes.
+  inline uint64_t Trim(bool all);
+
+ private:
+  static const int32_t kShards = 8;
+  static const int32_t kMinBucketShift = 8;  // 1MiB in pages
+  static const int32_t kBuckets = 8;
+  static const int32_t kEntriesPerBucket = 8;
+  static const size_t kMaxWasteFraction = 4;
+
+  struct Entry {
+    void* p;
+    size_t size;
+    uint64_t timestamp;
+  };
+
+  struct Shard {
+    typedef SpinLock<0> Lock;
+
+    Lock lock;
+    // Written under the lock, but also read without it to skip empty shards.
+    std::atomic<size_t> bytes;
+    int32_t len[kBuckets];
+    Entry entries[kBuckets][kEntriesPerBucket];
+    UNUSED uint8_t pad[64];
+  };
+
+  static always_inline int32_t BucketFor(size_t size);
+  static always_inline size_t ShardLimit() {
+    return config.large_object_cache_bytes() / kShards;
+  }
+  always_inline Shard* ShardFor(int32_t i);
+
+  // Removes entry j of bucket b. Requires the shard lock.
+  always_inline Entry Remove(Shard* shard, int32_t b, int32_t j);
+
+  // Collects (at most max) victims that are decayed or exceed the shard limit
+  // when extra bytes are added. Requires the shard lock, which must already be
+  // held when reading now, so that no entry is younger than now.
+  always_inline int32_t Evict(Shard* shard, size_t extra, uint64_t now,
+                              Entry* victims, int32_t max);
+
+  static always_inline uint64_t Unmap(Entry* victims, int32_t len);
+
+  Shard shards_[kShards];
+  std::atomic<uint64_t> cached_bytes_;
+};
+
+
+int32_t LargeObjectCache::BucketFor(size_t size) {
+  int32_t b = Log2(size / kPageSize) - kMinBucketShift;
+  if (b < 0) {
+    b = 0;
+  }
+  if (b >= kBuckets) {
+    b = kBuckets - 1;
+  }
+  return b;
+}
+
+
+LargeObjectCache::Shard* LargeObjectCache::ShardFor(int32_t i) {
+  return &shards_[i % kShards];
+}
+
+
+LargeObjectCache::Entry LargeObjectCache::Remove(
+    Shard* shard, int32_t b, int32_t j) {
+  Entry e = shard->entries[b][j];
+  shard->entries[b][j] = shard->entries[b][--shard->len[b]];
+  shard->bytes.fetch_sub(e.size, std::memory_order_relaxed);
+  cached_bytes_.fetch_sub(e.size, std::memory_order_relaxed);
+  return e;
+}
+
+
+int32_t LargeObjectCache::Evict(Shard* shard, size_t extra, uint64_t now,
+                                Entry* victims, int32_t max) {
+  int32_t n = 0;
+  for (int32_t b = 0; b < kBuckets; b++) {
+    for (int32_t j = shard->len[b] - 1; (j >= 0) && (n < max); j--) {
+      if ((now - shard->entries[b][j].timestamp) >= kDecayMs) {
+        victims[n++] = Remove(shard, b, j);
+      }
+    }
+  }
+  const size_t limit = ShardLimit();
+  int32_t oldest_b;
+  int32_t oldest_j;
+  while (((shard->bytes.load(std::memory_order_relaxed) + extra) > limit) &&
+         (n < max)) {
+    oldest_b = -1;
+    oldest_j = -1;
+    for (int32_t b = 0; b < kBuckets; b++) {
+      for (int32_t j = 0; j < shard->len[b]; j++) {
+        if ((oldest_b == -1) ||
+            (shard->entries[b][j].timestamp <
+             shard->entries[oldest_b][oldest_j].timestamp)) {
+          oldest_b = b;
+          oldest_j = j;
+        }
+      }
+    }
+    if (oldest_b == -1) {
+      break;
+    }
+    victims[n++] = Remove(shard, oldest_b, oldest_j);
+  }
+  return n;
+}
+
+
+uint64_t LargeObjectCache::Unmap(Entry* victims, int32_t len) {
+  uint64_t bytes = 0;
+  for (int32_t i = 0; i < len; i++) {
+    if (munmap(victims[i].p, victims[i].size) != 0) {
+      Fatal("munmap failed");
+    }
+    bytes += victims[i].size;
+  }
+  return bytes;
+}
+
+
+void* LargeObjectCache::Get(size_t size, size_t* actual_size) {
+  if (size > kMaxCachedSize) {
+    return nullptr;
+  }
+  const int32_t b = BucketFor(size);
+  const size_t max_size = size + size / kMaxWasteFraction;
+  const int32_t start = CurrentCpu();
+  Entry victims[kBuckets * kEntriesPerBucket];
+  int32_t nr_victims = 0;
+  void* p = nullptr;
+  Shard* shard;
+  for (int32_t i = 0; (i < kShards) && (p == nullptr); i++) {
+    shard = ShardFor(start + i);
+    // Only wait for our own shard.
+    if (i == 0) {
+      shard->lock.Lock();
+    } else if ((shard->bytes.load(std::memory_order_relaxed) == 0) ||
+               !shard->lock.TryLock()) {
+      continue;
+    }
+    // A fitting mapping might have crossed into the next bucket.
+    for (int32_t k = b; (k <= (b + 1)) && (k < kBuckets) && (p == nullptr);
+         k++) {
+      for (int32_t j = 0; j < shard->len[k]; j++) {
+        if ((shard->entries[k][j].size >= size) &&
+            (shard->entries[k][j].size <= max_size)) {
+          Entry e = Remove(shard, k, j);
+          p = e.p;
+          *actual_size = e.size;
+          break;
+        }
+      }
+    }
+    if (i == 0) {
+      nr_victims = Evict(
+          shard, 0, NowMs(), victims, kBuckets * kEntriesPerBucket);
+    }
+    shard->lock.Unlock();
+  }
+  Unmap(victims, nr_victims);
+  return p;
+}
+
+
+bool LargeObjectCache::Put(void* p, size_t size) {
+  if ((size > kMaxCachedSize) || (size > ShardLimit())) {
+    return false;
+  }
+  const int32_t b = BucketFor(size);
+  Entry victims[kBuckets * kEntriesPerBucket + 1];
+  int32_t nr_victims;
+  Shard* shard = ShardFor(CurrentCpu());
+  {
+    Shard::Lock::Guard guard(shard->lock);
+    const uint64_t now = NowMs();
+    nr_victims = Evict(shard, size, now, victims, kBuckets * kEntriesPerBucket);
+    if (shard->len[b] == kEntriesPerBucket) {
+      // Replace the oldest mapping in this bucket.
+      int32_t oldest = 0;
+      for (int32_t j = 1; j < kEntriesPerBucket; j++) {
+        if (shard->entries[b][j].timestamp <
+            shard->entries[b][oldest].timestamp) {
+          oldest = j;
+        }
+      }
+      victims[nr_victims++] = Remove(shard, b, oldest);
+    }
+    Entry* e = &shard->entries[b][shard->len[b]++];
+    e->p = p;
+    e->size = size;
+    e->timestamp = now;
+    shard->bytes.fetch_add(size, std::memory_order_relaxed);
+    cached_bytes_.fetch_add(size, std::memory_order_relaxed);
+  }
+  Unmap(victims, nr_victims);
+  return true;
+}
+
+
+uint64_t LargeObjectCache::Trim(bool all) {
+  Entry victims[kBuckets * kEntriesPerBucket];
+  int32_t nr_victims;
+  uint64_t bytes = 0;
+  Shard* shard;
+  for (int32_t i = 0; i < kShards; i++) {
+    shard = ShardFor(i);
+    {
+      Shard::Lock::Guard guard(shard->lock);
+      if (all) {
+        nr_victims = 0;
+        for (int32_t b = 0; b < kBuckets; b++) {
+          while (shard->len[b] > 0) {
+            victims[nr_victims++] = Remove(shard, b, shard->len[b] - 1);
+          }
+        }
+      } else {
+        nr_victims = Evict(
+            shard, 0, NowMs(), victims, kBuckets * kEntriesPerBucket);
+      }
+    }
+    bytes += Unmap(victims, nr_victims);
+  }
+  return bytes;
+}
+
+}  // namespace scalloc
+
+#endif  // SCALLOC_LARGE_OBJECT_CACHE_H_
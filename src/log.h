@@ -27,6 +27,14 @@ enum Severity {
 const int kVerbosity = SCALLOC_LOG_LEVEL;
 const int kLogLen = 512;
 
+namespace scalloc {
+
+// The verbosity chosen at runtime (see Config). Messages above kVerbosity have
+// been compiled out and stay disabled.
+extern int log_verbosity;
+
+}  // namespace scalloc
+
 
 // __FILE__ expands to the full path. Strip basename for __FILENAME__.
 #define __FILENAME__                                                           \
@@ -86,7 +94,8 @@ inline void LogPrintf(
 }
 
 
-#define LOG_ON(severity) (kVerbosity >= severity)
+#define LOG_ON(severity)                                                       \
+    ((kVerbosity >= severity) && (scalloc::log_verbosity >= severity))
 
 
 #define LOG(severity, format, ...) do {                                        \
@@ -0,0 +1,181 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+#ifndef SCALLOC_NUMA_H_
+#define SCALLOC_NUMA_H_
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif  // __linux__
+
+#include "globals.h"
+#include "log.h"
+#include "utils.h"
+
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif  // MPOL_PREFERRED
+
+namespace scalloc {
+
+// Maps CPUs to NUMA nodes. Nodes are numbered densely from 0, independent of
+// the ids the kernel uses.
+//
+// The topology is read from /sys/devices/system/node. Setting
+// SCALLOC_NUMA_NODES=<n> fakes a topology of n nodes with CPUs assigned in
+// contiguous blocks, which allows exercising the node-aware paths on
+// single-node machines. Fake nodes are never bound to physical memory.
+class NumaTopology {
+ public:
+  // Globally constructed, hence we use staged construction.
+  always_inline NumaTopology() {}
+  always_inline ~NumaTopology() {}
+
+  inline void Init();
+
+  always_inline int32_t nodes() { return nodes_; }
+  always_inline bool fake() { return fake_; }
+
+  always_inline int32_t NodeOf(int32_t cpu) {
+    return ((cpu >= 0) && (cpu < kMaxCpus)) ? cpu_to_node_[cpu] : 0;
+  }
+
+  // The node of the CPU the calling thread currently runs on.
+  always_inline int32_t CurrentNode() {
+    if (nodes_ == 1) {
+      return 0;
+    }
+    return NodeOf(CurrentCpu());
+  }
+
+  // Sets a preferred-node policy for [p, p + len). The kernel falls back to
+  // other nodes when the preferred node runs out of memory.
+  inline void Bind(uintptr_t p, size_t len, int32_t node);
+
+ private:
+  static inline bool ReadFile(const char* path, char* buffer, size_t len);
+  inline bool ParseCpuList(const char* list, int32_t node);
+  inline void ReadTopology();
+  inline void FakeTopology(int32_t nodes);
+
+  int32_t nodes_;
+  bool fake_;
+  int32_t node_ids_[kMaxNumaNodes];
+  int8_t cpu_to_node_[kMaxCpus];
+};
+
+
+void NumaTopology::Init() {
+  nodes_ = 1;
+  fake_ = false;
+  node_ids_[0] = 0;
+  memset(cpu_to_node_, 0, sizeof(cpu_to_node_));
+#ifdef SCALLOC_NUMA
+  const char* value = getenv("SCALLOC_NUMA_NODES");
+  if (value != NULL) {
+    FakeTopology(atoi(value));
+  } else {
+    ReadTopology();
+  }
+#endif  // SCALLOC_NUMA
+  LOG(kTrace, "numa nodes: %d (fake: %d)", nodes_, fake_);
+}
+
+
+bool NumaTopology::ReadFile(const char* path, char* buffer, size_t len) {
+  const int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    return false;
+  }
+  const ssize_t n = read(fd, buffer, len - 1);
+  close(fd);
+  if (n <= 0) {
+    return false;
+  }
+  buffer[n] = '\0';
+  return true;
+}
+
+
+// Parses a cpulist, e.g., "0-7,16-23".
+bool NumaTopology::ParseCpuList(const char* list, int32_t node) {
+  const char* c = list;
+  int64_t from;
+  int64_t to;
+  while ((*c >= '0') && (*c <= '9')) {
+    from = strtol(c, const_cast<char**>(&c), 10);
+    to = from;
+    if (*c == '-') {
+      to = strtol(c + 1, const_cast<char**>(&c), 10);
+    }
+    for (int64_t cpu = from; (cpu <= to) && (cpu < kMaxCpus); cpu++) {
+      cpu_to_node_[cpu] = static_cast<int8_t>(node);
+    }
+    if (*c == ',') {
+      c++;
+    }
+  }
+  return (*c == '\n') || (*c == '\0');
+}
+
+
+void NumaTopology::ReadTopology() {
+  char path[64];
+  char buffer[4096];
+  int32_t nodes = 0;
+  for (int32_t id = 0; id < kMaxNumaNodes; id++) {
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", id);
+    if (!ReadFile(path, buffer, sizeof(buffer))) {
+      continue;
+    }
+    if (!ParseCpuList(buffer, nodes)) {
+      LOG(kWarning, "cannot parse cpulist of node %d, disabling numa", id);
+      memset(cpu_to_node_, 0, sizeof(cpu_to_node_));
+      return;
+    }
+    node_ids_[nodes++] = id;
+  }
+  if (nodes > 1) {
+    nodes_ = nodes;
+  }
+}
+
+
+void NumaTopology::FakeTopology(int32_t nodes) {
+  if ((nodes <= 1) || (nodes > kMaxNumaNodes)) {
+    return;
+  }
+  const int32_t cpus = CpusOnline();
+  for (int32_t cpu = 0; cpu < kMaxCpus; cpu++) {
+    cpu_to_node_[cpu] = static_cast<int8_t>((cpu % cpus) * nodes / cpus);
+  }
+  for (int32_t i = 0; i < nodes; i++) {
+    node_ids_[i] = i;
+  }
+  nodes_ = nodes;
+  fake_ = true;
+}
+
+
+void NumaTopology::Bind(uintptr_t p, size_t len, int32_t node) {
+#if defined(__linux__) && defined(SYS_mbind)
+  if (fake_ || (nodes_ == 1)) {
+    return;
+  }
+  unsigned long mask = 1UL << node_ids_[node];  // NOLINT
+  if (syscall(SYS_mbind, p, len, MPOL_PREFERRED, &mask,
+              sizeof(mask) * 8 + 1, 0) != 0) {
+    LOG(kWarning, "mbind of %p to node %d failed", p, node_ids_[node]);
+  }
+#endif  // __linux__ && SYS_mbind
+}
+
+}  // namespace scalloc
+
+#endif  // SCALLOC_NUMA_H_
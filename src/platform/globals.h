@@ -8,12 +8,17 @@
 #define UNLIKELY(x)   __builtin_expect((x), 0)
 #define LIKELY(x)     __builtin_expect((x), 1)
 
+// Prefetches the cache line at x for writing. Never faults.
+#define PREFETCH_W(x) __builtin_prefetch((x), 1, 3)
+
 #ifdef DEBUG
 #define always_inline inline
 #else
 #define always_inline inline __attribute__((always_inline))
 #endif  // DEBUG
 
+#define never_inline inline __attribute__((noinline))
+
 #define CACHELINE_SIZE 64
 #define cache_aligned __attribute__((aligned(CACHELINE_SIZE)))
 
@@ -0,0 +1,65 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+#ifndef SCALLOC_PLATFORM_MEMBARRIER_H_
+#define SCALLOC_PLATFORM_MEMBARRIER_H_
+
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif  // __linux__
+
+#include "platform/globals.h"
+
+// Asymmetric fences through membarrier(2) (Linux >= 4.14).
+//
+// A heavy fence issued by one thread acts as a full memory barrier on all
+// other running threads of the process. Threads on a fast path thus only need
+// a light fence (a compiler barrier) to pair with it, as long as the heavy
+// side is rare.
+
+#if defined(__linux__) && defined(SYS_membarrier)
+#define SCALLOC_HAVE_MEMBARRIER 1
+#endif  // __linux__ && SYS_membarrier
+
+#ifdef SCALLOC_HAVE_MEMBARRIER
+#define SCALLOC_MEMBARRIER_CMD_QUERY 0
+#define SCALLOC_MEMBARRIER_CMD_PRIVATE_EXPEDITED (1 << 3)
+#define SCALLOC_MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED (1 << 4)
+#endif  // SCALLOC_HAVE_MEMBARRIER
+
+namespace scalloc {
+
+struct Membarrier {
+  // Registers the process for heavy fences. Returns false if they are not
+  // supported, in which case HeavyFence() must not be relied on.
+  static inline bool Register() {
+#ifdef SCALLOC_HAVE_MEMBARRIER
+    const long cmds = syscall(  // NOLINT
+        SYS_membarrier, SCALLOC_MEMBARRIER_CMD_QUERY, 0);
+    if ((cmds < 0) ||
+        ((cmds & SCALLOC_MEMBARRIER_CMD_PRIVATE_EXPEDITED) == 0)) {
+      return false;
+    }
+    return syscall(SYS_membarrier,
+                   SCALLOC_MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0) == 0;
+#else
+    return false;
+#endif  // SCALLOC_HAVE_MEMBARRIER
+  }
+
+  static always_inline void LightFence() {
+    __asm__ __volatile__("" : : : "memory");
+  }
+
+  static inline void HeavyFence() {
+#ifdef SCALLOC_HAVE_MEMBARRIER
+    syscall(SYS_membarrier, SCALLOC_MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0);
+#endif  // SCALLOC_HAVE_MEMBARRIER
+  }
+};
+
+}  // namespace scalloc
+
+#endif  // SCALLOC_PLATFORM_MEMBARRIER_H_
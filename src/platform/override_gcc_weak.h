@@ -20,6 +20,9 @@
 extern "C" {
   void* malloc(size_t size) __THROW                 ALIAS(scalloc_malloc);
   void free(void* p) __THROW                        ALIAS(scalloc_free);
+  void free_sized(void* p, size_t size) __THROW     ALIAS(scalloc_free_sized);
+  void free_aligned_sized(void* p, size_t alignment, size_t size) __THROW
+      ALIAS(scalloc_free_aligned_sized);
   void cfree(void* p) __THROW                       ALIAS(scalloc_free);
   void* calloc(size_t nmemb, size_t size) __THROW   ALIAS(scalloc_calloc);
   void* realloc(void* ptr, size_t size) __THROW     ALIAS(scalloc_realloc);
@@ -31,9 +34,21 @@ extern "C" {
       ALIAS(scalloc_posix_memalign);
   void* valloc(size_t __size) __THROW               ALIAS(scalloc_valloc);
   void* pvalloc(size_t __size) __THROW              ALIAS(scalloc_pvalloc);
+  size_t malloc_usable_size(void* p) __THROW
+      ALIAS(scalloc_malloc_usable_size);
+  size_t nallocx(size_t size, int flags) __THROW    ALIAS(scalloc_nallocx);
   void malloc_stats(void) __THROW
       ALIAS(scalloc_malloc_stats);
   int mallopt(int cmd, int value) __THROW           ALIAS(scalloc_mallopt);
+  int malloc_trim(size_t pad) __THROW              ALIAS(scalloc_malloc_trim);
+  int mallctl(const char* name, void* oldp, size_t* oldlenp, void* newp,
+              size_t newlen) __THROW                ALIAS(scalloc_mallctl);
+#if defined(__GLIBC__)
+  struct mallinfo mallinfo(void) __THROW            ALIAS(scalloc_mallinfo);
+#if __GLIBC_PREREQ(2, 33)
+  struct mallinfo2 mallinfo2(void) __THROW          ALIAS(scalloc_mallinfo2);
+#endif  // __GLIBC_PREREQ(2, 33)
+#endif  // __GLIBC__
 }
 
 #undef ALIAS
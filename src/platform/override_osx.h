@@ -31,7 +31,8 @@ kern_return_t mi_enumerator(task_t task,
 
 
 size_t mi_good_size(malloc_zone_t* zone, size_t size) {
-  return size;
+  const size_t good_size = scalloc::nallocx(size, 0);
+  return (good_size != 0) ? good_size : size;
 }
 
 
@@ -85,7 +86,7 @@ size_t mz_size(malloc_zone_t* zone, const void* p) {
   LOG(kTrace, "mz_size for ptr: %p", p);
   Span* s;
   if (LIKELY(object_space.Contains(p) && (s = Span::FromObject(p)))) {
-    return ClassToSize[s->size_class()];
+    return ClassInfo[s->size_class()].size;
   }
   // TODO: large objects.
   return 0;
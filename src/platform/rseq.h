@@ -0,0 +1,156 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+#ifndef SCALLOC_PLATFORM_RSEQ_H_
+#define SCALLOC_PLATFORM_RSEQ_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "platform/globals.h"
+
+// Restartable sequences (Linux >= 4.18) on x86-64.
+//
+// We do not register an rseq area ourselves (there can only be one per
+// thread) but use the one glibc (>= 2.35) registers for every thread. Without
+// it, all operations below fail and callers have to take their slow paths.
+
+#if defined(__linux__) && defined(__x86_64__)
+#define SCALLOC_HAVE_RSEQ 1
+#endif  // __linux__ && __x86_64__
+
+#ifdef SCALLOC_HAVE_RSEQ
+
+extern "C" {
+extern const ptrdiff_t __rseq_offset __attribute__((weak));
+extern const unsigned int __rseq_size __attribute__((weak));
+}
+
+// The signature glibc registers with. The kernel checks that the 4 bytes in
+// front of an abort handler match it.
+#define SCALLOC_RSEQ_SIG 0x53053053
+
+// Emits the critical section descriptor (struct rseq_cs) for a sequence
+// starting at label 1, committing with the instruction before label 2, and
+// aborting to label 4, and makes it the current one. Offsets into
+// struct rseq: cpu_id at 4, rseq_cs at 8.
+#define SCALLOC_RSEQ_START(rseq_operand)                                       \
+  ".pushsection __rseq_cs, \"aw\"\n\t"                                         \
+  ".balign 32\n\t"                                                             \
+  "3:\n\t"                                                                     \
+  ".long 0x0, 0x0\n\t"                                                         \
+  ".quad 1f, (2f - 1f), 4f\n\t"                                                \
+  ".popsection\n\t"                                                            \
+  "leaq 3b(%%rip), %%rax\n\t"                                                  \
+  "movq %%rax, 8(%" rseq_operand ")\n\t"
+
+#define SCALLOC_RSEQ_ABORT                                                     \
+  ".pushsection __rseq_failure, \"ax\"\n\t"                                    \
+  ".byte 0x0f, 0xb9, 0x3d\n\t"                                                 \
+  ".long 0x53053053\n\t"                                                       \
+  "4:\n\t"                                                                     \
+  "jmp 5f\n\t"                                                                 \
+  ".popsection\n\t"
+
+#endif  // SCALLOC_HAVE_RSEQ
+
+namespace scalloc {
+
+struct Rseq {
+  // Returns the area of the calling thread, or nullptr if rseq is not
+  // available.
+  static always_inline void* Area() {
+#ifdef SCALLOC_HAVE_RSEQ
+    if ((&__rseq_size == nullptr) || (__rseq_size == 0)) {
+      return nullptr;
+    }
+    uintptr_t tp;
+    __asm__("movq %%fs:0, %0" : "=r"(tp));
+    return reinterpret_cast<void*>(tp + __rseq_offset);
+#else
+    return nullptr;
+#endif  // SCALLOC_HAVE_RSEQ
+  }
+
+  // Returns the CPU the calling thread runs on, or -1 if the area has not been
+  // registered.
+  static always_inline int32_t Cpu(void* area) {
+    return *reinterpret_cast<volatile int32_t*>(
+        reinterpret_cast<uintptr_t>(area) + 4);
+  }
+
+  // Pops the top element of the stack (*len, slots) that belongs to cpu.
+  // Returns nullptr if the stack is empty, or if the calling thread does not
+  // run on cpu or has been preempted.
+  static always_inline void* Pop(
+      void* area, int32_t cpu, int32_t* len, void** slots) {
+#ifdef SCALLOC_HAVE_RSEQ
+    void* p;
+    __asm__ __volatile__(
+        SCALLOC_RSEQ_START("[area]")
+        "1:\n\t"
+        "cmpl %[cpu], 4(%[area])\n\t"
+        "jnz 4f\n\t"
+        "movslq (%[len]), %%rax\n\t"
+        "testq %%rax, %%rax\n\t"
+        "jz 5f\n\t"
+        "movq -8(%[slots], %%rax, 8), %[p]\n\t"
+        "decl %%eax\n\t"
+        "movl %%eax, (%[len])\n\t"
+        "2:\n\t"
+        "jmp 6f\n\t"
+        SCALLOC_RSEQ_ABORT
+        "5:\n\t"
+        "xorq %[p], %[p]\n\t"
+        "6:\n\t"
+        : [p] "=&r"(p)
+        : [area] "r"(area), [cpu] "r"(cpu), [len] "r"(len),
+          [slots] "r"(slots)
+        : "rax", "memory", "cc");
+    return p;
+#else
+    return nullptr;
+#endif  // SCALLOC_HAVE_RSEQ
+  }
+
+  // Pushes p onto the stack (*len, slots) of at most capacity elements that
+  // belongs to cpu. Fails if the stack is full, or if the calling thread does
+  // not run on cpu or has been preempted.
+  static always_inline bool Push(
+      void* area, int32_t cpu, int32_t* len, void** slots, int32_t capacity,
+      void* p) {
+#ifdef SCALLOC_HAVE_RSEQ
+    int32_t pushed;
+    __asm__ __volatile__(
+        SCALLOC_RSEQ_START("[area]")
+        "1:\n\t"
+        "cmpl %[cpu], 4(%[area])\n\t"
+        "jnz 4f\n\t"
+        "movslq (%[len]), %%rax\n\t"
+        "cmpl %[capacity], %%eax\n\t"
+        "jge 5f\n\t"
+        "movq %[p], (%[slots], %%rax, 8)\n\t"
+        "incl %%eax\n\t"
+        "movl %%eax, (%[len])\n\t"
+        "2:\n\t"
+        "movl $1, %[pushed]\n\t"
+        "jmp 6f\n\t"
+        SCALLOC_RSEQ_ABORT
+        "5:\n\t"
+        "movl $0, %[pushed]\n\t"
+        "6:\n\t"
+        : [pushed] "=&r"(pushed)
+        : [area] "r"(area), [cpu] "r"(cpu), [len] "r"(len),
+          [slots] "r"(slots), [capacity] "r"(capacity), [p] "r"(p)
+        : "rax", "memory", "cc");
+    return pushed != 0;
+#else
+    return false;
+#endif  // SCALLOC_HAVE_RSEQ
+  }
+};
+
+}  // namespace scalloc
+
+#endif  // SCALLOC_PLATFORM_RSEQ_H_
@@ -0,0 +1,429 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+#ifndef SCALLOC_PROFILER_H_
+#define SCALLOC_PROFILER_H_
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+
+#include "globals.h"
+#include "lock.h"
+#include "log.h"
+#include "utils.h"
+
+namespace scalloc {
+
+// Sampling heap profiler.
+//
+// Every core counts down the number of bytes until its next sample. The
+// distance between samples is drawn from an exponential distribution with the
+// sample rate as mean, i.e., sampling is a Poisson process over allocated
+// bytes. For every sampled object we record its size and the stack trace of
+// the allocation, aggregated per stack trace. Spans (and large objects) are
+// marked as holding sampled objects so that frees only need to consult the
+// profiler when a sampled object might be involved.
+//
+// Profiles are written in the gperftools heap profile format (heap_v2), which
+// pprof understands, and contain both the live heap and cumulative
+// allocations.
+//
+// Stack traces are taken by walking frame pointers (scalloc itself is built
+// with -fno-omit-frame-pointer). This never allocates and is safe to do while
+// holding core locks. Traces through code without frame pointers are cut
+// short.
+class HeapProfiler {
+ public:
+  static const int32_t kMaxStackDepth = 32;
+
+  // While sampling is disabled cores still come back every kDisabledInterval
+  // bytes, which bounds the time until a new sample rate takes effect.
+  static const int64_t kDisabledInterval = kMega;
+
+  // Globally constructed, hence we use staged construction.
+  always_inline HeapProfiler() {}
+  always_inline ~HeapProfiler() {}
+
+  inline void Init();
+
+  always_inline uint64_t sample_rate() {
+    return sample_rate_.load(std::memory_order_relaxed);
+  }
+  always_inline void set_sample_rate(uint64_t rate) {
+    sample_rate_.store(rate, std::memory_order_relaxed);
+  }
+
+  // Returns the number of bytes until the next sample, using (and updating)
+  // the caller's random state.
+  always_inline int64_t NextSampleInterval(uint64_t* rand_state);
+
+  never_inline void RecordAllocation(void* p, size_t size);
+  // Returns true if p was a sampled object.
+  never_inline bool RecordFree(void* p);
+  // A sampled object has been moved without copying, e.g., by mremap.
+  never_inline void RecordMove(void* old_p, void* new_p);
+
+  // Writes a profile to path (or to "<prefix>.<pid>.<seq>.heap" if path is
+  // NULL). Returns 0 on success and an errno value otherwise.
+  inline int Dump(const char* path);
+
+  // Async-signal-safe. The dump is written at the next sampling point.
+  always_inline void RequestDump() { dump_requested_ = 1; }
+  always_inline void MaybeDump();
+
+ private:
+  static const int32_t kBucketTableSize = 1 << 14;
+  static const int32_t kSampleTableSize = 1 << 16;
+  static const size_t kChunkSize = 1 << 20;
+  static const uintptr_t kMaxFrameSize = 1 << 20;
+
+  // Allocation statistics of a single stack trace.
+  struct Bucket {
+    Bucket* next;
+    uint64_t hash;
+    int32_t depth;
+    void* stack[kMaxStackDepth];
+    uint64_t allocs;
+    uint64_t alloc_bytes;
+    uint64_t frees;
+    uint64_t free_bytes;
+  };
+
+  // A live sampled object.
+  struct Sample {
+    Sample* next;
+    void* p;
+    size_t size;
+    Bucket* bucket;
+  };
+
+  typedef SpinLock<64> Lock;
+
+  static inline void SignalHandler(int signal);
+  static always_inline int32_t CaptureStack(void** stack, int32_t skip);
+  static always_inline uint64_t HashStack(void** stack, int32_t depth);
+  static always_inline uint32_t HashPointer(void* p);
+  static inline void Printf(int fd, const char* format, ...);
+
+  inline void* InternalAllocate(size_t size);
+  inline Bucket* GetBucket(void** stack, int32_t depth);
+
+  std::atomic<uint64_t> sample_rate_;
+  volatile sig_atomic_t dump_requested_;
+  const char* prefix_;
+  int32_t dumps_;
+
+  Lock lock_;
+  Bucket** buckets_;
+  Sample** samples_;
+  Sample* free_samples_;
+  uintptr_t chunk_current_;
+  uintptr_t chunk_end_;
+};
+
+
+void HeapProfiler::Init() {
+  const char* value;
+  prefix_ = "scalloc";
+  if ((value = getenv("SCALLOC_PROF_PREFIX")) != NULL) {
+    prefix_ = value;
+  }
+  if ((value = getenv("SCALLOC_PROF_SAMPLE_RATE")) != NULL) {
+    set_sample_rate(strtoull(value, NULL, 10));
+  }
+  if ((value = getenv("SCALLOC_PROF_SIGNAL")) != NULL) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = SignalHandler;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(atoi(value), &sa, NULL) != 0) {
+      LOG(kWarning, "cannot install profile signal handler for %s", value);
+    }
+  }
+}
+
+
+void HeapProfiler::SignalHandler(int signal) {
+  heap_profiler.RequestDump();
+}
+
+
+int64_t HeapProfiler::NextSampleInterval(uint64_t* rand_state) {
+  const uint64_t rate = sample_rate();
+  if (rate == 0) {
+    return kDisabledInterval;
+  }
+  // xorshift64*
+  uint64_t x = *rand_state;
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  *rand_state = x;
+  x *= 2685821657736338717ULL;
+
+  // -ln(u) for u uniform in (0, 1], with log2 approximated from the exponent
+  // and a linear mantissa of the double. Good enough for sampling.
+  const double u = static_cast<double>((x >> 11) + 1) / (1ULL << 53);
+  uint64_t bits;
+  memcpy(&bits, &u, sizeof(bits));
+  const int64_t exponent = static_cast<int64_t>((bits >> 52) & 0x7FF) - 1023;
+  const double mantissa =
+      static_cast<double>(bits & ((1ULL << 52) - 1)) / (1ULL << 52);
+  const double log2_u = exponent + mantissa;
+  const double interval = -log2_u * 0.6931471805599453 * rate;
+  if (interval < 1) {
+    return 1;
+  }
+  if (interval > static_cast<double>(INT64_MAX / 2)) {
+    return INT64_MAX / 2;
+  }
+  return static_cast<int64_t>(interval);
+}
+
+
+int32_t HeapProfiler::CaptureStack(void** stack, int32_t skip) {
+  void** fp = reinterpret_cast<void**>(__builtin_frame_address(0));
+  void** next;
+  int32_t depth = 0;
+  while ((fp != nullptr) && (depth < kMaxStackDepth)) {
+    if (fp[1] == nullptr) {
+      break;
+    }
+    if (skip > 0) {
+      skip--;
+    } else {
+      stack[depth++] = fp[1];
+    }
+    // Stacks grow downwards, so the caller's frame has to be above ours. Bail
+    // out on anything that does not look like a frame.
+    next = reinterpret_cast<void**>(fp[0]);
+    if ((next <= fp) ||
+        ((reinterpret_cast<uintptr_t>(next) -
+          reinterpret_cast<uintptr_t>(fp)) > kMaxFrameSize) ||
+        ((reinterpret_cast<uintptr_t>(next) & (sizeof(void*) - 1)) != 0)) {
+      break;
+    }
+    fp = next;
+  }
+  return depth;
+}
+
+
+uint64_t HeapProfiler::HashStack(void** stack, int32_t depth) {
+  // FNV-1a over the return addresses.
+  uint64_t hash = 14695981039346656037ULL;
+  for (int32_t i = 0; i < depth; i++) {
+    hash ^= reinterpret_cast<uintptr_t>(stack[i]);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+
+uint32_t HeapProfiler::HashPointer(void* p) {
+  return static_cast<uint32_t>(
+      (reinterpret_cast<uintptr_t>(p) >> 4) * 2654435761U);
+}
+
+
+void* HeapProfiler::InternalAllocate(size_t size) {
+  size = PadSize(size, sizeof(void*));
+  if ((chunk_current_ + size) > chunk_end_) {
+    chunk_current_ = reinterpret_cast<uintptr_t>(SystemMmapFail(kChunkSize));
+    chunk_end_ = chunk_current_ + kChunkSize;
+  }
+  void* p = reinterpret_cast<void*>(chunk_current_);
+  chunk_current_ += size;
+  return p;
+}
+
+
+HeapProfiler::Bucket* HeapProfiler::GetBucket(void** stack, int32_t depth) {
+  const uint64_t hash = HashStack(stack, depth);
+  Bucket** head = &buckets_[hash % kBucketTableSize];
+  for (Bucket* b = *head; b != nullptr; b = b->next) {
+    if ((b->hash == hash) &&
+        (b->depth == depth) &&
+        (memcmp(b->stack, stack, depth * sizeof(stack[0])) == 0)) {
+      return b;
+    }
+  }
+  Bucket* b = reinterpret_cast<Bucket*>(InternalAllocate(sizeof(Bucket)));
+  memset(b, 0, sizeof(*b));
+  b->hash = hash;
+  b->depth = depth;
+  memcpy(b->stack, stack, depth * sizeof(stack[0]));
+  b->next = *head;
+  *head = b;
+  return b;
+}
+
+
+void HeapProfiler::RecordAllocation(void* p, size_t size) {
+  void* stack[kMaxStackDepth];
+  // Skip the sampling frame in the allocator.
+  const int32_t depth = CaptureStack(stack, 1);
+
+  Lock::Guard guard(lock_);
+  if (buckets_ == nullptr) {
+    buckets_ = reinterpret_cast<Bucket**>(
+        SystemMmapFail(kBucketTableSize * sizeof(Bucket*)));
+    samples_ = reinterpret_cast<Sample**>(
+        SystemMmapFail(kSampleTableSize * sizeof(Sample*)));
+  }
+  Bucket* b = GetBucket(stack, depth);
+  b->allocs++;
+  b->alloc_bytes += size;
+
+  Sample* s = free_samples_;
+  if (s != nullptr) {
+    free_samples_ = s->next;
+  } else {
+    s = reinterpret_cast<Sample*>(InternalAllocate(sizeof(Sample)));
+  }
+  s->p = p;
+  s->size = size;
+  s->bucket = b;
+  Sample** head = &samples_[HashPointer(p) % kSampleTableSize];
+  s->next = *head;
+  *head = s;
+}
+
+
+bool HeapProfiler::RecordFree(void* p) {
+  Lock::Guard guard(lock_);
+  if (samples_ == nullptr) {
+    return false;
+  }
+  Sample** prev = &samples_[HashPointer(p) % kSampleTableSize];
+  for (Sample* s = *prev; s != nullptr; prev = &s->next, s = s->next) {
+    if (s->p == p) {
+      s->bucket->frees++;
+      s->bucket->free_bytes += s->size;
+      *prev = s->next;
+      s->next = free_samples_;
+      free_samples_ = s;
+      return true;
+    }
+  }
+  return false;
+}
+
+
+void HeapProfiler::RecordMove(void* old_p, void* new_p) {
+  Lock::Guard guard(lock_);
+  if (samples_ == nullptr) {
+    return;
+  }
+  Sample** prev = &samples_[HashPointer(old_p) % kSampleTableSize];
+  for (Sample* s = *prev; s != nullptr; prev = &s->next, s = s->next) {
+    if (s->p == old_p) {
+      *prev = s->next;
+      s->p = new_p;
+      Sample** head = &samples_[HashPointer(new_p) % kSampleTableSize];
+      s->next = *head;
+      *head = s;
+      return;
+    }
+  }
+}
+
+
+void HeapProfiler::Printf(int fd, const char* format, ...) {
+  char buffer[256];
+  va_list args;
+  va_start(args, format);
+  int len = vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  if (len < 0) {
+    return;
+  }
+  if (len >= static_cast<int>(sizeof(buffer))) {
+    len = sizeof(buffer) - 1;
+  }
+  if (write(fd, buffer, len) == -1) {
+    // Nothing we can do about it.
+  }
+}
+
+
+int HeapProfiler::Dump(const char* path) {
+  char default_path[256];
+  if (path == NULL) {
+    snprintf(default_path, sizeof(default_path), "%s.%d.%d.heap",
+             prefix_, getpid(), dumps_++);
+    path = default_path;
+  }
+  const int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1) {
+    return errno;
+  }
+
+  {
+    Lock::Guard guard(lock_);
+    uint64_t inuse = 0;
+    uint64_t inuse_bytes = 0;
+    uint64_t allocs = 0;
+    uint64_t alloc_bytes = 0;
+    for (int32_t i = 0; (buckets_ != nullptr) && (i < kBucketTableSize); i++) {
+      for (Bucket* b = buckets_[i]; b != nullptr; b = b->next) {
+        inuse += b->allocs - b->frees;
+        inuse_bytes += b->alloc_bytes - b->free_bytes;
+        allocs += b->allocs;
+        alloc_bytes += b->alloc_bytes;
+      }
+    }
+    Printf(fd, "heap profile: %6lu: %8lu [%6lu: %8lu] @ heap_v2/%lu\n",
+           inuse, inuse_bytes, allocs, alloc_bytes, sample_rate());
+    for (int32_t i = 0; (buckets_ != nullptr) && (i < kBucketTableSize); i++) {
+      for (Bucket* b = buckets_[i]; b != nullptr; b = b->next) {
+        Printf(fd, "%6lu: %8lu [%6lu: %8lu] @",
+               b->allocs - b->frees, b->alloc_bytes - b->free_bytes,
+               b->allocs, b->alloc_bytes);
+        for (int32_t j = 0; j < b->depth; j++) {
+          Printf(fd, " %p", b->stack[j]);
+        }
+        Printf(fd, "\n");
+      }
+    }
+  }
+
+  // pprof needs the mappings to symbolize.
+  Printf(fd, "\nMAPPED_LIBRARIES:\n");
+  const int maps = open("/proc/self/maps", O_RDONLY);
+  if (maps != -1) {
+    char buffer[4096];
+    ssize_t len;
+    while ((len = read(maps, buffer, sizeof(buffer))) > 0) {
+      if (write(fd, buffer, len) == -1) {
+        break;
+      }
+    }
+    close(maps);
+  }
+  close(fd);
+  return 0;
+}
+
+
+void HeapProfiler::MaybeDump() {
+  if (UNLIKELY(dump_requested_ != 0)) {
+    dump_requested_ = 0;
+    Dump(NULL);
+  }
+}
+
+}  // namespace scalloc
+
+#endif  // SCALLOC_PROFILER_H_
@@ -0,0 +1,129 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+#ifndef SCALLOC_PURGER_H_
+#define SCALLOC_PURGER_H_
+
+#include <dlfcn.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+
+#include <atomic>
+
+#include "config.h"
+#include "globals.h"
+#include "large_object_cache.h"
+#include "log.h"
+#include "platform/pthread_intercept.h"
+#include "span_pool.h"
+
+namespace scalloc {
+
+// Purges decayed memory from a background thread. Otherwise, decay periods
+// only end on the next span pool operation (see SpanPool::MaybePurge()), and
+// decayed large object mappings are only unmapped on the next operation on
+// their cache shard. A process that stops allocating would keep both forever.
+//
+// The thread is started once, after initialization, and never allocates. It
+// is not recreated in children after fork(), which fall back to purging on
+// operations.
+class BackgroundPurger {
+ public:
+  // Period of checking for work while there is nothing to decay.
+  static const int64_t kIdleMs = 1000;
+
+  // Globally constructed, hence we use staged construction.
+  always_inline BackgroundPurger() {}
+  always_inline ~BackgroundPurger() {}
+
+  inline void Start();
+
+  always_inline bool running() { return running_.load(); }
+
+ private:
+  static inline void* Main(void* arg);
+  static inline void SleepMs(int64_t ms);
+
+  std::atomic<bool> running_;
+};
+
+
+void BackgroundPurger::Start() {
+#if defined(SCALLOC_MADVISE_DECAY) || defined(SCALLOC_LARGE_OBJECT_CACHE)
+  if (!config.background_purge() || running_.load()) {
+    return;
+  }
+#if defined(__linux__)
+  // scalloc's own pthread_create() would set up a LAB for the thread.
+  PthreadCreateFunc create = reinterpret_cast<PthreadCreateFunc>(
+      dlsym(RTLD_NEXT, "pthread_create"));
+#else
+  PthreadCreateFunc create = reinterpret_cast<PthreadCreateFunc>(
+      pthread_create);
+#endif  // __linux__
+  if (create == NULL) {
+    LOG(kWarning, "background purge: pthread_create not found");
+    return;
+  }
+  // Signals of the application are never delivered to the purger.
+  sigset_t all;
+  sigset_t old;
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  pthread_t thread;
+  if (create(&thread, NULL, Main, this) == 0) {
+    pthread_detach(thread);
+    running_.store(true);
+  } else {
+    LOG(kWarning, "background purge: cannot start thread");
+  }
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+#endif  // SCALLOC_MADVISE_DECAY || SCALLOC_LARGE_OBJECT_CACHE
+}
+
+
+void BackgroundPurger::SleepMs(int64_t ms) {
+  struct timespec ts;
+  ts.tv_sec = ms / 1000;
+  ts.tv_nsec = (ms % 1000) * 1000000;
+  while (nanosleep(&ts, &ts) != 0) {}
+}
+
+
+// Sleeps until the current decay period of the span pool is over and ends it.
+// Periods that have been ended by operations in the meantime are skipped.
+// Cached large objects are checked once per kDecayMs of the cache.
+void* BackgroundPurger::Main(void* arg) {
+  while (true) {
+    int64_t wait = kIdleMs;
+#ifdef SCALLOC_MADVISE_DECAY
+    if (config.madvise_decay_ms() > 0) {
+      wait = span_pool.MsUntilPurge();
+    }
+#endif  // SCALLOC_MADVISE_DECAY
+#ifdef SCALLOC_LARGE_OBJECT_CACHE
+    const int64_t cache_decay = LargeObjectCache::kDecayMs;
+    if ((large_object_cache.CachedBytes() != 0) && (wait > cache_decay)) {
+      wait = cache_decay;
+    }
+#endif  // SCALLOC_LARGE_OBJECT_CACHE
+    if (wait > 0) {
+      SleepMs(wait);
+    }
+#ifdef SCALLOC_MADVISE_DECAY
+    span_pool.MaybePurge();
+#endif  // SCALLOC_MADVISE_DECAY
+#ifdef SCALLOC_LARGE_OBJECT_CACHE
+    if (large_object_cache.CachedBytes() != 0) {
+      large_object_cache.Trim(false);
+    }
+#endif  // SCALLOC_LARGE_OBJECT_CACHE
+  }
+  return NULL;
+}
+
+}  // namespace scalloc
+
+#endif  // SCALLOC_PURGER_H_
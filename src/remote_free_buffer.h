@@ -0,0 +1,95 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+#ifndef SCALLOC_REMOTE_FREE_BUFFER_H_
+#define SCALLOC_REMOTE_FREE_BUFFER_H_
+
+#include <string.h>
+
+#include "globals.h"
+#include "platform/assert.h"
+#include "platform/globals.h"
+
+namespace scalloc {
+
+class Span;
+
+// Buffers objects that are freed into spans of other cores. Objects are linked
+// up per destination span (using their first word) so that a whole batch can be
+// published on the span's remote free list with a single CAS. Slots are
+// direct-mapped by span address; a slot is flushed when it is full or when a
+// different span maps to it.
+//
+// Cores of threads that only free never refill spans, and cores that are not
+// thread-local are not destroyed on thread exit. Hence, all slots are also
+// flushed after every kMaxAge buffered objects. The bound is a count, not a
+// time: Objects stay buffered (and their spans unreclaimable) while the core
+// is idle, e.g., a round-robin or per-CPU core that no thread uses anymore.
+class RemoteFreeBuffer {
+ public:
+  static const int32_t kSlots = 8;
+  static const int32_t kBatchSize = 32;
+  static const int32_t kMaxAge = kSlots * kBatchSize;
+
+  class Batch {
+   public:
+    always_inline void Reset(Span* span) {
+      span_ = span;
+      head_ = nullptr;
+      tail_ = nullptr;
+      len_ = 0;
+    }
+
+    always_inline void Add(void* p) {
+      *(reinterpret_cast<void**>(p)) = head_;
+      if (head_ == nullptr) {
+        tail_ = p;
+      }
+      head_ = p;
+      len_++;
+    }
+
+    always_inline Span* span() { return span_; }
+    always_inline void* head() { return head_; }
+    always_inline void* tail() { return tail_; }
+    always_inline int32_t len() { return len_; }
+    always_inline bool Full() { return len_ == kBatchSize; }
+
+   private:
+    Span* span_;
+    void* head_;
+    void* tail_;
+    int32_t len_;
+  };
+
+  always_inline void Init() {
+    memset(batches_, 0, sizeof(batches_));
+    age_ = 0;
+  }
+
+  always_inline Batch* SlotFor(Span* s) {
+    return &batches_[
+        (reinterpret_cast<uintptr_t>(s) >> kVirtualSpanShift) % kSlots];
+  }
+
+  always_inline Batch* At(int32_t i) {
+    ScallocAssert(i < kSlots);
+    return &batches_[i];
+  }
+
+  // Counts a buffered object. Returns true if all slots should be flushed.
+  always_inline bool Age() {
+    return ++age_ >= kMaxAge;
+  }
+
+  always_inline void ResetAge() { age_ = 0; }
+
+ private:
+  Batch batches_[kSlots];
+  int32_t age_;
+};
+
+}  // namespace scalloc
+
+#endif  // SCALLOC_REMOTE_FREE_BUFFER_H_
@@ -0,0 +1,125 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+#ifndef SCALLOC_REUSABLE_SPANS_H_
+#define SCALLOC_REUSABLE_SPANS_H_
+
+#include "atomic_value.h"
+#include "core_id.h"
+#include "globals.h"
+#include "log.h"
+
+namespace scalloc {
+
+class ListNode {
+ public:
+  always_inline ListNode() : next_(nullptr) { }
+  always_inline ListNode* next() { return next_; }
+  always_inline void set_next(ListNode* next) { next_ = next; }
+  always_inline void clear_next() { next_ = nullptr; }
+
+ private:
+  ListNode* next_;
+};
+
+
+// The reusable spans of a core for a single size class. A lock-free stack
+// that any thread may push to (remote freers) and pop from (the owner and
+// thieves).
+//
+// There is no removal from the middle: A span that becomes empty while it is
+// linked stays in the stack until it gets popped (see Span::DeferDelete()).
+//
+// The stack is closed when its core terminates, after which pushes fail.
+// Pushes also fail for callers that observed a core id of an earlier thread,
+// as every Open() and Close() bumps the tag of the top pointer.
+class ReusableSpans {
+ public:
+  always_inline ReusableSpans();
+  always_inline bool Push(core_id owner, ListNode* node);
+  always_inline ListNode* Pop();
+
+  always_inline void Open(core_id owner);
+  // Returns the spans that were linked, chained through their next pointers.
+  always_inline ListNode* Close();
+
+  // Racy, only use as a hint.
+  always_inline bool Empty() {
+    ListNode* top = top_.load().value();
+    return (top == nullptr) || (top == Closed());
+  }
+
+ private:
+  typedef TaggedValue<ListNode*> TopPtr;
+
+  static always_inline ListNode* Closed() {
+    return reinterpret_cast<ListNode*>(1);
+  }
+
+  AtomicTaggedValue<ListNode*> top_;
+  AtomicCoreID owner_;
+
+  UNUSED char pad_[64 - ((
+      sizeof(top_) +
+      sizeof(owner_)) % 64)];
+};
+
+
+ReusableSpans::ReusableSpans()
+    : top_(TopPtr(nullptr, 0))
+    , owner_(kTerminated) {
+}
+
+
+void ReusableSpans::Open(core_id owner) {
+  const TopPtr top = top_.load();
+  ScallocAssert((top.value() == nullptr) || (top.value() == Closed()));
+  owner_.store(owner);
+  top_.store(TopPtr(nullptr, top.tag() + 1));
+}
+
+
+ListNode* ReusableSpans::Close() {
+  owner_.store(kTerminated);
+  TopPtr top;
+  do {
+    top = top_.load();
+  } while (!top_.swap(top, TopPtr(Closed(), top.tag() + 1)));
+  return (top.value() == Closed()) ? nullptr : top.value();
+}
+
+
+bool ReusableSpans::Push(core_id owner, ListNode* node) {
+  ScallocAssert(node != nullptr);
+  TopPtr top;
+  do {
+    top = top_.load();
+    // Checking the owner after loading the top makes the check part of the
+    // swap below.
+    if ((top.value() == Closed()) || (owner_.load() != owner)) {
+      return false;
+    }
+    node->set_next(top.value());
+  } while (!top_.swap(top, TopPtr(node, top.tag() + 1)));
+  return true;
+}
+
+
+ListNode* ReusableSpans::Pop() {
+  TopPtr top;
+  do {
+    top = top_.load();
+    if ((top.value() == nullptr) || (top.value() == Closed())) {
+      return nullptr;
+    }
+    // The next pointer may be stale if the span has been popped concurrently,
+    // in which case the tag has changed. Span headers are never unmapped.
+  } while (!top_.swap(top, TopPtr(top.value()->next(), top.tag() + 1)));
+  top.value()->clear_next();
+  return top.value();
+}
+
+}   // namespace scalloc
+
+#endif  // SCALLOC_REUSABLE_SPANS_H_
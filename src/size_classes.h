@@ -8,6 +8,7 @@
 #include <cinttypes>
 #include <cstdio>
 
+#include "config.h"
 #include "globals.h"
 #include "platform/assert.h"
 #include "platform/globals.h"
@@ -15,32 +16,106 @@
 
 namespace scalloc {
 
-extern const int32_t ClassToObjects[];
-extern const int32_t ClassToSize[];
-extern const int32_t ClassToSpanSize[];
-extern const int32_t ClassToReuseThreshold[];
+// Metadata of a size class. Entries are 16 bytes and the table is cache
+// aligned, so everything the fast paths need about a class is on a single
+// cache line.
+struct SizeClassInfo {
+  int32_t size;
+  int32_t objects;
+  int32_t span_size;
+  // Depends on the reuse threshold, which is only known at runtime.
+  int32_t reuse_threshold;
+};
+static_assert((kCacheLineSize % sizeof(SizeClassInfo)) == 0,
+              "size class metadata crosses cache lines");
+
+extern SizeClassInfo ClassInfo[];
+// Classes of sizes up to kMaxDirectSize, per kMinAlignment bytes.
+extern const uint8_t DirectSizeToClass[];
+// Coarse classes of medium sizes, per 1 << kMediumBinShift bins of every power
+// of two (see tools/gen_size_classes.py).
+extern const uint8_t MediumSizeToClass[];
 
 always_inline int32_t SizeToClass(const size_t size) __attribute__((pure));
+always_inline int32_t AlignedSizeToClass(const size_t align, const size_t size)
+    __attribute__((pure));
 always_inline int32_t SizeToBlockSize(const size_t size) __attribute__((pure));
 
 
+// Offset of the first block in a span of the given size class. Blocks of
+// regular classes follow the span header. Aligned classes leave out a whole
+// block instead, which aligns all of their blocks to their (power of two)
+// size.
+constexpr int32_t ClassBlockOffset(int32_t size_class, int32_t size) {
+  return (size_class >= kFirstAlignedClass) ? size : kSpanHeaderSize;
+}
+
+
 int32_t SizeToClass(const size_t size) {
-  if (size <= kMaxSmallSize) {
-    return (size + kMinAlignment - 1) / kMinAlignment;
+  if (LIKELY(size <= kMaxDirectSize)) {
+    return DirectSizeToClass[(size + kMinAlignment - 1) / kMinAlignment];
   }
   if (size <= kMaxMediumSize) {
-    return Log2(size - 1) - kMaxSmallShift + kFineClasses;
+    // size - 1 lies in [2^log, 2^(log + 1)), whose bin is given by the bits
+    // right below the leading one.
+    const int32_t log = 63 - __builtin_clzl(size - 1);
+    const size_t bin =
+        ((log - kMaxSmallShift) << kMediumBinShift) |
+        (((size - 1) >> (log - kMediumBinShift)) &
+         ((1 << kMediumBinShift) - 1));
+    return MediumSizeToClass[bin];
   }
   // 0 indicates size of 0 or large objects.
   return 0;
 }
 
 
+// Returns the class of a non-zero size whose blocks are all aligned to align,
+// a power of two, or 0 if only a large object will do.
+int32_t AlignedSizeToClass(const size_t align, const size_t size) {
+  if (align <= kSpanHeaderSize) {
+    // Spans and their headers are aligned to kSpanHeaderSize, so blocks of any
+    // regular class whose size is a multiple of align are aligned. Powers of
+    // two are always classes, which bounds the search.
+    if (size > kMaxMediumSize) {
+      return 0;
+    }
+    int32_t sc = SizeToClass((size + align - 1) & ~(align - 1));
+    while ((sc != 0) && ((ClassInfo[sc].size & (align - 1)) != 0)) {
+      sc++;
+    }
+    return sc;
+  }
+  const size_t block = (size > align) ? size : align;
+  if (block > kMaxMediumSize) {
+    return 0;
+  }
+  const int32_t log = 64 - __builtin_clzl(block - 1);
+  return kFirstAlignedClass + log - kMinAlignedShift;
+}
+
+
+// Derives the reuse threshold of a size class from its configured percentage.
+// Spans that have already been marked reusable keep their state.
+inline void UpdateReuseThreshold(int32_t size_class) {
+  SizeClassInfo& info = ClassInfo[size_class];
+  info.reuse_threshold =
+      (info.objects * config.reuse_threshold(size_class)) / 100;
+}
+
+
+inline void UpdateReuseThresholds() {
+  for (int32_t i = 0; i < kNumClasses; i++) {
+    UpdateReuseThreshold(i);
+  }
+}
+
+
 int32_t SizeToBlockSize(const size_t size) {
   if (size <= kMaxSmallSize) {
     return (size + kMinAlignment - 1) & ~(kMinAlignment-1);
   } else if (size <= kMaxMediumSize) {
-    return 1UL << (Log2(size - 1) + 1);
+    return ClassInfo[SizeToClass(size)].size;
   }
   UNREACHABLE();
   return 0;
@@ -49,12 +124,12 @@ int32_t SizeToBlockSize(const size_t size) {
 
 inline void PrintSizeclasses() {
   fprintf(stderr, "Sizeclass summary\n");
-  fprintf(stderr, "Reuse threshold: %d%%\n", kReuseThreshold);
+  fprintf(stderr, "Reuse threshold: %d%%\n", config.reuse_threshold());
   int32_t waste = 0;
   for (int32_t i = 0; i < kNumClasses; i++) {
     if (i > 0) {
-      waste = ClassToSize[i] - ClassToSize[i - 1] - 1;
-      waste = (waste * 100) / ClassToSize[i];
+      waste = ClassInfo[i].size - ClassInfo[i - 1].size - 1;
+      waste = (waste * 100) / ClassInfo[i].size;
     }
     fprintf(stderr, "[9] \t[%d] "
            "size: %d, "
@@ -63,10 +138,10 @@ inline void PrintSizeclasses() {
            "reuse threshold: %d, "
            "waste: %d%%\n",
            i,
-           ClassToSize[i],
-           ClassToObjects[i],
-           ClassToSpanSize[i],
-           ClassToReuseThreshold[i],
+           ClassInfo[i].size,
+           ClassInfo[i].objects,
+           ClassInfo[i].span_size,
+           ClassInfo[i].reuse_threshold,
            waste);
   }
   abort();
@@ -7,12 +7,17 @@
 //                          |  DO NOT EDIT!  |
 //                          +----------------+
 //
-// This file is auto-generated using ``tools/gen_size_classes.py huge''
+// This file is auto-generated using ``tools/gen_size_classes.py steps 4''
 
 #ifndef SCALLOC_SIZE_CLASSES_RAW_H_
 #define SCALLOC_SIZE_CLASSES_RAW_H_
 
 const int32_t kSpanHeaderSize = 128;
+const size_t kCoarseClasses = 48;
+const size_t kAlignedClasses = 13;
+const int32_t kMinAlignedShift = 8;
+const int32_t kMediumBinShift = 3;
+const size_t kMaxDirectSize = 4096;
 
 #define FOR_ALL_SIZE_CLASSES(V) \
   V(0, 0, 0, 0) /* NOLINT */ \
@@ -32,17 +37,426 @@ const int32_t kSpanHeaderSize = 128;
   V(14, 224, 32768, (32768 - kSpanHeaderSize)/224) /* NOLINT */ \
   V(15, 240, 32768, (32768 - kSpanHeaderSize)/240) /* NOLINT */ \
   V(16, 256, 32768, (32768 - kSpanHeaderSize)/256) /* NOLINT */ \
-  V(17, 512, ((64 * 512 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 64) /* NOLINT */ \
-  V(18, 1024, ((64 * 1024 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 64) /* NOLINT */ \
-  V(19, 2048, ((64 * 2048 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 64) /* NOLINT */ \
-  V(20, 4096, ((32 * 4096 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 32) /* NOLINT */ \
-  V(21, 8192, ((32 * 8192 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 32) /* NOLINT */ \
-  V(22, 16384, ((16 * 16384 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 16) /* NOLINT */ \
-  V(23, 32768, ((16 * 32768 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 16) /* NOLINT */ \
-  V(24, 65536, ((16 * 65536 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 16) /* NOLINT */ \
-  V(25, 131072, ((8 * 131072 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 8) /* NOLINT */ \
-  V(26, 262144, ((4 * 262144 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 4) /* NOLINT */ \
-  V(27, 524288, ((2 * 524288 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 2) /* NOLINT */ \
-  V(28, 1048576, ((1 * 1048576 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 1) /* NOLINT */
+  V(17, 320, ((64 * 320 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 64) /* NOLINT */ \
+  V(18, 384, ((64 * 384 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 64) /* NOLINT */ \
+  V(19, 448, ((64 * 448 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 64) /* NOLINT */ \
+  V(20, 512, ((64 * 512 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 64) /* NOLINT */ \
+  V(21, 640, ((64 * 640 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 64) /* NOLINT */ \
+  V(22, 768, ((64 * 768 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 64) /* NOLINT */ \
+  V(23, 896, ((64 * 896 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 64) /* NOLINT */ \
+  V(24, 1024, ((64 * 1024 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 64) /* NOLINT */ \
+  V(25, 1280, ((64 * 1280 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 64) /* NOLINT */ \
+  V(26, 1536, ((64 * 1536 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 64) /* NOLINT */ \
+  V(27, 1792, ((64 * 1792 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 64) /* NOLINT */ \
+  V(28, 2048, ((64 * 2048 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 64) /* NOLINT */ \
+  V(29, 2560, ((32 * 2560 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 32) /* NOLINT */ \
+  V(30, 3072, ((32 * 3072 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 32) /* NOLINT */ \
+  V(31, 3584, ((32 * 3584 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 32) /* NOLINT */ \
+  V(32, 4096, ((32 * 4096 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 32) /* NOLINT */ \
+  V(33, 5120, ((32 * 5120 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 32) /* NOLINT */ \
+  V(34, 6144, ((32 * 6144 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 32) /* NOLINT */ \
+  V(35, 7168, ((32 * 7168 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 32) /* NOLINT */ \
+  V(36, 8192, ((32 * 8192 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 32) /* NOLINT */ \
+  V(37, 10240, ((16 * 10240 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 16) /* NOLINT */ \
+  V(38, 12288, ((16 * 12288 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 16) /* NOLINT */ \
+  V(39, 14336, ((16 * 14336 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 16) /* NOLINT */ \
+  V(40, 16384, ((16 * 16384 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 16) /* NOLINT */ \
+  V(41, 20480, ((16 * 20480 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 16) /* NOLINT */ \
+  V(42, 24576, ((16 * 24576 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 16) /* NOLINT */ \
+  V(43, 28672, ((16 * 28672 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 16) /* NOLINT */ \
+  V(44, 32768, ((16 * 32768 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 16) /* NOLINT */ \
+  V(45, 40960, ((16 * 40960 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 16) /* NOLINT */ \
+  V(46, 49152, ((16 * 49152 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 16) /* NOLINT */ \
+  V(47, 57344, ((16 * 57344 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 16) /* NOLINT */ \
+  V(48, 65536, ((16 * 65536 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 16) /* NOLINT */ \
+  V(49, 81920, ((8 * 81920 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 8) /* NOLINT */ \
+  V(50, 98304, ((8 * 98304 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 8) /* NOLINT */ \
+  V(51, 114688, ((8 * 114688 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 8) /* NOLINT */ \
+  V(52, 131072, ((8 * 131072 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 8) /* NOLINT */ \
+  V(53, 163840, ((4 * 163840 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 4) /* NOLINT */ \
+  V(54, 196608, ((4 * 196608 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 4) /* NOLINT */ \
+  V(55, 229376, ((4 * 229376 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 4) /* NOLINT */ \
+  V(56, 262144, ((4 * 262144 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 4) /* NOLINT */ \
+  V(57, 327680, ((2 * 327680 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 2) /* NOLINT */ \
+  V(58, 393216, ((2 * 393216 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 2) /* NOLINT */ \
+  V(59, 458752, ((2 * 458752 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 2) /* NOLINT */ \
+  V(60, 524288, ((2 * 524288 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 2) /* NOLINT */ \
+  V(61, 655360, ((1 * 655360 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 1) /* NOLINT */ \
+  V(62, 786432, ((1 * 786432 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 1) /* NOLINT */ \
+  V(63, 917504, ((1 * 917504 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 1) /* NOLINT */ \
+  V(64, 1048576, ((1 * 1048576 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 1) /* NOLINT */ \
+  V(65, 256, ((65 * 256 + kPageSize - 1)/kPageSize) * kPageSize, 64) /* NOLINT */ \
+  V(66, 512, ((65 * 512 + kPageSize - 1)/kPageSize) * kPageSize, 64) /* NOLINT */ \
+  V(67, 1024, ((65 * 1024 + kPageSize - 1)/kPageSize) * kPageSize, 64) /* NOLINT */ \
+  V(68, 2048, ((65 * 2048 + kPageSize - 1)/kPageSize) * kPageSize, 64) /* NOLINT */ \
+  V(69, 4096, ((33 * 4096 + kPageSize - 1)/kPageSize) * kPageSize, 32) /* NOLINT */ \
+  V(70, 8192, ((33 * 8192 + kPageSize - 1)/kPageSize) * kPageSize, 32) /* NOLINT */ \
+  V(71, 16384, ((17 * 16384 + kPageSize - 1)/kPageSize) * kPageSize, 16) /* NOLINT */ \
+  V(72, 32768, ((17 * 32768 + kPageSize - 1)/kPageSize) * kPageSize, 16) /* NOLINT */ \
+  V(73, 65536, ((17 * 65536 + kPageSize - 1)/kPageSize) * kPageSize, 16) /* NOLINT */ \
+  V(74, 131072, ((9 * 131072 + kPageSize - 1)/kPageSize) * kPageSize, 8) /* NOLINT */ \
+  V(75, 262144, ((5 * 262144 + kPageSize - 1)/kPageSize) * kPageSize, 4) /* NOLINT */ \
+  V(76, 524288, ((3 * 524288 + kPageSize - 1)/kPageSize) * kPageSize, 2) /* NOLINT */ \
+  V(77, 1048576, ((2 * 1048576 + kPageSize - 1)/kPageSize) * kPageSize, 1) /* NOLINT */
+
+// The coarse class of every bin of medium sizes, see SizeToClass().
+#define FOR_ALL_MEDIUM_BINS(V) \
+  V(0, 17) /* NOLINT */ \
+  V(1, 17) /* NOLINT */ \
+  V(2, 18) /* NOLINT */ \
+  V(3, 18) /* NOLINT */ \
+  V(4, 19) /* NOLINT */ \
+  V(5, 19) /* NOLINT */ \
+  V(6, 20) /* NOLINT */ \
+  V(7, 20) /* NOLINT */ \
+  V(8, 21) /* NOLINT */ \
+  V(9, 21) /* NOLINT */ \
+  V(10, 22) /* NOLINT */ \
+  V(11, 22) /* NOLINT */ \
+  V(12, 23) /* NOLINT */ \
+  V(13, 23) /* NOLINT */ \
+  V(14, 24) /* NOLINT */ \
+  V(15, 24) /* NOLINT */ \
+  V(16, 25) /* NOLINT */ \
+  V(17, 25) /* NOLINT */ \
+  V(18, 26) /* NOLINT */ \
+  V(19, 26) /* NOLINT */ \
+  V(20, 27) /* NOLINT */ \
+  V(21, 27) /* NOLINT */ \
+  V(22, 28) /* NOLINT */ \
+  V(23, 28) /* NOLINT */ \
+  V(24, 29) /* NOLINT */ \
+  V(25, 29) /* NOLINT */ \
+  V(26, 30) /* NOLINT */ \
+  V(27, 30) /* NOLINT */ \
+  V(28, 31) /* NOLINT */ \
+  V(29, 31) /* NOLINT */ \
+  V(30, 32) /* NOLINT */ \
+  V(31, 32) /* NOLINT */ \
+  V(32, 33) /* NOLINT */ \
+  V(33, 33) /* NOLINT */ \
+  V(34, 34) /* NOLINT */ \
+  V(35, 34) /* NOLINT */ \
+  V(36, 35) /* NOLINT */ \
+  V(37, 35) /* NOLINT */ \
+  V(38, 36) /* NOLINT */ \
+  V(39, 36) /* NOLINT */ \
+  V(40, 37) /* NOLINT */ \
+  V(41, 37) /* NOLINT */ \
+  V(42, 38) /* NOLINT */ \
+  V(43, 38) /* NOLINT */ \
+  V(44, 39) /* NOLINT */ \
+  V(45, 39) /* NOLINT */ \
+  V(46, 40) /* NOLINT */ \
+  V(47, 40) /* NOLINT */ \
+  V(48, 41) /* NOLINT */ \
+  V(49, 41) /* NOLINT */ \
+  V(50, 42) /* NOLINT */ \
+  V(51, 42) /* NOLINT */ \
+  V(52, 43) /* NOLINT */ \
+  V(53, 43) /* NOLINT */ \
+  V(54, 44) /* NOLINT */ \
+  V(55, 44) /* NOLINT */ \
+  V(56, 45) /* NOLINT */ \
+  V(57, 45) /* NOLINT */ \
+  V(58, 46) /* NOLINT */ \
+  V(59, 46) /* NOLINT */ \
+  V(60, 47) /* NOLINT */ \
+  V(61, 47) /* NOLINT */ \
+  V(62, 48) /* NOLINT */ \
+  V(63, 48) /* NOLINT */ \
+  V(64, 49) /* NOLINT */ \
+  V(65, 49) /* NOLINT */ \
+  V(66, 50) /* NOLINT */ \
+  V(67, 50) /* NOLINT */ \
+  V(68, 51) /* NOLINT */ \
+  V(69, 51) /* NOLINT */ \
+  V(70, 52) /* NOLINT */ \
+  V(71, 52) /* NOLINT */ \
+  V(72, 53) /* NOLINT */ \
+  V(73, 53) /* NOLINT */ \
+  V(74, 54) /* NOLINT */ \
+  V(75, 54) /* NOLINT */ \
+  V(76, 55) /* NOLINT */ \
+  V(77, 55) /* NOLINT */ \
+  V(78, 56) /* NOLINT */ \
+  V(79, 56) /* NOLINT */ \
+  V(80, 57) /* NOLINT */ \
+  V(81, 57) /* NOLINT */ \
+  V(82, 58) /* NOLINT */ \
+  V(83, 58) /* NOLINT */ \
+  V(84, 59) /* NOLINT */ \
+  V(85, 59) /* NOLINT */ \
+  V(86, 60) /* NOLINT */ \
+  V(87, 60) /* NOLINT */ \
+  V(88, 61) /* NOLINT */ \
+  V(89, 61) /* NOLINT */ \
+  V(90, 62) /* NOLINT */ \
+  V(91, 62) /* NOLINT */ \
+  V(92, 63) /* NOLINT */ \
+  V(93, 63) /* NOLINT */ \
+  V(94, 64) /* NOLINT */ \
+  V(95, 64) /* NOLINT */
+
+// The class of every size up to kMaxDirectSize, in steps of 16 bytes, see
+// SizeToClass().
+#define FOR_ALL_DIRECT_SIZES(V) \
+  V(0, 0) /* NOLINT */ \
+  V(1, 1) /* NOLINT */ \
+  V(2, 2) /* NOLINT */ \
+  V(3, 3) /* NOLINT */ \
+  V(4, 4) /* NOLINT */ \
+  V(5, 5) /* NOLINT */ \
+  V(6, 6) /* NOLINT */ \
+  V(7, 7) /* NOLINT */ \
+  V(8, 8) /* NOLINT */ \
+  V(9, 9) /* NOLINT */ \
+  V(10, 10) /* NOLINT */ \
+  V(11, 11) /* NOLINT */ \
+  V(12, 12) /* NOLINT */ \
+  V(13, 13) /* NOLINT */ \
+  V(14, 14) /* NOLINT */ \
+  V(15, 15) /* NOLINT */ \
+  V(16, 16) /* NOLINT */ \
+  V(17, 17) /* NOLINT */ \
+  V(18, 17) /* NOLINT */ \
+  V(19, 17) /* NOLINT */ \
+  V(20, 17) /* NOLINT */ \
+  V(21, 18) /* NOLINT */ \
+  V(22, 18) /* NOLINT */ \
+  V(23, 18) /* NOLINT */ \
+  V(24, 18) /* NOLINT */ \
+  V(25, 19) /* NOLINT */ \
+  V(26, 19) /* NOLINT */ \
+  V(27, 19) /* NOLINT */ \
+  V(28, 19) /* NOLINT */ \
+  V(29, 20) /* NOLINT */ \
+  V(30, 20) /* NOLINT */ \
+  V(31, 20) /* NOLINT */ \
+  V(32, 20) /* NOLINT */ \
+  V(33, 21) /* NOLINT */ \
+  V(34, 21) /* NOLINT */ \
+  V(35, 21) /* NOLINT */ \
+  V(36, 21) /* NOLINT */ \
+  V(37, 21) /* NOLINT */ \
+  V(38, 21) /* NOLINT */ \
+  V(39, 21) /* NOLINT */ \
+  V(40, 21) /* NOLINT */ \
+  V(41, 22) /* NOLINT */ \
+  V(42, 22) /* NOLINT */ \
+  V(43, 22) /* NOLINT */ \
+  V(44, 22) /* NOLINT */ \
+  V(45, 22) /* NOLINT */ \
+  V(46, 22) /* NOLINT */ \
+  V(47, 22) /* NOLINT */ \
+  V(48, 22) /* NOLINT */ \
+  V(49, 23) /* NOLINT */ \
+  V(50, 23) /* NOLINT */ \
+  V(51, 23) /* NOLINT */ \
+  V(52, 23) /* NOLINT */ \
+  V(53, 23) /* NOLINT */ \
+  V(54, 23) /* NOLINT */ \
+  V(55, 23) /* NOLINT */ \
+  V(56, 23) /* NOLINT */ \
+  V(57, 24) /* NOLINT */ \
+  V(58, 24) /* NOLINT */ \
+  V(59, 24) /* NOLINT */ \
+  V(60, 24) /* NOLINT */ \
+  V(61, 24) /* NOLINT */ \
+  V(62, 24) /* NOLINT */ \
+  V(63, 24) /* NOLINT */ \
+  V(64, 24) /* NOLINT */ \
+  V(65, 25) /* NOLINT */ \
+  V(66, 25) /* NOLINT */ \
+  V(67, 25) /* NOLINT */ \
+  V(68, 25) /* NOLINT */ \
+  V(69, 25) /* NOLINT */ \
+  V(70, 25) /* NOLINT */ \
+  V(71, 25) /* NOLINT */ \
+  V(72, 25) /* NOLINT */ \
+  V(73, 25) /* NOLINT */ \
+  V(74, 25) /* NOLINT */ \
+  V(75, 25) /* NOLINT */ \
+  V(76, 25) /* NOLINT */ \
+  V(77, 25) /* NOLINT */ \
+  V(78, 25) /* NOLINT */ \
+  V(79, 25) /* NOLINT */ \
+  V(80, 25) /* NOLINT */ \
+  V(81, 26) /* NOLINT */ \
+  V(82, 26) /* NOLINT */ \
+  V(83, 26) /* NOLINT */ \
+  V(84, 26) /* NOLINT */ \
+  V(85, 26) /* NOLINT */ \
+  V(86, 26) /* NOLINT */ \
+  V(87, 26) /* NOLINT */ \
+  V(88, 26) /* NOLINT */ \
+  V(89, 26) /* NOLINT */ \
+  V(90, 26) /* NOLINT */ \
+  V(91, 26) /* NOLINT */ \
+  V(92, 26) /* NOLINT */ \
+  V(93, 26) /* NOLINT */ \
+  V(94, 26) /* NOLINT */ \
+  V(95, 26) /* NOLINT */ \
+  V(96, 26) /* NOLINT */ \
+  V(97, 27) /* NOLINT */ \
+  V(98, 27) /* NOLINT */ \
+  V(99, 27) /* NOLINT */ \
+  V(100, 27) /* NOLINT */ \
+  V(101, 27) /* NOLINT */ \
+  V(102, 27) /* NOLINT */ \
+  V(103, 27) /* NOLINT */ \
+  V(104, 27) /* NOLINT */ \
+  V(105, 27) /* NOLINT */ \
+  V(106, 27) /* NOLINT */ \
+  V(107, 27) /* NOLINT */ \
+  V(108, 27) /* NOLINT */ \
+  V(109, 27) /* NOLINT */ \
+  V(110, 27) /* NOLINT */ \
+  V(111, 27) /* NOLINT */ \
+  V(112, 27) /* NOLINT */ \
+  V(113, 28) /* NOLINT */ \
+  V(114, 28) /* NOLINT */ \
+  V(115, 28) /* NOLINT */ \
+  V(116, 28) /* NOLINT */ \
+  V(117, 28) /* NOLINT */ \
+  V(118, 28) /* NOLINT */ \
+  V(119, 28) /* NOLINT */ \
+  V(120, 28) /* NOLINT */ \
+  V(121, 28) /* NOLINT */ \
+  V(122, 28) /* NOLINT */ \
+  V(123, 28) /* NOLINT */ \
+  V(124, 28) /* NOLINT */ \
+  V(125, 28) /* NOLINT */ \
+  V(126, 28) /* NOLINT */ \
+  V(127, 28) /* NOLINT */ \
+  V(128, 28) /* NOLINT */ \
+  V(129, 29) /* NOLINT */ \
+  V(130, 29) /* NOLINT */ \
+  V(131, 29) /* NOLINT */ \
+  V(132, 29) /* NOLINT */ \
+  V(133, 29) /* NOLINT */ \
+  V(134, 29) /* NOLINT */ \
+  V(135, 29) /* NOLINT */ \
+  V(136, 29) /* NOLINT */ \
+  V(137, 29) /* NOLINT */ \
+  V(138, 29) /* NOLINT */ \
+  V(139, 29) /* NOLINT */ \
+  V(140, 29) /* NOLINT */ \
+  V(141, 29) /* NOLINT */ \
+  V(142, 29) /* NOLINT */ \
+  V(143, 29) /* NOLINT */ \
+  V(144, 29) /* NOLINT */ \
+  V(145, 29) /* NOLINT */ \
+  V(146, 29) /* NOLINT */ \
+  V(147, 29) /* NOLINT */ \
+  V(148, 29) /* NOLINT */ \
+  V(149, 29) /* NOLINT */ \
+  V(150, 29) /* NOLINT */ \
+  V(151, 29) /* NOLINT */ \
+  V(152, 29) /* NOLINT */ \
+  V(153, 29) /* NOLINT */ \
+  V(154, 29) /* NOLINT */ \
+  V(155, 29) /* NOLINT */ \
+  V(156, 29) /* NOLINT */ \
+  V(157, 29) /* NOLINT */ \
+  V(158, 29) /* NOLINT */ \
+  V(159, 29) /* NOLINT */ \
+  V(160, 29) /* NOLINT */ \
+  V(161, 30) /* NOLINT */ \
+  V(162, 30) /* NOLINT */ \
+  V(163, 30) /* NOLINT */ \
+  V(164, 30) /* NOLINT */ \
+  V(165, 30) /* NOLINT */ \
+  V(166, 30) /* NOLINT */ \
+  V(167, 30) /* NOLINT */ \
+  V(168, 30) /* NOLINT */ \
+  V(169, 30) /* NOLINT */ \
+  V(170, 30) /* NOLINT */ \
+  V(171, 30) /* NOLINT */ \
+  V(172, 30) /* NOLINT */ \
+  V(173, 30) /* NOLINT */ \
+  V(174, 30) /* NOLINT */ \
+  V(175, 30) /* NOLINT */ \
+  V(176, 30) /* NOLINT */ \
+  V(177, 30) /* NOLINT */ \
+  V(178, 30) /* NOLINT */ \
+  V(179, 30) /* NOLINT */ \
+  V(180, 30) /* NOLINT */ \
+  V(181, 30) /* NOLINT */ \
+  V(182, 30) /* NOLINT */ \
+  V(183, 30) /* NOLINT */ \
+  V(184, 30) /* NOLINT */ \
+  V(185, 30) /* NOLINT */ \
+  V(186, 30) /* NOLINT */ \
+  V(187, 30) /* NOLINT */ \
+  V(188, 30) /* NOLINT */ \
+  V(189, 30) /* NOLINT */ \
+  V(190, 30) /* NOLINT */ \
+  V(191, 30) /* NOLINT */ \
+  V(192, 30) /* NOLINT */ \
+  V(193, 31) /* NOLINT */ \
+  V(194, 31) /* NOLINT */ \
+  V(195, 31) /* NOLINT */ \
+  V(196, 31) /* NOLINT */ \
+  V(197, 31) /* NOLINT */ \
+  V(198, 31) /* NOLINT */ \
+  V(199, 31) /* NOLINT */ \
+  V(200, 31) /* NOLINT */ \
+  V(201, 31) /* NOLINT */ \
+  V(202, 31) /* NOLINT */ \
+  V(203, 31) /* NOLINT */ \
+  V(204, 31) /* NOLINT */ \
+  V(205, 31) /* NOLINT */ \
+  V(206, 31) /* NOLINT */ \
+  V(207, 31) /* NOLINT */ \
+  V(208, 31) /* NOLINT */ \
+  V(209, 31) /* NOLINT */ \
+  V(210, 31) /* NOLINT */ \
+  V(211, 31) /* NOLINT */ \
+  V(212, 31) /* NOLINT */ \
+  V(213, 31) /* NOLINT */ \
+  V(214, 31) /* NOLINT */ \
+  V(215, 31) /* NOLINT */ \
+  V(216, 31) /* NOLINT */ \
+  V(217, 31) /* NOLINT */ \
+  V(218, 31) /* NOLINT */ \
+  V(219, 31) /* NOLINT */ \
+  V(220, 31) /* NOLINT */ \
+  V(221, 31) /* NOLINT */ \
+  V(222, 31) /* NOLINT */ \
+  V(223, 31) /* NOLINT */ \
+  V(224, 31) /* NOLINT */ \
+  V(225, 32) /* NOLINT */ \
+  V(226, 32) /* NOLINT */ \
+  V(227, 32) /* NOLINT */ \
+  V(228, 32) /* NOLINT */ \
+  V(229, 32) /* NOLINT */ \
+  V(230, 32) /* NOLINT */ \
+  V(231, 32) /* NOLINT */ \
+  V(232, 32) /* NOLINT */ \
+  V(233, 32) /* NOLINT */ \
+  V(234, 32) /* NOLINT */ \
+  V(235, 32) /* NOLINT */ \
+  V(236, 32) /* NOLINT */ \
+  V(237, 32) /* NOLINT */ \
+  V(238, 32) /* NOLINT */ \
+  V(239, 32) /* NOLINT */ \
+  V(240, 32) /* NOLINT */ \
+  V(241, 32) /* NOLINT */ \
+  V(242, 32) /* NOLINT */ \
+  V(243, 32) /* NOLINT */ \
+  V(244, 32) /* NOLINT */ \
+  V(245, 32) /* NOLINT */ \
+  V(246, 32) /* NOLINT */ \
+  V(247, 32) /* NOLINT */ \
+  V(248, 32) /* NOLINT */ \
+  V(249, 32) /* NOLINT */ \
+  V(250, 32) /* NOLINT */ \
+  V(251, 32) /* NOLINT */ \
+  V(252, 32) /* NOLINT */ \
+  V(253, 32) /* NOLINT */ \
+  V(254, 32) /* NOLINT */ \
+  V(255, 32) /* NOLINT */ \
+  V(256, 32) /* NOLINT */
 
 #endif  // SCALLOC_SIZE_CLASSES_RAW_H_
@@ -6,16 +6,17 @@
 #define SCALLOC_SPAN_H_
 
 #include <pthread.h>
+#include <stddef.h>
 
 #include <new>
 
 #include "core_id.h"
-#include "deque.h"
 #include "free_list.h"
 #include "globals.h"
 #include "lock.h"
 #include "log.h"
 #include "platform/assert.h"
+#include "reusable_spans.h"
 #include "span_pool.h"
 #include "stack.h"
 
@@ -29,8 +30,6 @@ extern std::atomic<int32_t> remote_frees;
 
 class Span {
  public:
-  static const int_fast32_t kAlignTag = 0xAAAAAAAA;
-
   static always_inline bool IsFloatingOrReusable(int32_t epoch) {
     return !IsFull(epoch) && !IsHot(epoch);
   }
@@ -47,19 +46,28 @@ class Span {
     return (epoch & kEpochFull);
   }
 
+  // The epoch a successful TryMarkFloating(epoch) leaves behind.
+  static always_inline int32_t FloatingEpoch(int32_t epoch) {
+    return epoch & kEpochOnlyValuesMask;
+  }
+
   static always_inline Span* FromObject(const void* p);
-  static always_inline Span* FromSpanLink(DoubleListNode* link);
+  static always_inline Span* FromSpanLink(ListNode* link);
   static always_inline Span* New(size_t size_class, core_id owner);
   static always_inline void Delete(Span* s);
 
   always_inline void* Allocate();
+  always_inline size_t AllocateBatch(void** objs, size_t n);
   always_inline int32_t Free(void* p, core_id caller);
-  always_inline void* AlignToBlockStart(void* p);
+  always_inline int32_t FreeRange(void* first, void* last, int32_t len,
+                                  core_id caller);
+  always_inline int32_t FreeRemoteRange(void* first, void* last, int32_t len);
   always_inline void MoveRemoteToLocalObjects();
+  always_inline void PrefetchNext() { local_free_list_.PrefetchNext(); }
 
   always_inline size_t size_class();
   always_inline core_id owner();
-  always_inline DoubleListNode* SpanLink();
+  always_inline ListNode* SpanLink();
   always_inline int32_t epoch();
   always_inline bool NewMarkHot(int32_t old_epoch);
   always_inline bool NewMarkFull(int32_t old_epoch);
@@ -68,14 +76,72 @@ class Span {
   always_inline bool TryMarkFloating(int32_t old_epoch);
   always_inline bool TryReviveNew(core_id old_owner, core_id caller);
 
+  // Linking a span into the ReusableSpans of its owner requires a link token,
+  // which the stack holds on to while the span is linked. A span that becomes
+  // full while someone holds the token is deleted when the token is released.
+  always_inline bool AcquireLink() {
+    int32_t unlinked = kUnlinked;
+    return link_state_.compare_exchange_strong(unlinked, kLinked);
+  }
+  // Returns true if the span has become full in the meantime, in which case
+  // the caller has to delete it.
+  always_inline bool ReleaseLink() {
+    return link_state_.exchange(kUnlinked) == kLinkedFull;
+  }
+  // Called after marking a span full. Returns true if the link token is held,
+  // i.e., the span must not be deleted by the caller.
+  always_inline bool DeferDelete() {
+    int32_t linked = kLinked;
+    return link_state_.compare_exchange_strong(linked, kLinkedFull);
+  }
+  // Only meaningful for the holder of the link token, for whom a deferred
+  // delete cannot be undone.
+  always_inline bool DeleteDeferred() {
+    return link_state_.load() == kLinkedFull;
+  }
+
   always_inline int_fast32_t NrFreeObjects() {
     return NrLocalObjects() + NrRemoteObjects();
   }
 
+  // The size class and the number of live objects in this span that are
+  // tracked by the heap profiler share a word, so that a free resolves both
+  // with a single load of the span header (see Core::Free()).
+  always_inline int32_t class_info() { return class_info_.load(); }
+  static always_inline int32_t SizeClassOf(int32_t class_info) {
+    return class_info & kClassInfoClassMask;
+  }
+  static always_inline bool IsSampled(int32_t class_info) {
+    return class_info >= kClassInfoSampledObject;
+  }
+  always_inline bool HasSampledObjects() { return IsSampled(class_info()); }
+  always_inline void AddSampledObject() {
+    class_info_.fetch_add(kClassInfoSampledObject);
+  }
+  always_inline void RemoveSampledObject() {
+    class_info_.fetch_sub(kClassInfoSampledObject);
+  }
+
+  // Spans of a core that retains its spans (see Heap) are chained up, so that
+  // they can be released without looking at their objects.
+  always_inline Span* next_retained() { return next_retained_; }
+  always_inline void set_next_retained(Span* s) { next_retained_ = s; }
+
 
  private:
   typedef Stack<64> RemoteFreeList;
 
+  enum ClassInfoLayout {
+    kClassInfoSampledObject = 1 << 8,
+    kClassInfoClassMask = kClassInfoSampledObject - 1
+  };
+
+  enum LinkState {
+    kUnlinked = 0,
+    kLinked = 1,
+    kLinkedFull = 2
+  };
+
   enum EpochBit {
     kHotBit = 31,
     kFullBit = 30,
@@ -105,10 +171,11 @@ class Span {
   always_inline Span(size_t sc, core_id owner);
   always_inline void CheckAlignments();
   always_inline intptr_t HeaderEnd();
+  always_inline intptr_t BlocksStart(size_t size_class);
 
   // This list is used to link up reusable spans in the corresponding core. The
   // first word is also used in the span pool to link up spans.
-  DoubleListNode span_link_;
+  ListNode span_link_;
 
   AtomicCoreID owner_;
 
@@ -116,19 +183,25 @@ class Span {
   // pool.
   std::atomic<int32_t> epoch_;
 
-  int32_t size_class_;
-  UNUSED  char padding_[8];
+  std::atomic<int32_t> class_info_;
+  std::atomic<int32_t> link_state_;
+  Span* next_retained_;
   IncrementalFreeList local_free_list_;
 
   RemoteFreeList remote_free_list_;
 };
 
+static_assert(sizeof(Span) == kSpanHeaderSize,
+              "size classes assume a different span header size");
+
 
 #define FOR_ALL_SPAN_FIELDS(V)                                                 \
   V(span_link_)                                                                \
   V(owner_)                                                                    \
   V(epoch_)                                                                    \
-  V(size_class_)                                                               \
+  V(class_info_)                                                               \
+  V(link_state_)                                                               \
+  V(next_retained_)                                                            \
   V(local_free_list_)                                                          \
   V(remote_free_list_)                                                         \
 
@@ -139,7 +212,7 @@ Span* Span::FromObject(const void* p) {
 }
 
 
-Span* Span::FromSpanLink(DoubleListNode* link) {
+Span* Span::FromSpanLink(ListNode* link) {
   return reinterpret_cast<Span*>(link);
 }
 
@@ -152,33 +225,27 @@ Span* Span::New(size_t size_class, core_id owner) {
 
 void Span::Delete(Span* s) {
   ScallocAssert(s->span_link_.next() == nullptr);
-  ScallocAssert(s->span_link_.prev() == nullptr);
+  ScallocAssert(s->link_state_.load() == kUnlinked);
   span_pool.Free(s->size_class(), s, s->owner().tag());
 }
 
 
-void* Span::AlignToBlockStart(void* p) {
-  // Check if realigning is needed.
-  if (*reinterpret_cast<int_fast32_t*>(
-          reinterpret_cast<uintptr_t>(p) - sizeof(int_fast32_t)) == kAlignTag) {
-    const uintptr_t d =
-        (reinterpret_cast<uintptr_t>(p) - HeaderEnd())
-          % ClassToSize[size_class_];
-    LOG(kWarning, "found aligned adr: %p", p);
-    p = reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(p) - d);
-    LOG(kWarning, "  fix to: %p", p);
-  }
-  return p;
-}
-
-
 Span::Span(size_t size_class, core_id owner)
     : span_link_()
     , owner_(owner)
-    , size_class_(size_class)
-    , local_free_list_(HeaderEnd(), size_class)
+    , class_info_(size_class)
+    , link_state_(kUnlinked)
+    , local_free_list_(BlocksStart(size_class), size_class)
     , remote_free_list_() {
-  ScallocAssert(local_free_list_.Length() == ClassToObjects[size_class]);
+#ifdef SCALLOC_HUGEPAGES
+  // Purged spans only keep their leading fields, most importantly the epoch.
+  static_assert(offsetof(Span, class_info_) + sizeof(class_info_) ==
+                SpanPool::kPreservedHeaderSize,
+                "span pool preserves a different part of the span header");
+#endif  // SCALLOC_HUGEPAGES
+  static_assert(kNumClasses <= kClassInfoSampledObject,
+                "size classes do not fit into the class info");
+  ScallocAssert(local_free_list_.Length() == ClassInfo[size_class].objects);
   ScallocAssert(remote_free_list_.Length() == 0);
   ScallocAssert(owner.value() != nullptr);
 
@@ -191,7 +258,7 @@ Span::Span(size_t size_class, core_id owner)
 }
 
 
-size_t Span::size_class() { return size_class_; }
+size_t Span::size_class() { return SizeClassOf(class_info()); }
 core_id Span::owner() { return owner_.load(); }
 int32_t Span::epoch() { return epoch_.load(); }
 
@@ -208,8 +275,14 @@ intptr_t Span::HeaderEnd() {
 }
 
 
-DoubleListNode* Span::SpanLink() {
-  ScallocAssert(&span_link_ == reinterpret_cast<DoubleListNode*>(this));
+intptr_t Span::BlocksStart(size_t size_class) {
+  return reinterpret_cast<intptr_t>(this) +
+         ClassBlockOffset(size_class, ClassInfo[size_class].size);
+}
+
+
+ListNode* Span::SpanLink() {
+  ScallocAssert(&span_link_ == reinterpret_cast<ListNode*>(this));
   return &span_link_;
 }
 
@@ -246,7 +319,7 @@ void Span::NewMarkFloating() {
 
 
 bool Span::TryMarkFloating(int32_t old_epoch) {
-  int32_t new_epoch = old_epoch & kEpochOnlyValuesMask;
+  int32_t new_epoch = FloatingEpoch(old_epoch);
   return epoch_.compare_exchange_strong(old_epoch, new_epoch);
 }
 
@@ -278,6 +351,11 @@ void* Span::Allocate() {
 }
 
 
+size_t Span::AllocateBatch(void** objs, size_t n) {
+  return local_free_list_.PopBatch(objs, n);
+}
+
+
 int32_t Span::Free(void* p, core_id caller) {
   if (owner() == caller) {  // Local free.
 #ifdef PROFILE
@@ -292,13 +370,41 @@ int32_t Span::Free(void* p, core_id caller) {
   }
 }
 
+// Returns a chain of len objects, linked from first to last, like Free().
+// Returns the number of free objects.
+int32_t Span::FreeRange(void* first, void* last, int32_t len,
+                        core_id caller) {
+  if (owner() == caller) {
+#ifdef PROFILE
+    local_frees.fetch_add(len);
+#endif  // PROFILE
+    return local_free_list_.PushRange(first, last, len) + NrRemoteObjects();
+  }
+  return FreeRemoteRange(first, last, len);
+}
+
+
+// Publishes a chain of len objects, linked from first to last, on the remote
+// free list with a single CAS. Returns the number of free objects.
+int32_t Span::FreeRemoteRange(void* first, void* last, int32_t len) {
+#ifdef PROFILE
+  remote_frees.fetch_add(len);
+#endif  // PROFILE
+  return remote_free_list_.PushRangeReturnTag(first, last, len) +
+         NrLocalObjects();
+}
+
+
 always_inline void Span::MoveRemoteToLocalObjects() {
   if (NrRemoteObjects() != 0) {
     int32_t actual_len = 0;
     void* objects = nullptr;
     remote_free_list_.PopAll(&objects, &actual_len);
     if (NrLocalObjects() == 0) {
+      // The objects have been freed by other cores and are most likely not in
+      // our cache. Taking over the list does not touch them.
       local_free_list_.SetList(objects, actual_len);
+      local_free_list_.PrefetchNext();
       return;
     }
     void* next;
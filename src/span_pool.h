@@ -5,13 +5,16 @@
 #ifndef SCALLOC_SPAN_POOL_H_
 #define SCALLOC_SPAN_POOL_H_
 
+#include <string.h>
 #include <sys/mman.h>
 
 #include <atomic>
 
 #include "arena.h"
+#include "config.h"
 #include "globals.h"
 #include "lock.h"
+#include "numa.h"
 #include "size_classes.h"
 #include "stack.h"
 
@@ -30,6 +33,38 @@ class SpanPool {
   always_inline void AnnounceNewThread();
   always_inline void AnnounceLeavingThread();
 
+  // Purges all dirty spans right away. Returns the number of purged bytes.
+  inline uint64_t Purge();
+  // Restarts the decay period after it has been changed (see Config).
+  inline void DecayChanged();
+#ifdef SCALLOC_MADVISE_DECAY
+  // Ends the current decay period if it is over, purging the spans that have
+  // not been needed during the period.
+  always_inline void MaybePurge();
+  // Time (in ms) until the current decay period is over.
+  always_inline int64_t MsUntilPurge() {
+    const uint64_t next = next_purge_.load(std::memory_order_relaxed);
+    const uint64_t now = NowMs();
+    return (next > now) ? static_cast<int64_t>(next - now) : 0;
+  }
+#endif  // SCALLOC_MADVISE_DECAY
+
+  // Statistics. Depths are only approximate under concurrent use. Depths of a
+  // backend are summed up over all NUMA nodes.
+  always_inline int32_t limit() { return limit_.load(); }
+  always_inline int32_t Depth(int32_t slot, int32_t backend);
+  always_inline int32_t DirtyDepth(int32_t slot, int32_t backend);
+  always_inline int32_t NodeDepth(int32_t node);
+  always_inline uint64_t MadvisedBytes() { return madvised_bytes_.load(); }
+
+  static const int32_t kSizeClassSlots = kNumClasses - kFineClasses + 1;
+
+#ifdef SCALLOC_HUGEPAGES
+  // Bytes at the start of a span that survive the span pool, i.e., the span
+  // header up to the size class info (see Span::Span()).
+  static const size_t kPreservedHeaderSize = 24;
+#endif  // SCALLOC_HUGEPAGES
+
 #ifdef PROFILE
   inline void PrintProfileSummary() {
     LOG(kWarning,
@@ -39,16 +74,169 @@ class SpanPool {
 #endif  // PROFILE
 
  private:
-  static const int32_t kSizeClassSlots = kCoarseClasses + 1;
-#if defined(SCALLOC_SPAN_POOL_BACKEND_LIMIT)
-  static const int32_t kHardLimit = SCALLOC_SPAN_POOL_BACKEND_LIMIT;
+#ifdef SCALLOC_HUGEPAGES
+  // Purging releases whole hugepages, including the span header. Clean spans
+  // are thus linked through records outside of the object space, which also
+  // keep their headers.
+  struct CleanRecord {
+    void* next;
+    uint8_t header[kPreservedHeaderSize];
+  };
+
+  static always_inline CleanRecord* RecordOf(void* p) {
+    return &clean_records_[
+        (reinterpret_cast<uintptr_t>(p) - object_space.start(0)) /
+        kVirtualSpanSize];
+  }
+
+  static always_inline void** CleanLink(void* p) {
+    return &RecordOf(p)->next;
+  }
+
+  static always_inline void SaveHeader(void* p) {
+    memcpy(RecordOf(p)->header, p, kPreservedHeaderSize);
+  }
+
+  static always_inline void RestoreHeader(void* p) {
+    memcpy(p, RecordOf(p)->header, kPreservedHeaderSize);
+  }
+
+  static CleanRecord* clean_records_;
+
+  typedef Stack<0, CleanLink> CleanStack;
 #else
-  static const int32_t kHardLimit = 16384;
-#endif  // SCALLOC_SPAN_POOL_BACKEND_LIMIT
+  typedef Stack<0> CleanStack;
+#endif  // SCALLOC_HUGEPAGES
+
+  // The spans of a backend. Spans that have been returned without purging
+  // their memory are kept on a separate dirty stack, which is preferred for
+  // reuse. Counters live on the same cache line as the tops of the stacks.
+  class Backend {
+   public:
+    always_inline void Push(void* p, bool dirty) {
+      depth_.fetch_add(1, std::memory_order_relaxed);
+      if (dirty) {
+        dirty_depth_.fetch_add(1, std::memory_order_relaxed);
+        dirty_.Push(p);
+      } else {
+        clean_.Push(p);
+      }
+    }
 
-  typedef Stack<64> Backend;
+    always_inline void* Pop(bool* dirty) {
+      void* p = dirty_.Pop();
+      if (p != nullptr) {
+        *dirty = true;
+        const int32_t left =
+            dirty_depth_.fetch_sub(1, std::memory_order_relaxed) - 1;
+        if (left < low_water_.load(std::memory_order_relaxed)) {
+          low_water_.store(left, std::memory_order_relaxed);
+        }
+      } else {
+        *dirty = false;
+        p = clean_.Pop();
+#ifdef SCALLOC_HUGEPAGES
+        if (p != nullptr) {
+          RestoreHeader(p);
+        }
+#endif  // SCALLOC_HUGEPAGES
+      }
+      if (p != nullptr) {
+        depth_.fetch_sub(1, std::memory_order_relaxed);
+      }
+      return p;
+    }
 
-  always_inline int32_t limit() { return limit_.load(); }
+#ifdef SCALLOC_MADVISE_DECAY
+    // Moves dirty spans that have not been needed since the last call, i.e.,
+    // the low water mark of the dirty stack, or all dirty spans, to the clean
+    // stack, purging them on the way. Returns the number of purged spans.
+    //
+    // The spans that have not been needed are the oldest ones at the bottom of
+    // the stack. The whole stack is taken off, and the spans above the low
+    // water mark are pushed back in order. Pops in the meantime fall back to
+    // the clean stack.
+    always_inline int32_t Purge(SpanPool* pool, bool all) {
+      const int32_t n = all ?
+          INT32_MAX : low_water_.load(std::memory_order_relaxed);
+      if (n <= 0) {
+        low_water_.store(dirty_depth_.load(std::memory_order_relaxed),
+                         std::memory_order_relaxed);
+        return 0;
+      }
+      void* top = dirty_.TakeAll();
+      int32_t len = 0;
+      for (void* p = top; p != nullptr; p = *InlineLink(p)) {
+        len++;
+      }
+      const int32_t keep = (len > n) ? (len - n) : 0;
+      void* last = nullptr;
+      void* p = top;
+      for (int32_t i = 0; i < keep; i++) {
+        last = p;
+        p = *InlineLink(p);
+      }
+      if (last != nullptr) {
+        dirty_.PushRange(top, last);
+      }
+      int32_t i = 0;
+      void* next;
+      for (; p != nullptr; p = next, i++) {
+        next = *InlineLink(p);
+        dirty_depth_.fetch_sub(1, std::memory_order_relaxed);
+        pool->PurgeSpan(p, all);
+        clean_.Push(p);
+      }
+      low_water_.store(dirty_depth_.load(std::memory_order_relaxed),
+                       std::memory_order_relaxed);
+      return i;
+    }
+#endif  // SCALLOC_MADVISE_DECAY
+
+    always_inline int32_t Depth() {
+      return depth_.load(std::memory_order_relaxed);
+    }
+
+    always_inline int32_t DirtyDepth() {
+      return dirty_depth_.load(std::memory_order_relaxed);
+    }
+
+   private:
+    Stack<0> dirty_;
+    CleanStack clean_;
+    std::atomic<int32_t> depth_;
+    std::atomic<int32_t> dirty_depth_;
+    std::atomic<int32_t> low_water_;
+    UNUSED uint8_t pad_[64 - ((sizeof(dirty_) +
+                               sizeof(clean_) +
+                               sizeof(depth_) +
+                               sizeof(dirty_depth_) +
+                               sizeof(low_water_)) % 64)];
+  };
+
+  always_inline Backend* BackendsOf(int32_t slot, int32_t node) {
+    return &spans_[slot][node * backends_per_node_];
+  }
+
+  // Pops a span from a node, looking at the backend for id first and at all
+  // other backends and slots of the node afterwards. Returns the slot in
+  // *slot.
+  always_inline void* PopFromNode(int32_t size_class_slot, int32_t node,
+                                  int32_t id, int32_t* slot, bool* dirty);
+
+  always_inline void Madvised(size_t len) {
+    madvised_bytes_.fetch_add(len, std::memory_order_relaxed);
+  }
+
+#if defined(SCALLOC_MADVISE_DECAY) || \
+    (defined(SCALLOC_HUGEPAGES) && defined(SCALLOC_MADVISE_EAGER))
+  // Spans that are purged right away (see Purge()) are released with
+  // MADV_DONTNEED, so that the memory is gone when we return.
+  always_inline void PurgeSpan(void* p, bool now = false);
+#endif  // SCALLOC_MADVISE_DECAY || (SCALLOC_HUGEPAGES && SCALLOC_MADVISE_EAGER)
+#ifdef SCALLOC_MADVISE_DECAY
+  inline void PurgeAll(bool all);
+#endif  // SCALLOC_MADVISE_DECAY
 
   // The currently announced number of threads.
   std::atomic<int32_t> current_threads_;
@@ -59,7 +247,19 @@ class SpanPool {
 
   UNUSED uint8_t pad_[64 - ((sizeof(limit_) + sizeof(current_threads_))  % 64)];  // NOLINT
 
+  // Per slot, CpusOnline() backends for each NUMA node.
   Backend* spans_[kSizeClassSlots];
+  int32_t backends_per_node_;
+
+  std::atomic<uint64_t> madvised_bytes_;
+
+#ifdef SCALLOC_MADVISE_DECAY
+  // Time (in ms) of the next purge. The thread that advances it does the
+  // purging.
+  std::atomic<uint64_t> next_purge_;
+  // MADV_FREE, or MADV_DONTNEED if the kernel does not know MADV_FREE.
+  std::atomic<int> purge_advice_;
+#endif  // SCALLOC_MADVISE_DECAY
 
 #ifdef PROFILE
   std::atomic<int32_t> nr_allocate_;
@@ -69,18 +269,66 @@ class SpanPool {
 };
 
 
+#ifdef SCALLOC_HUGEPAGES
+SpanPool::CleanRecord* SpanPool::clean_records_;
+#endif  // SCALLOC_HUGEPAGES
+
+
 void SpanPool::Init() {
   current_threads_ = 0;
   limit_ = 0;
+  madvised_bytes_ = 0;
+#ifdef SCALLOC_MADVISE_DECAY
+  next_purge_ = NowMs() + config.madvise_decay_ms();
+#if defined(MADV_FREE)
+  purge_advice_ = MADV_FREE;
+#else
+  purge_advice_ = MADV_DONTNEED;
+#endif  // MADV_FREE
+#endif  // SCALLOC_MADVISE_DECAY
 #ifdef PROFILE
   nr_allocate_ = 0;
   nr_free_ = 0;
   nr_madvise_ = 0;
 #endif  // PROFILE
+#ifdef SCALLOC_HUGEPAGES
+  clean_records_ = reinterpret_cast<CleanRecord*>(SystemMmapFail(
+      (kObjectSpaceSize / kVirtualSpanSize) * sizeof(CleanRecord)));
+#endif  // SCALLOC_HUGEPAGES
+  backends_per_node_ = CpusOnline();
   for (size_t i = 0; i < kSizeClassSlots; i++) {
-    spans_[i] = reinterpret_cast<Backend*>(
-        SystemMmapFail(sizeof(Backend) * CpusOnline()));
+    spans_[i] = reinterpret_cast<Backend*>(SystemMmapFail(
+        sizeof(Backend) * backends_per_node_ * numa_topology.nodes()));
+  }
+}
+
+
+int32_t SpanPool::Depth(int32_t slot, int32_t backend) {
+  int32_t depth = 0;
+  for (int32_t node = 0; node < numa_topology.nodes(); node++) {
+    depth += BackendsOf(slot, node)[backend].Depth();
+  }
+  return depth;
+}
+
+
+int32_t SpanPool::DirtyDepth(int32_t slot, int32_t backend) {
+  int32_t depth = 0;
+  for (int32_t node = 0; node < numa_topology.nodes(); node++) {
+    depth += BackendsOf(slot, node)[backend].DirtyDepth();
+  }
+  return depth;
+}
+
+
+int32_t SpanPool::NodeDepth(int32_t node) {
+  int32_t depth = 0;
+  for (int32_t i = 0; i < kSizeClassSlots; i++) {
+    for (int32_t j = 0; j < limit(); j++) {
+      depth += BackendsOf(i, node)[j].Depth();
+    }
   }
+  return depth;
 }
 
 
@@ -89,7 +337,7 @@ void SpanPool::AnnounceNewThread() {
   const int_fast32_t cpus = CpusOnline();
   int32_t old_limit;
   int32_t new_limit = current_threads_.fetch_add(1) + 1;
-  if ((new_limit > cpus) || (new_limit > kHardLimit)) {
+  if ((new_limit > cpus) || (new_limit > config.span_pool_backend_limit())) {
     return;
   }
   do {
@@ -119,40 +367,50 @@ void*  SpanPool::Allocate(size_t size_class, int32_t id) {
   } else {
     size_class_slot = size_class - kFineClasses;
   }
-  int32_t i = size_class_slot;
-  void* s = spans_[size_class_slot][id % limit()].Pop();
-  for (size_t _i = 0; (s == nullptr) && (_i < kSizeClassSlots); _i++) {
-    i  = size_class_slot - _i;
-    if (i < 0) { i += kSizeClassSlots; }
-
-    const uint64_t start = hwrand() % limit();
-    LOG(kTrace, "start: %lu", start);
-    for (int_fast32_t _j = 0; (_j < limit()) && (s == nullptr); _j++) {
-      s = spans_[i][(start + _j) % limit()].Pop();
-    }
+  // Spans of the local node come first. Spans of other nodes are only
+  // used as a fallback before taking fresh address space.
+  const int32_t nodes = numa_topology.nodes();
+  const int32_t node = numa_topology.CurrentNode();
+  int32_t i;
+  bool dirty;
+  void* s = nullptr;
+  for (int32_t _n = 0; (s == nullptr) && (_n < nodes); _n++) {
+    s = PopFromNode(size_class_slot, (node + _n) % nodes, id, &i, &dirty);
   }
 
   if (s == NULL) {
-    s =  object_space.AllocateVirtualSpan();
+    s =  object_space.AllocateVirtualSpan(node);
   } else {
 #if defined(SCALLOC_MADVISE) && !defined(SCALLOC_MADVISE_EAGER)
+#if defined(SCALLOC_MADVISE_DECAY)
+    // Purged spans are clean anyways. Without purging, spans are kept as is.
+    const bool trim = dirty && (config.madvise_decay_ms() >= 0);
+#else
+    const bool trim = true;
+#endif  // SCALLOC_MADVISE_DECAY
     // madvise for any of the non-fine size classes
-    if ((i > 0) && (ClassToSpanSize[i + kFineClasses] > ClassToSpanSize[size_class])) {
+    if (trim && (i > 0) &&
+        (ClassInfo[i + kFineClasses].span_size >
+            ClassInfo[size_class].span_size)) {
       madvise(
           reinterpret_cast<void*>(
-              reinterpret_cast<uintptr_t>(s) + ClassToSpanSize[size_class]),
-          kVirtualSpanSize - ClassToSpanSize[size_class],
+              reinterpret_cast<uintptr_t>(s) + ClassInfo[size_class].span_size),
+          kVirtualSpanSize - ClassInfo[size_class].span_size,
           MADV_DONTNEED);
+      Madvised(kVirtualSpanSize - ClassInfo[size_class].span_size);
 #ifdef PROFILE
       nr_madvise_.fetch_add(1);
 #endif  // PROFILE
     }
 #endif  // MADVISE && !MADVISE_EAGER
   }
+#ifdef SCALLOC_MADVISE_DECAY
+  MaybePurge();
+#endif  // SCALLOC_MADVISE_DECAY
 #if defined(SCALLOC_STRICT_PROTECT)
   if (mprotect(
           s,
-          ClassToSpanSize[size_class],
+          ClassInfo[size_class].span_size,
           PROT_READ | PROT_WRITE) != 0) {
     Fatal("mprotect failed");
   }
@@ -161,6 +419,26 @@ void*  SpanPool::Allocate(size_t size_class, int32_t id) {
 }
 
 
+void* SpanPool::PopFromNode(int32_t size_class_slot, int32_t node,
+                            int32_t id, int32_t* slot, bool* dirty) {
+  int32_t i = size_class_slot;
+  void* s = BackendsOf(size_class_slot, node)[id % limit()].Pop(dirty);
+  for (size_t _i = 0; (s == nullptr) && (_i < kSizeClassSlots); _i++) {
+    i  = size_class_slot - _i;
+    if (i < 0) { i += kSizeClassSlots; }
+
+    const uint64_t start = hwrand() % limit();
+    LOG(kTrace, "start: %lu", start);
+    Backend* backends = BackendsOf(i, node);
+    for (int_fast32_t _j = 0; (_j < limit()) && (s == nullptr); _j++) {
+      s = backends[(start + _j) % limit()].Pop(dirty);
+    }
+  }
+  *slot = i;
+  return s;
+}
+
+
 void SpanPool::Free(size_t size_class, void* p, int32_t id) {
 #ifdef PROFILE
   nr_free_.fetch_add(1);
@@ -168,16 +446,25 @@ void SpanPool::Free(size_t size_class, void* p, int32_t id) {
   LOG(kTrace, "span pool put %p, size class: %lu", p, size_class);
   ScallocAssert(limit() != 0);
 #if defined(SCALLOC_MADVISE) && defined(SCALLOC_MADVISE_EAGER)
+#ifdef SCALLOC_HUGEPAGES
+  // Spans of all size classes cover a whole hugepage.
+  PurgeSpan(p);
+#else
   if (size_class >= 17) {
     madvise(
         reinterpret_cast<void*>(
             reinterpret_cast<uintptr_t>(p) + kPageSize),
         kVirtualSpanSize - kPageSize,
         MADV_DONTNEED);
+    Madvised(kVirtualSpanSize - kPageSize);
 #ifdef PROFILE
     nr_madvise_.fetch_add(1);
 #endif  // PROFILE
   }
+#endif  // SCALLOC_HUGEPAGES
+#elif defined(SCALLOC_HUGEPAGES) && !defined(SCALLOC_MADVISE_DECAY)
+  // The span goes to a clean stack, see CleanRecord.
+  SaveHeader(p);
 #endif  // MADVISE && MADVISE_EAGER
   if (size_class  <= kFineClasses) {
     size_class = 0;
@@ -192,7 +479,111 @@ void SpanPool::Free(size_t size_class, void* p, int32_t id) {
     Fatal("mprotect failed");
   }
 #endif  // SCALLOC_STRICT_PROTECT
-  spans_[size_class][id % limit()].Push(p);
+  // Spans always go back to the node their memory is bound to.
+  Backend* backends = BackendsOf(size_class, object_space.PartitionOf(p));
+#if defined(SCALLOC_MADVISE_DECAY)
+  if (config.madvise_decay_ms() == 0) {
+    PurgeSpan(p);
+    backends[id % limit()].Push(p, false);
+  } else {
+    // Purging is deferred, see MaybePurge().
+    backends[id % limit()].Push(p, true);
+    MaybePurge();
+  }
+#else
+  backends[id % limit()].Push(p, false);
+#endif  // SCALLOC_MADVISE_DECAY
+}
+
+
+#if defined(SCALLOC_MADVISE_DECAY) || \
+    (defined(SCALLOC_HUGEPAGES) && defined(SCALLOC_MADVISE_EAGER))
+void SpanPool::PurgeSpan(void* p, bool now) {
+#ifdef SCALLOC_HUGEPAGES
+  // Release the hugepage as a whole, partially purging it would split it.
+  SaveHeader(p);
+  void* start = p;
+  const size_t len = kVirtualSpanSize;
+#else
+  // Keep the page holding the span header.
+  void* start = reinterpret_cast<void*>(
+      reinterpret_cast<uintptr_t>(p) + kPageSize);
+  const size_t len = kVirtualSpanSize - kPageSize;
+#endif  // SCALLOC_HUGEPAGES
+#ifdef SCALLOC_MADVISE_DECAY
+  if (madvise(start, len, now ? MADV_DONTNEED : purge_advice_.load()) != 0) {
+    purge_advice_.store(MADV_DONTNEED);
+    madvise(start, len, MADV_DONTNEED);
+  }
+#else
+  madvise(start, len, MADV_DONTNEED);
+#endif  // SCALLOC_MADVISE_DECAY
+  Madvised(len);
+#ifdef PROFILE
+  nr_madvise_.fetch_add(1);
+#endif  // PROFILE
+}
+#endif  // SCALLOC_MADVISE_DECAY || (SCALLOC_HUGEPAGES && SCALLOC_MADVISE_EAGER)
+
+
+#ifdef SCALLOC_MADVISE_DECAY
+// Spans that have been sitting dirty in a backend for a whole decay period
+// are purged in batches by whichever thread first notices that the period is
+// over, or by the background purger (see BackgroundPurger). A negative decay
+// period disables purging.
+void SpanPool::MaybePurge() {
+  const int64_t decay_ms = config.madvise_decay_ms();
+  if (decay_ms < 0) {
+    return;
+  }
+  uint64_t next = next_purge_.load(std::memory_order_relaxed);
+  const uint64_t now = NowMs();
+  if (LIKELY(now < next)) {
+    return;
+  }
+  if (!next_purge_.compare_exchange_strong(next, now + decay_ms)) {
+    return;
+  }
+  PurgeAll(false);
+}
+
+
+void SpanPool::PurgeAll(bool all) {
+  const int32_t backends = limit();
+  for (int32_t i = 0; i < kSizeClassSlots; i++) {
+    for (int32_t node = 0; node < numa_topology.nodes(); node++) {
+      for (int32_t j = 0; j < backends; j++) {
+        BackendsOf(i, node)[j].Purge(this, all);
+      }
+    }
+  }
+}
+#endif  // SCALLOC_MADVISE_DECAY
+
+
+// Without decay, spans are purged when they are returned (or never).
+uint64_t SpanPool::Purge() {
+#ifdef SCALLOC_MADVISE_DECAY
+  const uint64_t before = MadvisedBytes();
+  PurgeAll(true);
+  return MadvisedBytes() - before;
+#else
+  return 0;
+#endif  // SCALLOC_MADVISE_DECAY
+}
+
+
+// Dirty spans that are left over when switching to eager purging would never
+// be purged otherwise.
+void SpanPool::DecayChanged() {
+#ifdef SCALLOC_MADVISE_DECAY
+  const int64_t decay_ms = config.madvise_decay_ms();
+  if (decay_ms == 0) {
+    PurgeAll(true);
+  } else if (decay_ms > 0) {
+    next_purge_.store(NowMs() + decay_ms);
+  }
+#endif  // SCALLOC_MADVISE_DECAY
 }
 
 }  // namespace scalloc
@@ -16,11 +16,19 @@
 
 namespace scalloc {
 
+// Returns where the next pointer of element p is stored, which by default is
+// the first word of p.
+always_inline void** InlineLink(void* p) {
+  return reinterpret_cast<void**>(p);
+}
+
+
 // Treiber stack
 //
-// Note: The implementation stores the next pointers in the memory provided, and
-// thus needs blocks of at least sizeof(TaggedValue).
-template<int PAD = 64>
+// Note: By default, the implementation stores the next pointers in the memory
+// provided, and thus needs blocks of at least sizeof(TaggedValue). Link
+// allows keeping them elsewhere.
+template<int PAD = 64, void** (*Link)(void*) = InlineLink>
 class Stack {
  public:
   always_inline Stack() : top_(TaggedValue<void*>(nullptr, 0)) { }
@@ -28,6 +36,7 @@ class Stack {
   always_inline void PushRange(void* p_start, void* p_end);
   always_inline void* Pop();
   always_inline void PopAll(void** elements, int32_t* len);
+  always_inline void* TakeAll();
   always_inline int_fast32_t Length();
 
   always_inline void SetTop(void* p);
@@ -37,6 +46,8 @@ class Stack {
   }
 
   always_inline int32_t PushReturnTag(void* p);
+  always_inline int32_t PushRangeReturnTag(void* p_start, void* p_end,
+                                           int32_t len);
 
  private:
   typedef TaggedValue<void*> TopPtr;
@@ -47,46 +58,60 @@ class Stack {
 };
 
 
-template<int PAD>
-void Stack<PAD>::SetTop(void* p) {
+template<int PAD, void** (*Link)(void*)>
+void Stack<PAD, Link>::SetTop(void* p) {
   top_.store(TopPtr(p, 0));
 }
 
 
-template<int PAD>
-int32_t Stack<PAD>::PushReturnTag(void* p) {
+template<int PAD, void** (*Link)(void*)>
+int32_t Stack<PAD, Link>::PushReturnTag(void* p) {
   TopPtr top_old;
   do {
     top_old = top_.load();
-    *(reinterpret_cast<void**>(p)) = top_old.value();
+    *Link(p) = top_old.value();
   } while (!top_.swap(top_old, TopPtr(p, top_old.tag() + 1)));
   return top_old.tag() + 1;
 }
 
 
-template<int PAD>
-void Stack<PAD>::Push(void* p) {
+// Pushes a range of len elements that is already linked up and bumps the tag by
+// len, keeping the tag a valid length for PopAll().
+template<int PAD, void** (*Link)(void*)>
+int32_t Stack<PAD, Link>::PushRangeReturnTag(void* p_start, void* p_end,
+                                       int32_t len) {
+  TopPtr top_old;
+  do {
+    top_old = top_.load();
+    *Link(p_end) = top_old.value();
+  } while (!top_.swap(top_old, TopPtr(p_start, top_old.tag() + len)));
+  return top_old.tag() + len;
+}
+
+
+template<int PAD, void** (*Link)(void*)>
+void Stack<PAD, Link>::Push(void* p) {
   LOG(kTrace, "push %p", p);
   TopPtr top_old;
   do {
     top_old = top_.load();
-    *(reinterpret_cast<void**>(p)) = top_old.value();
+    *Link(p) = top_old.value();
   } while (!top_.swap(top_old, TopPtr(p, top_old.tag() + 1)));
 }
 
 
-template<int PAD>
-void Stack<PAD>::PushRange(void* p_start, void* p_end) {
+template<int PAD, void** (*Link)(void*)>
+void Stack<PAD, Link>::PushRange(void* p_start, void* p_end) {
   TopPtr top_old;
   do {
     top_old = top_.load();
-    *(reinterpret_cast<void**>(p_end)) = top_old.value();
+    *Link(p_end) = top_old.value();
   } while (!top_.swap(top_old, TopPtr(p_start, top_old.tag() + 1)));
 }
 
 
-template<int PAD>
-void* Stack<PAD>::Pop() {
+template<int PAD, void** (*Link)(void*)>
+void* Stack<PAD, Link>::Pop() {
   TopPtr top_old;
   do {
     top_old = top_.load();
@@ -94,7 +119,7 @@ void* Stack<PAD>::Pop() {
       return NULL;
     }
   } while (!top_.swap(
-      top_old, TopPtr(*(reinterpret_cast<void**>(top_old.value())),
+      top_old, TopPtr(*Link(top_old.value()),
                       top_old.tag() + 1)));
   LOG(kTrace, "pop  %p", top_old.value());
   return top_old.value();
@@ -103,8 +128,8 @@ void* Stack<PAD>::Pop() {
 
 // Returns the length of the list returned iff there have not been any pop()
 // operations in between.
-template<int PAD>
-void Stack<PAD>::PopAll(void** elements, int32_t* len) {
+template<int PAD, void** (*Link)(void*)>
+void Stack<PAD, Link>::PopAll(void** elements, int32_t* len) {
   TopPtr top_old;
   do {
     top_old = top_.load();
@@ -117,10 +142,26 @@ void Stack<PAD>::PopAll(void** elements, int32_t* len) {
 }
 
 
+// Removes all elements and returns them chained up. Unlike PopAll(), which
+// resets the tag to a length of 0, the tag keeps counting, so that concurrent
+// Pop() calls cannot mistake a refilled stack for the one they have observed.
+template<int PAD, void** (*Link)(void*)>
+void* Stack<PAD, Link>::TakeAll() {
+  TopPtr top_old;
+  do {
+    top_old = top_.load();
+    if (top_old.value() == NULL) {
+      return NULL;
+    }
+  } while (!top_.swap(top_old, TopPtr(NULL, top_old.tag() + 1)));
+  return top_old.value();
+}
+
+
 // Returns the length of the list returned iff there have not been any pop()
 // operations in between.
-template<int PAD>
-int_fast32_t Stack<PAD>::Length() {
+template<int PAD, void** (*Link)(void*)>
+int_fast32_t Stack<PAD, Link>::Length() {
   return top_.load().tag();
 }
 
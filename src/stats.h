@@ -0,0 +1,233 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+#ifndef SCALLOC_STATS_H_
+#define SCALLOC_STATS_H_
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "core.h"
+#include "globals.h"
+#include "large-objects.h"
+#include "large_object_cache.h"
+#include "lock.h"
+#include "numa.h"
+#include "size_classes.h"
+#include "span.h"
+#include "span_pool.h"
+
+namespace scalloc {
+
+struct SizeClassStats {
+  uint64_t spans;
+  uint64_t live_objects;
+  uint64_t free_objects;
+};
+
+
+// A snapshot of heap statistics. Nothing is maintained on the fast paths, a
+// snapshot is taken by walking the headers of all spans in the object space
+// (see Refresh()). Objects held in thread caches or remote free buffers are
+// accounted as live by their spans.
+class HeapStats {
+ public:
+  // Globally constructed, hence we use staged construction.
+  always_inline HeapStats() {}
+  always_inline ~HeapStats() {}
+
+  // Takes a new snapshot and returns the new epoch.
+  inline uint64_t Refresh();
+  inline void Print(int fd);
+
+  always_inline uint64_t epoch() { return epoch_; }
+
+  // Bytes of live objects, including large objects.
+  always_inline uint64_t allocated() {
+    return small_allocated_ + LargeObject::MappedBytes();
+  }
+  // Virtual memory handed out by the object space plus large objects
+  // (including cached mappings).
+  always_inline uint64_t mapped() {
+    return object_space_used_ + LargeObject::MappedBytes() +
+           large_object_cache.CachedBytes();
+  }
+  always_inline uint64_t small_allocated() { return small_allocated_; }
+  always_inline uint64_t small_free() { return small_free_; }
+  always_inline uint64_t object_space_used() { return object_space_used_; }
+  always_inline uint64_t spans_hot() { return spans_hot_; }
+  always_inline uint64_t spans_floating() { return spans_floating_; }
+  always_inline uint64_t spans_reusable() { return spans_reusable_; }
+  always_inline uint64_t spans_full() { return spans_full_; }
+  always_inline const SizeClassStats& size_class(int32_t sc) {
+    return classes_[sc];
+  }
+
+ private:
+  typedef SpinLock<64> Lock;
+
+  static inline void Printf(int fd, const char* format, ...);
+
+  // Accounts the spans in [start, end). Requires the lock.
+  inline void RefreshRange(uintptr_t start, uintptr_t end);
+
+  Lock lock_;
+  uint64_t epoch_;
+  uint64_t object_space_used_;
+  uint64_t small_allocated_;
+  uint64_t small_free_;
+  uint64_t spans_hot_;
+  uint64_t spans_floating_;
+  uint64_t spans_reusable_;
+  uint64_t spans_full_;
+  SizeClassStats classes_[kNumClasses];
+};
+
+
+uint64_t HeapStats::Refresh() {
+  Lock::Guard guard(lock_);
+  object_space_used_ = 0;
+  small_allocated_ = 0;
+  small_free_ = 0;
+  spans_hot_ = 0;
+  spans_floating_ = 0;
+  spans_reusable_ = 0;
+  spans_full_ = 0;
+  memset(classes_, 0, sizeof(classes_));
+
+  uintptr_t start;
+  uintptr_t end;
+  for (int32_t i = 0; i < object_space.partitions(); i++) {
+    start = object_space.start(i);
+    end = object_space.current(i);
+    object_space_used_ += end - start;
+    RefreshRange(start, end);
+  }
+
+  for (int32_t i = 1; i < kNumClasses; i++) {
+    small_allocated_ += classes_[i].live_objects * ClassInfo[i].size;
+    small_free_ += classes_[i].free_objects * ClassInfo[i].size;
+  }
+  return ++epoch_;
+}
+
+
+void HeapStats::RefreshRange(uintptr_t start, uintptr_t end) {
+  Span* s;
+  int32_t epoch;
+  int32_t sc;
+  int64_t free_objects;
+  for (uintptr_t addr = start; addr < end; addr += kVirtualSpanSize) {
+    s = reinterpret_cast<Span*>(addr);
+    sc = s->size_class();
+    // Spans that have just been reserved might not be constructed yet.
+    if ((sc <= 0) || (sc >= kNumClasses)) {
+      continue;
+    }
+    epoch = s->epoch();
+    if (Span::IsFull(epoch)) {
+      // Spans in the span pool.
+      spans_full_++;
+      continue;
+    }
+    if (Span::IsHot(epoch)) {
+      spans_hot_++;
+    } else if (Span::IsReusable(epoch)) {
+      spans_reusable_++;
+    } else {
+      spans_floating_++;
+    }
+    free_objects = s->NrFreeObjects();
+    if (free_objects > ClassInfo[sc].objects) {
+      free_objects = ClassInfo[sc].objects;
+    }
+    classes_[sc].spans++;
+    classes_[sc].free_objects += free_objects;
+    classes_[sc].live_objects += ClassInfo[sc].objects - free_objects;
+  }
+}
+
+
+void HeapStats::Printf(int fd, const char* format, ...) {
+  char buffer[256];
+  va_list args;
+  va_start(args, format);
+  int len = vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  if (len < 0) {
+    return;
+  }
+  if (len >= static_cast<int>(sizeof(buffer))) {
+    len = sizeof(buffer) - 1;
+  }
+  if (write(fd, buffer, len) == -1) {
+    // Nothing we can do about it.
+  }
+}
+
+
+void HeapStats::Print(int fd) {
+  Refresh();
+  Printf(fd, "scalloc statistics (epoch %lu)\n", epoch());
+  Printf(fd, "allocated: %lu, mapped: %lu, madvised (total): %lu\n",
+         allocated(), mapped(), span_pool.MadvisedBytes());
+  Printf(fd, "small objects: allocated: %lu, free: %lu\n",
+         small_allocated(), small_free());
+  Printf(fd, "large objects: count: %lu, mapped: %lu, cached: %lu\n",
+         LargeObject::NrObjects(), LargeObject::MappedBytes(),
+         large_object_cache.CachedBytes());
+  Printf(fd, "spans: hot: %lu, floating: %lu, reusable: %lu, full: %lu\n",
+         spans_hot(), spans_floating(), spans_reusable(), spans_full());
+
+  Printf(fd, "%6s %8s %8s %10s %10s\n",
+         "class", "size", "spans", "live", "free");
+  for (int32_t i = 1; i < kNumClasses; i++) {
+    if (classes_[i].spans == 0) {
+      continue;
+    }
+    Printf(fd, "%6d %8d %8lu %10lu %10lu\n",
+           i, ClassInfo[i].size, classes_[i].spans,
+           classes_[i].live_objects, classes_[i].free_objects);
+  }
+
+  Printf(fd, "span pool depth (slot: backends)\n");
+  const int32_t limit = span_pool.limit();
+  int32_t depth;
+  for (int32_t i = 0; i < SpanPool::kSizeClassSlots; i++) {
+    depth = 0;
+    for (int32_t j = 0; j < limit; j++) {
+      depth += span_pool.Depth(i, j);
+    }
+    Printf(fd, "%6d: %d\n", i, depth);
+  }
+
+  if (numa_topology.nodes() > 1) {
+    Printf(fd, "numa nodes (node: used, pooled spans)\n");
+    for (int32_t i = 0; i < numa_topology.nodes(); i++) {
+      Printf(fd, "%6d: %lu, %d\n", i,
+             object_space.current(i) - object_space.start(i),
+             span_pool.NodeDepth(i));
+    }
+  }
+
+  Printf(fd, "%6s %10s %10s %10s %10s %10s %10s %10s %10s\n",
+         "core", "refills", "reused", "new", "large", "remote", "flushes",
+         "reclaimed", "stolen");
+  int32_t i = 0;
+  for (Core* c = Core::First(); c != nullptr; c = c->Next(), i++) {
+    const CoreCounters& counters = c->counters();
+    Printf(fd, "%6d %10lu %10lu %10lu %10lu %10lu %10lu %10lu %10lu\n",
+           i, counters.span_refills, counters.reused_spans,
+           counters.new_spans, counters.large_allocations,
+           counters.remote_frees, counters.remote_flushes,
+           counters.reclaimed_spans, counters.stolen_spans);
+  }
+}
+
+}  // namespace scalloc
+
+#endif  // SCALLOC_STATS_H_
@@ -0,0 +1,94 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+#ifndef SCALLOC_THREAD_CACHE_H_
+#define SCALLOC_THREAD_CACHE_H_
+
+#include <string.h>
+
+#include "globals.h"
+#include "platform/assert.h"
+#include "platform/globals.h"
+
+namespace scalloc {
+
+// A small bounded cache of objects per size class that sits in front of the
+// hot spans of a core. Objects in the cache are still accounted as allocated by
+// their spans, which allows serving alloc/free pairs without touching any span
+// header. The cache is refilled from and flushed to spans in batches.
+class ThreadCache {
+ public:
+  // Only fine size classes are cached. Size class 0 is part of the range but
+  // never holds objects.
+  static const int32_t kCachedClasses = kFineClasses;
+  static const int32_t kCapacity = 32;
+  static const int32_t kBatchSize = kCapacity / 2;
+
+  static always_inline bool Caches(int32_t size_class) {
+    return size_class < kCachedClasses;
+  }
+
+  always_inline void Init();
+  always_inline void* Pop(int32_t size_class);
+  always_inline bool Push(int32_t size_class, void* p);
+  always_inline void* Oldest(int32_t size_class, int32_t i);
+  always_inline void DropOldest(int32_t size_class, int32_t n);
+
+  always_inline int32_t Length(int32_t size_class) { return len_[size_class]; }
+
+  // Objects may also be stored right on top of the cache and then added at
+  // once through Grow().
+  always_inline void** Top(int32_t size_class) {
+    return &objects_[size_class][len_[size_class]];
+  }
+  always_inline void Grow(int32_t size_class, int32_t n) {
+    ScallocAssert(len_[size_class] + n <= kCapacity);
+    len_[size_class] += n;
+  }
+
+ private:
+  void* objects_[kCachedClasses][kCapacity];
+  int32_t len_[kCachedClasses];
+};
+
+
+void ThreadCache::Init() {
+  memset(len_, 0, sizeof(len_));
+}
+
+
+void* ThreadCache::Pop(int32_t size_class) {
+  if (len_[size_class] == 0) {
+    return nullptr;
+  }
+  return objects_[size_class][--len_[size_class]];
+}
+
+
+bool ThreadCache::Push(int32_t size_class, void* p) {
+  if (UNLIKELY(len_[size_class] == kCapacity)) {
+    return false;
+  }
+  objects_[size_class][len_[size_class]++] = p;
+  return true;
+}
+
+
+void* ThreadCache::Oldest(int32_t size_class, int32_t i) {
+  ScallocAssert(i < len_[size_class]);
+  return objects_[size_class][i];
+}
+
+
+void ThreadCache::DropOldest(int32_t size_class, int32_t n) {
+  ScallocAssert(n <= len_[size_class]);
+  len_[size_class] -= n;
+  memmove(&objects_[size_class][0],
+          &objects_[size_class][n],
+          len_[size_class] * sizeof(objects_[size_class][0]));
+}
+
+}  // namespace scalloc
+
+#endif  // SCALLOC_THREAD_CACHE_H_
@@ -5,7 +5,9 @@
 #ifndef SCALLOC_UTILS_H_
 #define SCALLOC_UTILS_H_
 
+#include <sched.h>
 #include <sys/mman.h>
+#include <time.h>
 
 #include "globals.h"
 #include "platform/globals.h"
@@ -106,6 +108,31 @@ always_inline uint_fast64_t hwrand() {
 }
 
 
+// Returns the CPU the calling thread is running on. The result is only a hint
+// as the thread may be migrated at any time.
+always_inline int32_t CurrentCpu() {
+#if defined(__linux__)
+  const int cpu = sched_getcpu();
+  if (LIKELY(cpu >= 0)) {
+    return cpu;
+  }
+#endif  // __linux__
+  return static_cast<int32_t>(hwrand() % CpusOnline());
+}
+
+
+// Coarse monotonic time in milliseconds.
+always_inline uint64_t NowMs() {
+  struct timespec ts;
+#if defined(CLOCK_MONOTONIC_COARSE)
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+#else
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif  // CLOCK_MONOTONIC_COARSE
+  return static_cast<uint64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+
 // Used for pseudorand
 const uint32_t kA = 16807;
 const uint32_t kM = 2147483647;
@@ -0,0 +1,98 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+#include <errno.h>
+#include <malloc.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "scalloc.h"
+#include "test_util.h"
+
+namespace {
+
+bool IsAligned(void* p, size_t alignment) {
+  return (reinterpret_cast<uintptr_t>(p) % alignment) == 0;
+}
+
+
+// Covers the regular classes (up to 128B), the aligned classes (up to 1MiB),
+// and aligned large objects.
+TEST(AlignedTest, AllAlignments) {
+  for (size_t alignment = 16; alignment <= (2 << 20); alignment *= 2) {
+    for (size_t size : { static_cast<size_t>(1), alignment / 2, alignment,
+                         alignment + 1, 3 * alignment }) {
+      std::vector<void*> blocks;
+      for (int i = 0; i < 8; i++) {
+        void* p = NULL;
+        ASSERT_EQ(0, posix_memalign(&p, alignment, size));
+        ASSERT_TRUE(IsAligned(p, alignment))
+            << "alignment " << alignment << " size " << size;
+        EXPECT_GE(scalloc_malloc_usable_size(p), size);
+        memset(p, 0x5a, size);
+        blocks.push_back(p);
+      }
+      for (void* p : blocks) {
+        free(p);
+      }
+    }
+  }
+}
+
+
+// Blocks of aligned classes go back to their class.
+TEST(AlignedTest, FreeAlignedSized) {
+  for (size_t alignment = 32; alignment <= (1 << 20); alignment *= 2) {
+    for (size_t size : { alignment / 2, alignment }) {
+      void* p = memalign(alignment, size);
+      ASSERT_NE(nullptr, p);
+      ASSERT_TRUE(IsAligned(p, alignment));
+      scalloc_free_aligned_sized(p, alignment, size);
+      void* q = memalign(alignment, size);
+      EXPECT_EQ(p, q) << "alignment " << alignment << " size " << size;
+      scalloc_free_aligned_sized(q, alignment, size);
+    }
+  }
+}
+
+
+TEST(AlignedTest, FreeAlignedSizedLarge) {
+  const uint64_t before = CtlRead("stats.large.count");
+  const size_t alignment = 4 << 20;
+  void* p = aligned_alloc(alignment, alignment);
+  ASSERT_TRUE(IsAligned(p, alignment));
+  EXPECT_EQ(before + 1, CtlRead("stats.large.count"));
+  scalloc_free_aligned_sized(p, alignment, alignment);
+  EXPECT_EQ(before, CtlRead("stats.large.count"));
+  scalloc_free_aligned_sized(NULL, alignment, alignment);
+}
+
+
+TEST(AlignedTest, Memalign) {
+  // Other alignments are rounded up to a power of two.
+  void* p = memalign(48, 100);
+  EXPECT_TRUE(IsAligned(p, 64));
+  free(p);
+  p = valloc(100);
+  EXPECT_TRUE(IsAligned(p, 4096));
+  free(p);
+}
+
+
+TEST(AlignedTest, InvalidArguments) {
+  void* p = reinterpret_cast<void*>(1);
+  EXPECT_EQ(EINVAL, posix_memalign(&p, 48, 16));
+  EXPECT_EQ(EINVAL, posix_memalign(&p, sizeof(void*) / 2, 16));
+  EXPECT_EQ(reinterpret_cast<void*>(1), p);
+  errno = 0;
+  EXPECT_EQ(nullptr, aligned_alloc(64, 100));
+  EXPECT_EQ(EINVAL, errno);
+  EXPECT_EQ(ENOMEM, posix_memalign(&p, 4096, SIZE_MAX - 4096));
+}
+
+}  // namespace
@@ -0,0 +1,104 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "scalloc.h"
+#include "test_util.h"
+
+namespace {
+
+const size_t kBatch = 1000;
+
+void ExpectDistinct(void** ptrs, size_t n) {
+  std::set<void*> seen(ptrs, ptrs + n);
+  EXPECT_EQ(n, seen.size());
+}
+
+
+TEST(BatchTest, AllocateAndFree) {
+  for (size_t size : { 1, 16, 100, 1000, 32768, 1 << 20 }) {
+    std::vector<void*> ptrs(kBatch);
+    ASSERT_EQ(kBatch, scalloc_malloc_batch(size, ptrs.data(), kBatch));
+    for (void* p : ptrs) {
+      ASSERT_NE(nullptr, p);
+      EXPECT_GE(scalloc_malloc_usable_size(p), size);
+      memset(p, 0x5a, size);
+    }
+    ExpectDistinct(ptrs.data(), kBatch);
+    scalloc_free_batch(ptrs.data(), kBatch);
+  }
+}
+
+
+TEST(BatchTest, LargeObjects) {
+  const uint64_t before = CtlRead("stats.large.count");
+  void* ptrs[4];
+  ASSERT_EQ(4u, scalloc_malloc_batch(4 << 20, ptrs, 4));
+  EXPECT_EQ(before + 4, CtlRead("stats.large.count"));
+  scalloc_free_batch(ptrs, 4);
+  EXPECT_EQ(before, CtlRead("stats.large.count"));
+}
+
+
+TEST(BatchTest, EdgeCases) {
+  void* ptrs[2] = { NULL, NULL };
+  EXPECT_EQ(0u, scalloc_malloc_batch(16, ptrs, 0));
+  // Sizes that overflow are refused like in calloc().
+  EXPECT_EQ(0u, scalloc_malloc_batch(SIZE_MAX / 2 + 2, ptrs, 2));
+  scalloc_free_batch(ptrs, 2);
+  scalloc_free_batch(NULL, 0);
+}
+
+
+// Batches and single blocks mix.
+TEST(BatchTest, MixedWithMalloc) {
+  std::vector<void*> ptrs(kBatch);
+  ASSERT_EQ(kBatch, scalloc_malloc_batch(64, ptrs.data(), kBatch));
+  for (size_t i = 0; i < kBatch; i += 2) {
+    free(ptrs[i]);
+    ptrs[i] = malloc(64);
+  }
+  ExpectDistinct(ptrs.data(), kBatch);
+  std::reverse(ptrs.begin(), ptrs.end());
+  scalloc_free_batch(ptrs.data(), kBatch);
+}
+
+
+// Blocks freed by another thread go through the remote path of their spans,
+// and must not be handed out twice afterwards.
+TEST(BatchTest, RemoteFree) {
+  const int kRounds = 50;
+  std::set<void*> live;
+  for (int round = 0; round < kRounds; round++) {
+    std::vector<void*> ptrs(kBatch);
+    ASSERT_EQ(kBatch, scalloc_malloc_batch(48, ptrs.data(), kBatch));
+    for (void* p : ptrs) {
+      EXPECT_TRUE(live.insert(p).second);
+      memset(p, round, 48);
+    }
+    // Keep a few blocks alive, so that spans are shared between rounds.
+    std::vector<void*> remote;
+    for (size_t i = 0; i < kBatch; i++) {
+      if ((i % 10) == 0) continue;
+      remote.push_back(ptrs[i]);
+      live.erase(ptrs[i]);
+    }
+    std::thread([&remote] {
+      scalloc_free_batch(remote.data(), remote.size());
+    }).join();
+  }
+  std::vector<void*> rest(live.begin(), live.end());
+  scalloc_free_batch(rest.data(), rest.size());
+}
+
+}  // namespace
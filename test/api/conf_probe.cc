@@ -0,0 +1,33 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+// Prints the configuration that scalloc has read from SCALLOC_CONF, one
+// "<mallctl key> <value>" pair per line. See config_test.cc.
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "scalloc.h"
+
+int main(int argc, char** argv) {
+  const char* keys[] = {
+    "config.lab_model",
+    "config.reuse_threshold",
+    "config.classes.1.reuse_threshold",
+    "config.cleanup_in_free",
+    "config.background_purge",
+    "config.span_pool_backend_limit",
+    "config.madvise_decay_ms",
+    "config.large_object_cache_bytes",
+  };
+  for (const char* key : keys) {
+    int64_t value = 0;
+    size_t len = sizeof(value);
+    if (scalloc_mallctl(key, &value, &len, NULL, 0) != 0) {
+      return 1;
+    }
+    printf("%s %ld\n", key, value);
+  }
+  return 0;
+}
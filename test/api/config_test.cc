@@ -0,0 +1,144 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <map>
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+// SCALLOC_CONF is only read during initialization, so every configuration is
+// checked in a fresh conf_probe process, which lives next to the test binary.
+class ConfigTest : public testing::Test {
+ protected:
+  typedef std::map<std::string, int64_t> Values;
+
+  // Runs the probe with the given SCALLOC_CONF (or without, if conf is NULL).
+  // Returns the values it reports and its stderr output in warnings.
+  static Values Probe(const char* conf, std::string* warnings = NULL) {
+    char exe[PATH_MAX];
+    const ssize_t len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+    EXPECT_GT(len, 0);
+    exe[(len > 0) ? len : 0] = '\0';
+    std::string dir(exe);
+    dir = dir.substr(0, dir.rfind('/'));
+    const std::string err_file = dir + "/conf_probe.err";
+    std::string cmd;
+    if (conf != NULL) {
+      cmd = std::string("SCALLOC_CONF='") + conf + "' ";
+    } else {
+      cmd = "env -u SCALLOC_CONF ";
+    }
+    cmd += dir + "/conf_probe 2>" + err_file;
+
+    Values values;
+    FILE* out = popen(cmd.c_str(), "r");
+    EXPECT_NE(nullptr, out);
+    if (out == NULL) {
+      return values;
+    }
+    char key[128];
+    long value;  // NOLINT
+    while (fscanf(out, "%127s %ld", key, &value) == 2) {
+      values[key] = value;
+    }
+    EXPECT_EQ(0, pclose(out)) << cmd;
+
+    if (warnings != NULL) {
+      warnings->clear();
+      FILE* err = fopen(err_file.c_str(), "r");
+      if (err != NULL) {
+        char buf[256];
+        while (fgets(buf, sizeof(buf), err) != NULL) {
+          *warnings += buf;
+        }
+        fclose(err);
+      }
+    }
+    unlink(err_file.c_str());
+    return values;
+  }
+
+  void SetUp() {
+    defaults_ = Probe(NULL);
+    ASSERT_EQ(8u, defaults_.size());
+  }
+
+  // Expects the values of conf to equal the defaults, except for changed.
+  void ExpectValues(const char* conf, const Values& changed) {
+    Values expected = defaults_;
+    for (const auto& kv : changed) {
+      expected[kv.first] = kv.second;
+    }
+    EXPECT_EQ(expected, Probe(conf)) << "SCALLOC_CONF=" << conf;
+  }
+
+  Values defaults_;
+};
+
+
+TEST_F(ConfigTest, EmptyKeepsDefaults) {
+  ExpectValues("", {});
+}
+
+
+TEST_F(ConfigTest, ParsesAllOptions) {
+  ExpectValues("lab_model:rr", {{"config.lab_model", 1}});
+  ExpectValues("lab_model:percpu", {{"config.lab_model", 2}});
+  ExpectValues("lab_model:tlab", {{"config.lab_model", 0}});
+  ExpectValues("reuse_threshold:60",
+               {{"config.reuse_threshold", 60},
+                {"config.classes.1.reuse_threshold", 60}});
+  ExpectValues("cleanup_in_free:no", {{"config.cleanup_in_free", 0}});
+  ExpectValues("background_purge:no", {{"config.background_purge", 0}});
+  ExpectValues("span_pool_backend_limit:3",
+               {{"config.span_pool_backend_limit", 3}});
+  ExpectValues("madvise_decay_ms:-1", {{"config.madvise_decay_ms", -1}});
+  ExpectValues("large_object_cache_bytes:0",
+               {{"config.large_object_cache_bytes", 0}});
+}
+
+
+TEST_F(ConfigTest, ParsesLists) {
+  ExpectValues("lab_model:percpu,reuse_threshold:0,madvise_decay_ms:0",
+               {{"config.lab_model", 2},
+                {"config.reuse_threshold", 0},
+                {"config.classes.1.reuse_threshold", 0},
+                {"config.madvise_decay_ms", 0}});
+  // Later options win.
+  ExpectValues("reuse_threshold:10,reuse_threshold:20",
+               {{"config.reuse_threshold", 20},
+                {"config.classes.1.reuse_threshold", 20}});
+}
+
+
+TEST_F(ConfigTest, IgnoresInvalidOptions) {
+  std::string warnings;
+  EXPECT_EQ(defaults_,
+            Probe("reuse_threshold:101,lab_model:foo,unknown:1,"
+                  "cleanup_in_free:maybe,span_pool_backend_limit:0,"
+                  "madvise_decay_ms:-2,large_object_cache_bytes:1x",
+                  &warnings));
+  EXPECT_NE(std::string::npos, warnings.find("'reuse_threshold:101'"))
+      << warnings;
+  EXPECT_NE(std::string::npos, warnings.find("'unknown:1'")) << warnings;
+  EXPECT_NE(std::string::npos,
+            warnings.find("'large_object_cache_bytes:1x'")) << warnings;
+}
+
+
+TEST_F(ConfigTest, SkipsMalformedEntries) {
+  ExpectValues(",,reuse_threshold,:5,reuse_threshold:,reuse_threshold:50,",
+               {{"config.reuse_threshold", 50},
+                {"config.classes.1.reuse_threshold", 50}});
+}
+
+}  // namespace
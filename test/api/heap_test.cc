@@ -0,0 +1,127 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "scalloc.h"
+#include "test_util.h"
+
+namespace {
+
+const size_t kLargeSize = 4 << 20;
+
+TEST(HeapTest, DestroyReleasesAllObjects) {
+  const uint64_t large_before = CtlRead("stats.large.count");
+  void* heap = scalloc_heap_create();
+  ASSERT_NE(nullptr, heap);
+  for (size_t size = 1; size <= (1 << 20); size *= 2) {
+    for (int i = 0; i < 100; i++) {
+      void* p = scalloc_heap_malloc(heap, size);
+      ASSERT_NE(nullptr, p);
+      memset(p, 0x5a, size);
+    }
+  }
+  for (int i = 0; i < 4; i++) {
+    void* p = scalloc_heap_malloc(heap, kLargeSize);
+    ASSERT_NE(nullptr, p);
+    memset(p, 0x5a, kLargeSize);
+  }
+  EXPECT_EQ(large_before + 4, CtlRead("stats.large.count"));
+  scalloc_heap_destroy(heap);
+  EXPECT_EQ(large_before, CtlRead("stats.large.count"));
+}
+
+
+TEST(HeapTest, FreeReturnsObjectsToTheHeap) {
+  void* heap = scalloc_heap_create();
+  void* p = scalloc_heap_malloc(heap, 64);
+  scalloc_heap_free(heap, p);
+  EXPECT_EQ(p, scalloc_heap_malloc(heap, 64));
+
+  const uint64_t large_before = CtlRead("stats.large.count");
+  void* large = scalloc_heap_malloc(heap, kLargeSize);
+  EXPECT_EQ(large_before + 1, CtlRead("stats.large.count"));
+  scalloc_heap_free(heap, large);
+  EXPECT_EQ(large_before, CtlRead("stats.large.count"));
+  scalloc_heap_free(heap, NULL);
+  scalloc_heap_destroy(heap);
+}
+
+
+// Objects that do not belong to the heap are passed on to their owner.
+TEST(HeapTest, FreeForwardsForeignObjects) {
+  void* heap = scalloc_heap_create();
+  void* other = scalloc_heap_create();
+  const uint64_t large_before = CtlRead("stats.large.count");
+
+  scalloc_heap_free(heap, malloc(64));
+  scalloc_heap_free(heap, malloc(kLargeSize));
+  void* aligned = NULL;
+  ASSERT_EQ(0, posix_memalign(&aligned, 1 << 16, kLargeSize));
+  scalloc_heap_free(heap, aligned);
+  scalloc_heap_free(heap, scalloc_heap_malloc(other, 64));
+  scalloc_heap_free(heap, scalloc_heap_malloc(other, kLargeSize));
+  EXPECT_EQ(large_before, CtlRead("stats.large.count"));
+
+  scalloc_heap_destroy(other);
+  scalloc_heap_destroy(heap);
+}
+
+
+TEST(HeapTest, HeapsAreRecycled) {
+  const uint64_t large_before = CtlRead("stats.large.count");
+  void* first = scalloc_heap_create();
+  scalloc_heap_destroy(first);
+  for (int i = 0; i < 1000; i++) {
+    void* heap = scalloc_heap_create();
+    ASSERT_NE(nullptr, heap);
+    EXPECT_NE(nullptr, scalloc_heap_malloc(heap, 32));
+    EXPECT_NE(nullptr, scalloc_heap_malloc(heap, kLargeSize));
+    scalloc_heap_destroy(heap);
+  }
+  EXPECT_EQ(large_before, CtlRead("stats.large.count"));
+  scalloc_heap_destroy(NULL);
+}
+
+
+TEST(HeapTest, SharedBetweenThreads) {
+  const int kThreads = 4;
+  const int kObjects = 10000;
+  void* heap = scalloc_heap_create();
+  std::vector<std::thread> threads;
+  std::vector<std::vector<uintptr_t*> > objects(kThreads);
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([heap, t, &objects] {
+      for (int i = 0; i < kObjects; i++) {
+        uintptr_t* p = static_cast<uintptr_t*>(
+            scalloc_heap_malloc(heap, 16 + (i % 64) * 16));
+        *p = (t << 24) | i;
+        objects[t].push_back(p);
+        if ((i % 3) == 0) {
+          scalloc_heap_free(heap, objects[t][i / 2]);
+          objects[t][i / 2] = NULL;
+        }
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  for (int t = 0; t < kThreads; t++) {
+    for (int i = 0; i < kObjects; i++) {
+      if (objects[t][i] != NULL) {
+        EXPECT_EQ(static_cast<uintptr_t>((t << 24) | i), *objects[t][i]);
+      }
+    }
+  }
+  scalloc_heap_destroy(heap);
+}
+
+}  // namespace
@@ -0,0 +1,183 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "test_util.h"
+
+namespace {
+
+const size_t kSizes[] = { 16, 48, 64, 256, 1024, 4096 };
+const size_t kNumSizes = sizeof(kSizes) / sizeof(kSizes[0]);
+
+// Hands blocks from producers to consumers.
+class BlockQueue {
+ public:
+  void Push(const Block& b) {
+    std::lock_guard<std::mutex> guard(lock_);
+    blocks_.push_back(b);
+  }
+
+  bool Pop(Block* b) {
+    std::lock_guard<std::mutex> guard(lock_);
+    if (blocks_.empty()) {
+      return false;
+    }
+    *b = blocks_.front();
+    blocks_.pop_front();
+    return true;
+  }
+
+ private:
+  std::mutex lock_;
+  std::deque<Block> blocks_;
+};
+
+
+// Every block is allocated by a producer and freed by a consumer, i.e., goes
+// through the remote free buffer of the consumer. Buffered blocks must not be
+// handed out again before they are published.
+TEST(RemoteFreeTest, ProducerConsumer) {
+  const int kProducers = 2;
+  const int kConsumers = 4;
+  const uint64_t kBlocks = 200000;
+  BlockQueue queue;
+  std::atomic<int> producers_done(0);
+  std::atomic<uint64_t> corrupted(0);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kProducers; t++) {
+    threads.emplace_back([&queue, &producers_done, t] {
+      for (uint64_t i = 0; i < kBlocks; i++) {
+        Block b;
+        b.size = kSizes[i % kNumSizes];
+        b.p = malloc(b.size);
+        b.id = (static_cast<uint64_t>(t) << 32) | i;
+        b.Mark();
+        queue.Push(b);
+      }
+      producers_done++;
+    });
+  }
+  for (int t = 0; t < kConsumers; t++) {
+    threads.emplace_back([&queue, &producers_done, &corrupted] {
+      Block b;
+      while (true) {
+        if (!queue.Pop(&b)) {
+          if (producers_done.load() == kProducers) {
+            // Producers are done, so an empty queue stays empty.
+            if (!queue.Pop(&b)) {
+              return;
+            }
+          } else {
+            std::this_thread::yield();
+            continue;
+          }
+        }
+        if (!b.Check()) {
+          corrupted++;
+        }
+        free(b.p);
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(0u, corrupted.load());
+}
+
+
+// Blocks freed by a thread that exits right away are published on its exit and
+// can be reused by their owner.
+TEST(RemoteFreeTest, PublishedOnThreadExit) {
+  // Enough blocks to free whole spans, which hold more than 30000 blocks of 64
+  // bytes in hugepage builds.
+  const size_t kBlocks = 100000;
+  std::vector<void*> blocks(kBlocks);
+  for (size_t i = 0; i < kBlocks; i++) {
+    blocks[i] = malloc(64);
+  }
+  const std::set<void*> freed(blocks.begin(), blocks.end());
+  // Fewer blocks than fit into the buffer stay buffered until the exit.
+  std::thread([&blocks] {
+    for (size_t i = 0; i < 10; i++) {
+      free(blocks[i]);
+    }
+  }).join();
+  std::thread([&blocks] {
+    for (size_t i = 10; i < kBlocks; i++) {
+      free(blocks[i]);
+    }
+  }).join();
+  size_t reused = 0;
+  for (size_t i = 0; i < kBlocks; i++) {
+    blocks[i] = malloc(64);
+    reused += freed.count(blocks[i]);
+  }
+  EXPECT_GT(reused, kBlocks / 2);
+  for (size_t i = 0; i < kBlocks; i++) {
+    free(blocks[i]);
+  }
+}
+
+
+// Many threads free into each other's spans while they allocate.
+TEST(RemoteFreeTest, AllToAll) {
+  const int kThreads = 8;
+  const int kRounds = 20;
+  const size_t kBlocks = 2000;
+  // Blocks of the current and the last round, per thread.
+  std::vector<std::vector<Block> > blocks[2];
+  blocks[0].resize(kThreads);
+  blocks[1].resize(kThreads);
+  std::atomic<uint64_t> corrupted(0);
+  for (int round = 0; round < kRounds; round++) {
+    std::vector<Block>* current = &blocks[round % 2][0];
+    std::vector<Block>* last = &blocks[(round + 1) % 2][0];
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; t++) {
+      threads.emplace_back([current, last, &corrupted, t, round] {
+        std::vector<Block>& neighbor = last[(t + 1) % kThreads];
+        for (size_t i = 0; i < kBlocks; i++) {
+          Block b;
+          b.size = kSizes[(i + t) % kNumSizes];
+          b.p = malloc(b.size);
+          b.id = (static_cast<uint64_t>(round) << 48) |
+                 (static_cast<uint64_t>(t) << 32) | i;
+          b.Mark();
+          current[t].push_back(b);
+          if (i < neighbor.size()) {
+            const Block& old = neighbor[i];
+            if (!old.Check()) {
+              corrupted++;
+            }
+            free(old.p);
+          }
+        }
+        neighbor.clear();
+      });
+    }
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+  }
+  for (std::vector<Block>& thread_blocks : blocks[(kRounds + 1) % 2]) {
+    for (const Block& b : thread_blocks) {
+      EXPECT_TRUE(b.Check());
+      free(b.p);
+    }
+  }
+  EXPECT_EQ(0u, corrupted.load());
+}
+
+}  // namespace
@@ -0,0 +1,92 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "test_util.h"
+
+namespace {
+
+// A block that any thread may swap out, i.e., free remotely.
+struct Slot {
+  std::mutex lock;
+  Block block;
+};
+
+
+// Short-lived threads exchange blocks of a shared table. Freeing a block of
+// another thread makes its span reusable for the owner, i.e., pushes it to
+// the owner's reusable spans, while the owner pops from them, terminates
+// (closes them), or its core is taken over by a new thread (opens them).
+TEST(ReusableSpansTest, PushWhileOwnersComeAndGo) {
+  const int kLiveThreads = 8;
+  const int kTotalThreads = 400;
+  const size_t kSlots = 4096;
+  const size_t kSizes[] = { 16, 32, 64, 128, 512 };
+  std::vector<Slot> slots(kSlots);
+  for (size_t i = 0; i < kSlots; i++) {
+    slots[i].block.p = nullptr;
+  }
+  std::atomic<uint64_t> next_id(1);
+  std::atomic<uint64_t> corrupted(0);
+  std::atomic<int> live(0);
+
+  auto worker = [&](uint64_t seed) {
+    // Lifetimes differ, so that threads exit while others are busy.
+    const size_t ops = 2000 + (seed % 7) * 1000;
+    uint64_t state = seed * 0x9e3779b97f4a7c15ULL + 1;
+    for (size_t op = 0; op < ops; op++) {
+      state ^= state << 13;
+      state ^= state >> 7;
+      state ^= state << 17;
+      Block b;
+      b.size = kSizes[state % 5];
+      b.p = malloc(b.size);
+      b.id = next_id++;
+      b.Mark();
+      Slot& slot = slots[(state >> 8) % kSlots];
+      Block old;
+      {
+        std::lock_guard<std::mutex> guard(slot.lock);
+        old = slot.block;
+        slot.block = b;
+      }
+      if (old.p != nullptr) {
+        if (!old.Check()) {
+          corrupted++;
+        }
+        free(old.p);
+      }
+    }
+    live--;
+  };
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kTotalThreads; t++) {
+    while (live.load() >= kLiveThreads) {
+      std::this_thread::yield();
+    }
+    live++;
+    threads.emplace_back(worker, static_cast<uint64_t>(t));
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  for (Slot& slot : slots) {
+    if (slot.block.p != nullptr) {
+      EXPECT_TRUE(slot.block.Check());
+      free(slot.block.p);
+    }
+  }
+  EXPECT_EQ(0u, corrupted.load());
+}
+
+}  // namespace
@@ -0,0 +1,84 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gtest/gtest.h"
+#include "test_util.h"
+
+namespace {
+
+// Writes a numeric mallctl() key and returns its previous value.
+uint64_t CtlWrite(const char* name, uint64_t value) {
+  uint64_t old = 0;
+  size_t len = sizeof(old);
+  EXPECT_EQ(0, scalloc_mallctl(name, &old, &len, &value, sizeof(value)))
+      << name;
+  return old;
+}
+
+
+TEST(RuntimeConfigTest, WritesReturnThePreviousValue) {
+  const uint64_t threshold = CtlRead("config.reuse_threshold");
+  const uint64_t other = (threshold == 30) ? 40 : 30;
+  EXPECT_EQ(threshold, CtlWrite("config.reuse_threshold", other));
+  EXPECT_EQ(other, CtlRead("config.reuse_threshold"));
+  EXPECT_EQ(other, CtlWrite("config.classes.1.reuse_threshold", 90));
+  EXPECT_EQ(90u, CtlRead("config.classes.1.reuse_threshold"));
+  EXPECT_EQ(other, CtlRead("config.classes.2.reuse_threshold"));
+  // Setting all size classes overrides the ones of single classes.
+  EXPECT_EQ(other, CtlWrite("config.reuse_threshold", threshold));
+  EXPECT_EQ(threshold, CtlRead("config.classes.1.reuse_threshold"));
+}
+
+
+TEST(RuntimeConfigTest, RejectsInvalidWrites) {
+  const uint64_t threshold = CtlRead("config.reuse_threshold");
+  uint64_t value = 101;
+  EXPECT_EQ(EINVAL, scalloc_mallctl("config.reuse_threshold", NULL, NULL,
+                                    &value, sizeof(value)));
+  value = 0;
+  EXPECT_EQ(EINVAL, scalloc_mallctl("config.span_pool_backend_limit", NULL,
+                                    NULL, &value, sizeof(value)));
+  EXPECT_EQ(EPERM, scalloc_mallctl("config.lab_model", NULL, NULL,
+                                   &value, sizeof(value)));
+  EXPECT_EQ(threshold, CtlRead("config.reuse_threshold"));
+}
+
+
+TEST(RuntimeConfigTest, Mallopt) {
+  const uint64_t threshold = CtlRead("config.reuse_threshold");
+  EXPECT_EQ(1, scalloc_mallopt(M_SCALLOC_REUSE_THRESHOLD, 50));
+  EXPECT_EQ(50u, CtlRead("config.reuse_threshold"));
+  EXPECT_EQ(0, scalloc_mallopt(M_SCALLOC_REUSE_THRESHOLD, 101));
+  EXPECT_EQ(50u, CtlRead("config.reuse_threshold"));
+  EXPECT_EQ(1, scalloc_mallopt(M_SCALLOC_REUSE_THRESHOLD, threshold));
+
+  const uint64_t cache_bytes = CtlRead("config.large_object_cache_bytes");
+  EXPECT_EQ(1, scalloc_mallopt(M_SCALLOC_LARGE_OBJECT_CACHE_MB, 64));
+  EXPECT_EQ(64u << 20, CtlRead("config.large_object_cache_bytes"));
+  EXPECT_EQ(0, scalloc_mallopt(M_SCALLOC_LARGE_OBJECT_CACHE_MB, -1));
+  CtlWrite("config.large_object_cache_bytes", cache_bytes);
+}
+
+
+TEST(RuntimeConfigTest, PurgeEmptiesTheLargeObjectCache) {
+  const size_t kSize = 4 << 20;
+  void* p = malloc(kSize);
+  ASSERT_NE(nullptr, p);
+  memset(p, 1, kSize);
+  free(p);
+  if (CtlRead("config.large_object_cache_bytes") > 0) {
+    EXPECT_GT(CtlRead("stats.large.cached"), 0u);
+  }
+  uint64_t purged = 0;
+  size_t len = sizeof(purged);
+  EXPECT_EQ(0, scalloc_mallctl("purge", &purged, &len, NULL, 0));
+  EXPECT_EQ(0u, CtlRead("stats.large.cached"));
+}
+
+}  // namespace
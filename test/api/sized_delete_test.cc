@@ -0,0 +1,142 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+#include <dlfcn.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <new>
+
+#include "gtest/gtest.h"
+#include "scalloc.h"
+#include "test_util.h"
+
+namespace {
+
+const size_t kSmallSizes[] = { 1, 8, 16, 24, 100, 256 };
+// More than the address space, but below the maximum object size.
+const size_t kHugeSize = static_cast<size_t>(1) << 62;
+
+// A block freed with its size goes back to its size class, from which the
+// next allocation of that size is served first.
+TEST(SizedDeleteTest, ReturnsBlockToItsClass) {
+  for (size_t size : kSmallSizes) {
+    void* p = ::operator new(size);
+    memset(p, 0x5a, size);
+    ::operator delete(p, size);
+    void* q = ::operator new(size);
+    EXPECT_EQ(p, q) << "size " << size;
+    ::operator delete(q, size);
+  }
+}
+
+
+TEST(SizedDeleteTest, Arrays) {
+  for (size_t size : kSmallSizes) {
+    void* p = ::operator new[](size);
+    ::operator delete[](p, size);
+    void* q = ::operator new[](size);
+    EXPECT_EQ(p, q) << "size " << size;
+    ::operator delete[](q, size);
+  }
+}
+
+
+// new has to return a unique pointer for size 0, which is served from size 1.
+TEST(SizedDeleteTest, ZeroSize) {
+  void* p = ::operator new(0);
+  void* q = ::operator new(0);
+  ASSERT_NE(nullptr, p);
+  ASSERT_NE(nullptr, q);
+  EXPECT_NE(p, q);
+  ::operator delete(p, static_cast<size_t>(0));
+  ::operator delete(q, static_cast<size_t>(0));
+}
+
+
+TEST(SizedDeleteTest, LargeObjects) {
+  const uint64_t before = CtlRead("stats.large.count");
+  const size_t size = 4 << 20;
+  void* p = ::operator new(size);
+  memset(p, 0x5a, size);
+  EXPECT_EQ(before + 1, CtlRead("stats.large.count"));
+  ::operator delete(p, size);
+  EXPECT_EQ(before, CtlRead("stats.large.count"));
+}
+
+
+TEST(SizedDeleteTest, Aligned) {
+  const size_t alignments[] = { 32, 64, 4096, 1 << 16 };
+  for (size_t alignment : alignments) {
+    for (size_t size : { alignment / 2, alignment, 3 * alignment }) {
+      const std::align_val_t al = static_cast<std::align_val_t>(alignment);
+      void* p = ::operator new(size, al);
+      ASSERT_EQ(0u, reinterpret_cast<uintptr_t>(p) % alignment);
+      memset(p, 0x5a, size);
+      ::operator delete(p, size, al);
+      void* q = ::operator new[](size, al);
+      ASSERT_EQ(0u, reinterpret_cast<uintptr_t>(q) % alignment);
+      ::operator delete[](q, size, al);
+    }
+  }
+}
+
+
+TEST(SizedDeleteTest, NothrowFailsForHugeSizes) {
+  EXPECT_EQ(nullptr, ::operator new(kHugeSize, std::nothrow));
+  EXPECT_EQ(nullptr,
+            ::operator new(kHugeSize, std::align_val_t(64), std::nothrow));
+}
+
+
+TEST(SizedDeleteTest, ThrowsBadAlloc) {
+  void* volatile p = nullptr;
+  EXPECT_THROW(p = ::operator new(kHugeSize), std::bad_alloc);
+  EXPECT_THROW(p = ::operator new[](kHugeSize), std::bad_alloc);
+  EXPECT_THROW(p = ::operator new(kHugeSize, std::align_val_t(64)),
+               std::bad_alloc);
+  EXPECT_THROW(p = ::operator new[](kHugeSize, std::align_val_t(64)),
+               std::bad_alloc);
+  // Not a power of two.
+  EXPECT_THROW(p = ::operator new(64, std::align_val_t(48)), std::bad_alloc);
+  EXPECT_EQ(nullptr, p);
+}
+
+
+// The aligned overloads are only compiled with -faligned-new. Without them,
+// the C++ library serves aligned new on top of malloc().
+TEST(SizedDeleteTest, AlignedOverloadsAreExported) {
+  const char* symbols[] = {
+    "_ZnwmSt11align_val_t",                  // new(size_t, align_val_t)
+    "_ZnamSt11align_val_t",                  // new[](size_t, align_val_t)
+    "_ZnwmSt11align_val_tRKSt9nothrow_t",    // nothrow variants
+    "_ZnamSt11align_val_tRKSt9nothrow_t",
+    "_ZdlPvSt11align_val_t",                 // delete(void*, align_val_t)
+    "_ZdaPvSt11align_val_t",
+    "_ZdlPvmSt11align_val_t",                // sized variants
+    "_ZdaPvmSt11align_val_t",
+  };
+  for (const char* symbol : symbols) {
+    void* address = dlsym(RTLD_DEFAULT, symbol);
+    ASSERT_NE(nullptr, address) << symbol;
+    Dl_info info;
+    ASSERT_NE(0, dladdr(address, &info)) << symbol;
+    EXPECT_NE(nullptr, strstr(info.dli_fname, "libscalloc")) << symbol;
+  }
+}
+
+
+TEST(SizedDeleteTest, FreeSized) {
+  for (size_t size : kSmallSizes) {
+    void* p = malloc(size);
+    scalloc_free_sized(p, size);
+    void* q = malloc(size);
+    EXPECT_EQ(p, q) << "size " << size;
+    scalloc_free_sized(q, size);
+  }
+  scalloc_free_sized(NULL, 16);
+}
+
+}  // namespace
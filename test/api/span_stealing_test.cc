@@ -0,0 +1,199 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "test_util.h"
+
+namespace {
+
+// Spans are only stolen if the kernel provides the heavy fences of
+// membarrier(2), and only threads with their own cores (TLAB) steal from
+// each other.
+bool StealsSpans() {
+#if defined(SYS_membarrier)
+  const long kPrivateExpedited = 1 << 3;  // NOLINT
+  const long cmds = syscall(SYS_membarrier, 0, 0);  // NOLINT
+  return (cmds >= 0) && ((cmds & kPrivateExpedited) != 0) &&
+         (CtlRead("config.lab_model") == 0);
+#else
+  return false;
+#endif  // SYS_membarrier
+}
+
+
+// A thread that frees most of its objects but stays alive leaves reusable
+// spans behind, which another thread takes instead of new spans.
+TEST(SpanStealingTest, IdleCoreIsStolenFrom) {
+  if (!StealsSpans()) {
+    GTEST_SKIP() << "span stealing not available";
+  }
+  const size_t kBlocks = 40000;
+  const size_t kSize = 64;
+  std::vector<Block> kept;
+  std::mutex lock;
+  std::atomic<bool> freed(false);
+  std::atomic<bool> done(false);
+  std::thread holder([&kept, &lock, &freed, &done] {
+    std::vector<Block> blocks(kBlocks);
+    for (size_t i = 0; i < kBlocks; i++) {
+      blocks[i].size = kSize;
+      blocks[i].p = malloc(kSize);
+      blocks[i].id = i;
+      blocks[i].Mark();
+    }
+    {
+      // Every tenth object keeps its span from becoming empty.
+      std::lock_guard<std::mutex> guard(lock);
+      for (size_t i = 0; i < kBlocks; i++) {
+        if ((i % 10) == 0) {
+          kept.push_back(blocks[i]);
+        } else {
+          free(blocks[i].p);
+        }
+      }
+    }
+    freed = true;
+    while (!done.load()) {
+      std::this_thread::yield();
+    }
+  });
+  while (!freed.load()) {
+    std::this_thread::yield();
+  }
+
+  uint64_t stolen = 0;
+  uint64_t corrupted = 0;
+  std::thread thief([&kept, &lock, &stolen, &corrupted] {
+    const uint64_t stolen_before = CoreCounterSum("stolen_spans");
+    std::vector<Block> blocks(kBlocks);
+    for (size_t i = 0; i < kBlocks; i++) {
+      blocks[i].size = kSize;
+      blocks[i].p = malloc(kSize);
+      blocks[i].id = (1ULL << 32) | i;
+      blocks[i].Mark();
+    }
+    stolen = CoreCounterSum("stolen_spans") - stolen_before;
+    std::lock_guard<std::mutex> guard(lock);
+    for (const Block& b : kept) {
+      if (!b.Check()) {
+        corrupted++;
+      }
+    }
+    for (const Block& b : blocks) {
+      if (!b.Check()) {
+        corrupted++;
+      }
+      free(b.p);
+    }
+  });
+  thief.join();
+  done = true;
+  holder.join();
+  for (const Block& b : kept) {
+    free(b.p);
+  }
+  EXPECT_GT(stolen, 0u);
+  EXPECT_EQ(0u, corrupted);
+}
+
+
+// The load moves between threads that all stay alive: In every round one
+// thread frees most of its objects, while the others allocate and thus steal
+// its spans. Some objects are freed by other threads, racing with the
+// adoption of their spans.
+TEST(SpanStealingTest, ShiftingLoad) {
+  const int kThreads = 4;
+  const int kRounds = 40;
+  const size_t kBlocks = 5000;
+  const size_t kSizes[] = { 16, 64, 256 };
+  std::vector<Block> blocks[kThreads];
+  std::vector<Block> mailbox[kThreads];
+  std::mutex mailbox_lock[kThreads];
+  std::atomic<int> round_done[kRounds];
+  for (int round = 0; round < kRounds; round++) {
+    round_done[round] = 0;
+  }
+  std::atomic<uint64_t> corrupted(0);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([&, t] {
+      uint64_t next_id = static_cast<uint64_t>(t) << 48;
+      for (int round = 0; round < kRounds; round++) {
+        if ((round % kThreads) == t) {
+          // Free all but every tenth object, and hand every fifth over.
+          std::vector<Block> kept;
+          for (size_t i = 0; i < blocks[t].size(); i++) {
+            const Block& b = blocks[t][i];
+            if (!b.Check()) {
+              corrupted++;
+            }
+            if ((i % 10) == 0) {
+              kept.push_back(b);
+            } else if ((i % 5) == 0) {
+              const int to = (t + 1 + (i % (kThreads - 1))) % kThreads;
+              std::lock_guard<std::mutex> guard(mailbox_lock[to]);
+              mailbox[to].push_back(b);
+            } else {
+              free(b.p);
+            }
+          }
+          blocks[t].swap(kept);
+        } else {
+          for (size_t i = 0; i < kBlocks; i++) {
+            Block b;
+            b.size = kSizes[i % 3];
+            b.p = malloc(b.size);
+            b.id = next_id++;
+            b.Mark();
+            blocks[t].push_back(b);
+          }
+        }
+        std::vector<Block> received;
+        {
+          std::lock_guard<std::mutex> guard(mailbox_lock[t]);
+          received.swap(mailbox[t]);
+        }
+        for (const Block& b : received) {
+          if (!b.Check()) {
+            corrupted++;
+          }
+          free(b.p);
+        }
+        // Rounds overlap by at most one.
+        round_done[round]++;
+        if (round > 0) {
+          while (round_done[round - 1].load() < kThreads) {
+            std::this_thread::yield();
+          }
+        }
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  for (int t = 0; t < kThreads; t++) {
+    for (const Block& b : blocks[t]) {
+      EXPECT_TRUE(b.Check());
+      free(b.p);
+    }
+    for (const Block& b : mailbox[t]) {
+      EXPECT_TRUE(b.Check());
+      free(b.p);
+    }
+  }
+  EXPECT_EQ(0u, corrupted.load());
+}
+
+}  // namespace
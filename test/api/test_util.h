@@ -0,0 +1,62 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+#ifndef SCALLOC_TEST_API_TEST_UTIL_H_
+#define SCALLOC_TEST_API_TEST_UTIL_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+
+#include "gtest/gtest.h"
+#include "scalloc.h"
+
+// Stress tests mark every block with the id of its allocation in its first and
+// last word. A block that is handed out while it is still in use gets a new id
+// and fails the check of its previous user. Blocks are at least 16 bytes.
+inline void MarkBlock(void* p, size_t size, uint64_t id) {
+  uint64_t* words = static_cast<uint64_t*>(p);
+  words[0] = id;
+  words[(size / sizeof(id)) - 1] = ~id;
+}
+
+
+inline bool CheckBlock(void* p, size_t size, uint64_t id) {
+  const uint64_t* words = static_cast<uint64_t*>(p);
+  return (words[0] == id) && (words[(size / sizeof(id)) - 1] == ~id);
+}
+
+
+struct Block {
+  void* p;
+  size_t size;
+  uint64_t id;
+
+  void Mark() { MarkBlock(p, size, id); }
+  bool Check() const { return CheckBlock(p, size, id); }
+};
+
+
+// Reads a numeric mallctl() key, failing the test if it does not exist.
+inline uint64_t CtlRead(const char* name) {
+  uint64_t value = 0;
+  size_t len = sizeof(value);
+  EXPECT_EQ(0, scalloc_mallctl(name, &value, &len, NULL, 0)) << name;
+  return value;
+}
+
+
+// Sums up a counter of all cores, e.g., "stolen_spans".
+inline uint64_t CoreCounterSum(const char* counter) {
+  const uint64_t cores = CtlRead("stats.cores.count");
+  uint64_t sum = 0;
+  for (uint64_t i = 0; i < cores; i++) {
+    sum += CtlRead(("stats.cores." + std::to_string(i) + "." +
+                    counter).c_str());
+  }
+  return sum;
+}
+
+#endif  // SCALLOC_TEST_API_TEST_UTIL_H_
@@ -0,0 +1,147 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "test_util.h"
+
+namespace {
+
+// More threads than the former limit of 128 cores are alive at once.
+TEST(ThreadReclaimTest, ManyConcurrentThreads) {
+  const int kThreads = 300;
+  const size_t kBlocks = 100;
+  std::atomic<int> allocated(0);
+  std::atomic<uint64_t> corrupted(0);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([&allocated, &corrupted, t] {
+      std::vector<Block> blocks(kBlocks);
+      for (size_t i = 0; i < kBlocks; i++) {
+        blocks[i].size = 16 + (i % 8) * 16;
+        blocks[i].p = malloc(blocks[i].size);
+        blocks[i].id = (static_cast<uint64_t>(t) << 32) | i;
+        blocks[i].Mark();
+      }
+      // Keep all threads alive until every thread has allocated.
+      allocated++;
+      while (allocated.load() < kThreads) {
+        std::this_thread::yield();
+      }
+      for (const Block& b : blocks) {
+        if (!b.Check()) {
+          corrupted++;
+        }
+        free(b.p);
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(0u, corrupted.load());
+}
+
+
+// Short-lived threads leave blocks behind that are freed after the threads
+// have terminated, i.e., into spans of reclaimed cores. Cores of terminated
+// threads are reused, so their number stays bounded.
+TEST(ThreadReclaimTest, BlocksOutliveTheirThreads) {
+  const int kWaves = 250;
+  const int kThreadsPerWave = 8;
+  const size_t kBlocks = 64;
+  std::vector<Block> handed_over[kThreadsPerWave];
+  std::vector<Block> previous;
+  std::atomic<uint64_t> corrupted(0);
+  const uint64_t cores_before = CtlRead("stats.cores.count");
+  for (int wave = 0; wave < kWaves; wave++) {
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreadsPerWave; t++) {
+      threads.emplace_back([&handed_over, wave, t] {
+        std::vector<void*> own;
+        for (size_t i = 0; i < kBlocks; i++) {
+          Block b;
+          b.size = 16 << (i % 8);
+          b.p = malloc(b.size);
+          b.id = (static_cast<uint64_t>(wave) << 32) |
+                 (static_cast<uint64_t>(t) << 16) | i;
+          b.Mark();
+          if ((i % 2) == 0) {
+            handed_over[t].push_back(b);
+          } else {
+            own.push_back(b.p);
+          }
+        }
+        for (void* p : own) {
+          free(p);
+        }
+      });
+    }
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+    // Blocks of the wave before last, whose cores have been reused since.
+    for (const Block& b : previous) {
+      if (!b.Check()) {
+        corrupted++;
+      }
+      free(b.p);
+    }
+    previous.clear();
+    for (std::vector<Block>& blocks : handed_over) {
+      previous.insert(previous.end(), blocks.begin(), blocks.end());
+      blocks.clear();
+    }
+  }
+  for (const Block& b : previous) {
+    EXPECT_TRUE(b.Check());
+    free(b.p);
+  }
+  EXPECT_EQ(0u, corrupted.load());
+  EXPECT_LE(CtlRead("stats.cores.count"),
+            cores_before + 2 * kThreadsPerWave);
+}
+
+
+// Threads exit while other threads still free into their spans.
+TEST(ThreadReclaimTest, ExitWhileFreeing) {
+  const int kRounds = 200;
+  const size_t kBlocks = 256;
+  std::atomic<uint64_t> corrupted(0);
+  std::vector<Block> blocks;
+  for (int round = 0; round < kRounds; round++) {
+    std::vector<Block> next(kBlocks);
+    std::thread allocator([&next, round] {
+      for (size_t i = 0; i < kBlocks; i++) {
+        next[i].size = 32 + (i % 4) * 32;
+        next[i].p = malloc(next[i].size);
+        next[i].id = (static_cast<uint64_t>(round) << 32) | i;
+        next[i].Mark();
+      }
+    });
+    std::thread freer([&blocks, &corrupted] {
+      for (const Block& b : blocks) {
+        if (!b.Check()) {
+          corrupted++;
+        }
+        free(b.p);
+      }
+    });
+    allocator.join();
+    freer.join();
+    blocks.swap(next);
+  }
+  for (const Block& b : blocks) {
+    free(b.p);
+  }
+  EXPECT_EQ(0u, corrupted.load());
+}
+
+}  // namespace
@@ -0,0 +1,77 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+#include <malloc.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gtest/gtest.h"
+#include "scalloc.h"
+
+namespace {
+
+#define MALLOCX_LG_ALIGN(la) (static_cast<int>(la))
+
+TEST(UsableSizeTest, CoversRequestedSize) {
+  for (size_t size = 1; size <= (8 << 20); size += (size / 8) + 1) {
+    void* p = malloc(size);
+    const size_t usable = malloc_usable_size(p);
+    EXPECT_GE(usable, size);
+    EXPECT_EQ(usable, scalloc_malloc_usable_size(p));
+    // The slack may be used.
+    memset(p, 0x5a, usable);
+    free(p);
+  }
+  EXPECT_EQ(0u, malloc_usable_size(NULL));
+}
+
+
+// Mappings of large objects that are reused from the large object cache may be
+// larger than the smallest size that nallocx() reports.
+TEST(UsableSizeTest, NallocxMatchesMalloc) {
+  for (size_t size = 1; size <= (8 << 20); size += (size / 8) + 1) {
+    void* p = malloc(size);
+    const size_t expected = scalloc_nallocx(size, 0);
+    EXPECT_GE(expected, size);
+    if (size <= (1 << 20)) {
+      EXPECT_EQ(malloc_usable_size(p), expected) << "size " << size;
+    } else {
+      EXPECT_LE(expected, malloc_usable_size(p)) << "size " << size;
+    }
+    free(p);
+  }
+}
+
+
+TEST(UsableSizeTest, NallocxMatchesAlignedAlloc) {
+  for (size_t la = 4; la <= 22; la++) {
+    const size_t alignment = static_cast<size_t>(1) << la;
+    for (size_t size : { alignment, 3 * alignment }) {
+      void* p = aligned_alloc(alignment, size);
+      const size_t expected = scalloc_nallocx(size, MALLOCX_LG_ALIGN(la));
+      EXPECT_GE(expected, size);
+      if (size <= (1 << 20)) {
+        EXPECT_EQ(malloc_usable_size(p), expected)
+            << "alignment " << alignment << " size " << size;
+      } else {
+        EXPECT_LE(expected, malloc_usable_size(p))
+            << "alignment " << alignment << " size " << size;
+      }
+      free(p);
+    }
+  }
+}
+
+
+TEST(UsableSizeTest, NallocxFailures) {
+  EXPECT_EQ(0u, scalloc_nallocx(0, 0));
+  EXPECT_EQ(0u, scalloc_nallocx(SIZE_MAX, 0));
+  EXPECT_EQ(0u, scalloc_nallocx(SIZE_MAX - 4096, 0));
+  // The header or the alignment slack of a large object overflows.
+  EXPECT_EQ(0u, scalloc_nallocx(SIZE_MAX - 4096, MALLOCX_LG_ALIGN(20)));
+  EXPECT_EQ(0u, scalloc_nallocx(SIZE_MAX / 2 + 1, MALLOCX_LG_ALIGN(63)));
+}
+
+}  // namespace
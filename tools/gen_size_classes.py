@@ -0,0 +1,249 @@
+#!/usr/bin/env python
+#
+# Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+# Please see the AUTHORS file for details.  Use of this source code is governed
+# by a BSD license that can be found in the LICENSE file.
+
+"""Generates src/size_classes_raw.h.
+
+Fine classes cover sizes up to 256 bytes in steps of 16 bytes. Coarse (medium)
+classes cover sizes up to 1MiB. Every power of two above 256 bytes is split
+into eight bins, and coarse classes may only end on bin boundaries. This keeps
+SizeToClass() at a single table lookup per medium size. Sizes up to
+MAX_DIRECT_SIZE are mapped by a table indexed by size in steps of 16 bytes
+instead.
+
+Every table also gets one aligned class per power of two from 256 bytes to 1MiB
+(see AlignedSizeToClass()), whose spans leave out a whole block for the header,
+so that all blocks are aligned to their size.
+
+Modes:
+  huge                One coarse class per power of two.
+  steps N             N coarse classes per power of two (1, 2, 4, or 8).
+  tuned HISTOGRAM [N] Powers of two plus up to N (default: 36) additional
+                      coarse classes that minimize the internal fragmentation
+                      of the given histogram.
+
+A histogram is either a heap profile written by scalloc's heap profiler (see
+prof.dump), using the average size of the allocations of every stack trace
+scaled by the sampling probability, or a text file with one "size count" pair
+per line.
+
+Example:
+  tools/gen_size_classes.py steps 4 > src/size_classes_raw.h
+"""
+
+import math
+import sys
+
+SPAN_HEADER_SIZE = 128
+MIN_ALIGNMENT = 16
+MAX_SMALL_SHIFT = 8
+MAX_MEDIUM_SHIFT = 20
+FINE_SPAN_SIZE = 32768
+# Bins per power of two, log2.
+MEDIUM_BIN_SHIFT = 3
+MEDIUM_BINS = 1 << MEDIUM_BIN_SHIFT
+# Largest size that is looked up directly, see FOR_ALL_DIRECT_SIZES.
+MAX_DIRECT_SIZE = 4096
+# Smallest aligned class, log2. Smaller alignments are served by regular
+# classes.
+MIN_ALIGNED_SHIFT = 8
+DEFAULT_TUNED_CLASSES = 36
+
+
+def Usage():
+  sys.stderr.write(__doc__)
+  sys.exit(1)
+
+
+def BinEnds():
+  """All sizes a coarse class may have, in increasing order."""
+  ends = []
+  for shift in range(MAX_SMALL_SHIFT, MAX_MEDIUM_SHIFT):
+    step = (1 << shift) // MEDIUM_BINS
+    for i in range(1, MEDIUM_BINS + 1):
+      ends.append((1 << shift) + i * step)
+  return ends
+
+
+def PowersOfTwo():
+  return [1 << s for s in range(MAX_SMALL_SHIFT + 1, MAX_MEDIUM_SHIFT + 1)]
+
+
+def StepClasses(steps):
+  if steps not in (1, 2, 4, 8):
+    Usage()
+  stride = MEDIUM_BINS // steps
+  return BinEnds()[stride - 1::stride]
+
+
+def ReadHistogram(path):
+  """Returns a dict of size -> count for medium sizes."""
+  histogram = {}
+  with open(path) as f:
+    lines = f.readlines()
+  profile = (len(lines) > 0) and lines[0].startswith('heap profile:')
+  if profile:
+    # "... @ heap_v2/<sample rate>"
+    rate = int(lines[0].split('/')[-1])
+  for line in lines[1:] if profile else lines:
+    if profile:
+      # "live: live_bytes [allocs: alloc_bytes] @ stack", see profiler.h.
+      if '@' not in line or '[' not in line:
+        continue
+      allocs = line.split('[')[1].split(']')[0].split(':')
+      count = int(allocs[0])
+      if count == 0:
+        continue
+      size = int(allocs[1]) // count
+      # Larger objects are more likely to be sampled.
+      if rate > 0:
+        count = int(round(count / (1 - math.exp(-float(size) / rate))))
+    else:
+      fields = line.split()
+      if len(fields) != 2 or fields[0].startswith('#'):
+        continue
+      size, count = int(fields[0]), int(fields[1])
+    if (1 << MAX_SMALL_SHIFT) < size <= (1 << MAX_MEDIUM_SHIFT):
+      histogram[size] = histogram.get(size, 0) + count
+  return histogram
+
+
+def Waste(histogram, lower, upper):
+  """Bytes wasted by sizes in (lower, upper] when rounded up to upper."""
+  return sum(c * (upper - s)
+             for s, c in histogram.items() if lower < s <= upper)
+
+
+def TunedClasses(histogram, extra):
+  """Picks up to extra bin ends in addition to the powers of two, minimizing
+  the wasted bytes over the histogram. Powers of two are always classes, which
+  bounds the waste for sizes that are missing from the histogram."""
+  classes = set(PowersOfTwo())
+  # Classes are added one at a time, always the one saving the most bytes.
+  ends = BinEnds()
+  for _ in range(extra):
+    best = None
+    best_gain = 0
+    current = sorted(classes)
+    for end in ends:
+      if end in classes:
+        continue
+      lower = max([c for c in current if c < end] + [1 << MAX_SMALL_SHIFT])
+      upper = min(c for c in current if c > end)
+      gain = (Waste(histogram, lower, upper) -
+              Waste(histogram, lower, end) - Waste(histogram, end, upper))
+      if gain > best_gain:
+        best, best_gain = end, gain
+    if best is None:
+      break
+    classes.add(best)
+  return sorted(classes)
+
+
+def SpanObjects(size):
+  """Objects per span of a coarse class, by the power of two above it."""
+  p = 1 << (size - 1).bit_length()
+  if p <= 2048:
+    return 64
+  if p <= 8192:
+    return 32
+  if p <= 65536:
+    return 16
+  return (1 << MAX_MEDIUM_SHIFT) // p
+
+
+def AlignedClasses():
+  return [1 << s for s in range(MIN_ALIGNED_SHIFT, MAX_MEDIUM_SHIFT + 1)]
+
+
+def Generate(mode, coarse):
+  out = []
+  w = out.append
+  fine = (1 << MAX_SMALL_SHIFT) // MIN_ALIGNMENT + 1
+  w('// Copyright (c) 2015, the scalloc Project Authors.  All rights reserved.')
+  w('// Please see the AUTHORS file for details.  Use of this source code is '
+    'governed')
+  w('// by a BSD license that can be found in the LICENSE file.')
+  w('')
+  w('//')
+  w('//                          +----------------+')
+  w('//                          |  DO NOT EDIT!  |')
+  w('//                          +----------------+')
+  w('//')
+  w("// This file is auto-generated using ``tools/gen_size_classes.py %s''" %
+    mode)
+  w('')
+  w('#ifndef SCALLOC_SIZE_CLASSES_RAW_H_')
+  w('#define SCALLOC_SIZE_CLASSES_RAW_H_')
+  w('')
+  w('const int32_t kSpanHeaderSize = %d;' % SPAN_HEADER_SIZE)
+  w('const size_t kCoarseClasses = %d;' % len(coarse))
+  w('const size_t kAlignedClasses = %d;' % len(AlignedClasses()))
+  w('const int32_t kMinAlignedShift = %d;' % MIN_ALIGNED_SHIFT)
+  w('const int32_t kMediumBinShift = %d;' % MEDIUM_BIN_SHIFT)
+  w('const size_t kMaxDirectSize = %d;' % MAX_DIRECT_SIZE)
+  w('')
+  w('#define FOR_ALL_SIZE_CLASSES(V) \\')
+  lines = ['  V(0, 0, 0, 0) /* NOLINT */']
+  for i in range(1, fine):
+    size = i * MIN_ALIGNMENT
+    lines.append('  V(%d, %d, %d, (%d - kSpanHeaderSize)/%d) /* NOLINT */' %
+                 (i, size, FINE_SPAN_SIZE, FINE_SPAN_SIZE, size))
+  for i, size in enumerate(coarse):
+    objects = SpanObjects(size)
+    lines.append('  V(%d, %d, ((%d * %d + kSpanHeaderSize)/kPageSize + 1) * '
+                 'kPageSize, %d) /* NOLINT */' %
+                 (fine + i, size, objects, size, objects))
+  first_aligned = fine + len(coarse)
+  for i, size in enumerate(AlignedClasses()):
+    objects = SpanObjects(size)
+    lines.append('  V(%d, %d, ((%d * %d + kPageSize - 1)/kPageSize) * '
+                 'kPageSize, %d) /* NOLINT */' %
+                 (first_aligned + i, size, objects + 1, size, objects))
+  w(' \\\n'.join(lines))
+  w('')
+  w('// The coarse class of every bin of medium sizes, see SizeToClass().')
+  w('#define FOR_ALL_MEDIUM_BINS(V) \\')
+  lines = []
+  for i, end in enumerate(BinEnds()):
+    sc = fine + min(j for j, size in enumerate(coarse) if size >= end)
+    lines.append('  V(%d, %d) /* NOLINT */' % (i, sc))
+  w(' \\\n'.join(lines))
+  w('')
+  w('// The class of every size up to kMaxDirectSize, in steps of 16 bytes, see')
+  w('// SizeToClass().')
+  w('#define FOR_ALL_DIRECT_SIZES(V) \\')
+  lines = []
+  for i in range(MAX_DIRECT_SIZE // MIN_ALIGNMENT + 1):
+    size = i * MIN_ALIGNMENT
+    if size <= (1 << MAX_SMALL_SHIFT):
+      sc = i
+    else:
+      sc = fine + min(j for j, c in enumerate(coarse) if c >= size)
+    lines.append('  V(%d, %d) /* NOLINT */' % (i, sc))
+  w(' \\\n'.join(lines))
+  w('')
+  w('#endif  // SCALLOC_SIZE_CLASSES_RAW_H_')
+  return '\n'.join(out) + '\n'
+
+
+def main(argv):
+  if len(argv) < 1:
+    Usage()
+  if argv[0] == 'huge' and len(argv) == 1:
+    coarse = StepClasses(1)
+  elif argv[0] == 'steps' and len(argv) == 2:
+    coarse = StepClasses(int(argv[1]))
+  elif argv[0] == 'tuned' and len(argv) in (2, 3):
+    extra = int(argv[2]) if len(argv) == 3 else DEFAULT_TUNED_CLASSES
+    coarse = TunedClasses(ReadHistogram(argv[1]), extra)
+  else:
+    Usage()
+  assert coarse[-1] == (1 << MAX_MEDIUM_SHIFT)
+  sys.stdout.write(Generate(' '.join(argv), coarse))
+
+
+if __name__ == '__main__':
+  main(sys.argv[1:])
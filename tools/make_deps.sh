@@ -7,8 +7,7 @@ echo "gyp... "
 echo ""
 
 if [[ -d build/gyp ]]; then
-  cd build/gyp
-  git pull
+  (cd build/gyp && git pull)
 else
   mkdir -p build/gyp
   git clone https://chromium.googlesource.com/external/gyp build/gyp
@@ -21,4 +20,21 @@ else
   exit $?
 fi
 
+echo "googletest... "
+echo ""
+
+if [[ -d build/googletest ]]; then
+  (cd build/googletest && git fetch --tags && git checkout -q release-1.12.1)
+else
+  mkdir -p build/googletest
+  git clone -b release-1.12.1 https://github.com/google/googletest build/googletest
+fi
+
+if [ $? -eq 0 ]; then
+  echo ""
+  echo "googletest... done"
+else
+  exit $?
+fi
+
 
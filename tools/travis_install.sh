@@ -8,9 +8,10 @@ fi
 
 if [[ $(uname -s) = "Linux" ]]; then
   echo "Linux install start"
-  sudo apt-get install -qq gcc-4.8 g++-4.8 
-  # We want to compile with g++ 4.8 when rather than the default g++
-  sudo update-alternatives --install /usr/bin/g++ g++ /usr/bin/g++-4.8 90
+  sudo apt-get install -qq gcc-7 g++-7
+  # We want to compile with g++ 7 rather than the default g++, as the tests
+  # (googletest) need C++14.
+  sudo update-alternatives --install /usr/bin/g++ g++ /usr/bin/g++-7 90
   tools/make_deps.sh
   echo "Linux install end"
 fi
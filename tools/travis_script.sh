@@ -1,5 +1,7 @@
 #!/bin/bash
 
+set -e
+
 if [[ $(uname -s) = "Darwin" ]]; then
   build/gyp/gyp --depth=. scalloc.gyp --build=Debug
   build/gyp/gyp --depth=. scalloc.gyp --build=Release
@@ -9,5 +11,10 @@ if [[ $(uname -s) = "Linux" ]]; then
   build/gyp/gyp --depth=. scalloc.gyp
   V=1 BUILDTYPE=Debug make
   V=1 BUILDTYPE=Release make
+  out/Debug/api_test
+  out/Release/api_test
+  # The other allocation buffer models, see SCALLOC_CONF.
+  SCALLOC_CONF=lab_model:rr out/Release/api_test
+  SCALLOC_CONF=lab_model:percpu out/Release/api_test
 fi
 